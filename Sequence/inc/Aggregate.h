@@ -0,0 +1,135 @@
+/*
+ * Aggregate.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: R. Krishnaswamy
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include "inc/Sequence.h"
+
+// An Aggregate is a policy of GenericSequence.  Each element of the
+// sequence keeps the aggregate of the subtree it roots, so that the
+// aggregate over any range of indices can be computed in O(log n).
+// An Aggregate class provides:
+//
+//   - The type of an aggregated value
+//       typedef ... ValueType;
+//   - Whether aggregates are kept at all
+//       static constexpr bool isEnabled = true;
+//   - The aggregate of an empty range
+//       static ValueType identity();
+//   - The aggregate of a single element, of the given width
+//       static ValueType of(const ElementType& elt, IndexType width);
+//   - An associative combination of the aggregates of two adjacent
+//     ranges, the first range being on the left.  It need not be
+//     commutative.
+//       static ValueType combine(const ValueType& left,
+//                                const ValueType& right);
+//
+// For instance, a count of flagged elements is a SumAggregate whose Key
+// returns 1 for a flagged element and 0 otherwise.
+
+// The default policy, which keeps no aggregates.
+template <class ElementType>
+struct NoAggregate
+{
+	struct ValueType
+	{};
+
+	static constexpr bool isEnabled = false;
+
+	static ValueType identity()
+	{
+		return ValueType();
+	}
+
+	static ValueType of(const ElementType&, IndexType)
+	{
+		return ValueType();
+	}
+
+	static ValueType combine(const ValueType&, const ValueType&)
+	{
+		return ValueType();
+	}
+};
+
+
+// The sum, minimum and maximum of Key()(elt) over a range.  Key is a
+// function object type that gives the value of an element.
+template <class ElementType, class Key>
+struct SumAggregate
+{
+	typedef decltype(Key()(std::declval<const ElementType&>())) ValueType;
+
+	static constexpr bool isEnabled = true;
+
+	static ValueType identity()
+	{
+		return ValueType();
+	}
+
+	static ValueType of(const ElementType& elt, IndexType)
+	{
+		return Key()(elt);
+	}
+
+	static ValueType combine(const ValueType& left, const ValueType& right)
+	{
+		return left + right;
+	}
+};
+
+
+template <class ElementType, class Key>
+struct MinAggregate
+{
+	typedef decltype(Key()(std::declval<const ElementType&>())) ValueType;
+
+	static constexpr bool isEnabled = true;
+
+	static ValueType identity()
+	{
+		return std::numeric_limits<ValueType>::max();
+	}
+
+	static ValueType of(const ElementType& elt, IndexType)
+	{
+		return Key()(elt);
+	}
+
+	static ValueType combine(const ValueType& left, const ValueType& right)
+	{
+		return std::min(left, right);
+	}
+};
+
+
+template <class ElementType, class Key>
+struct MaxAggregate
+{
+	typedef decltype(Key()(std::declval<const ElementType&>())) ValueType;
+
+	static constexpr bool isEnabled = true;
+
+	static ValueType identity()
+	{
+		return std::numeric_limits<ValueType>::lowest();
+	}
+
+	static ValueType of(const ElementType& elt, IndexType)
+	{
+		return Key()(elt);
+	}
+
+	static ValueType combine(const ValueType& left, const ValueType& right)
+	{
+		return std::max(left, right);
+	}
+};
@@ -0,0 +1,826 @@
+/*
+ * BTreeSequence.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: R. Krishnaswamy
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include "inc/Sequence.h"
+
+using namespace std;
+
+// The template BTreeSequence has the same index and offset API as
+// GenericSequence, but is a B+-tree rather than an AVL tree.  A lookup in
+// the AVL tree takes one dependent cache miss per level, that is about
+// 27 misses at 10^8 elements.  The B+-tree has far fewer levels:
+//    - A leaf holds up to LeafCapacity elements, with their widths, in
+//      contiguous arrays.  The leaves are also linked in order, so that
+//      a scan does not visit the branches.
+//    - A branch holds up to BranchCapacity children, with the prefix sums
+//      of the weights and widths of the children.  These arrays are
+//      padded with NoEntry up to BranchCapacity, so that the search for
+//      a child is a fixed-length count of comparisons, which the compiler
+//      turns into SIMD code.
+// Each node other than the root is kept at least half full, by merging
+// with or borrowing from a sibling on removal.
+
+template <
+// The class ElementType is expected to be default constructible and
+// move assignable.
+class ElementType,
+
+// The largest number of elements of a leaf.
+IndexType LeafCapacity = 64,
+
+// The largest number of children of a branch.
+IndexType BranchCapacity = 32
+>
+class BTreeSequence
+{
+	static_assert(LeafCapacity >= 4, "Leaves must hold at least 4 elements");
+	static_assert(BranchCapacity >= 4, "Branches must hold at least 4 children");
+
+	struct Leaf;
+
+public:
+	// An Iterator visits the elements in order, through the chain of
+	// leaves.  It is a bidirectional iterator.
+	class Iterator
+	{
+	public:
+		typedef std::bidirectional_iterator_tag iterator_category;
+		typedef ElementType value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef ElementType* pointer;
+		typedef ElementType& reference;
+
+		Iterator()
+		{}
+
+		Iterator(const BTreeSequence* pSeq, Leaf* pLeaf, IndexType position)
+		: m_pSeq(pSeq), m_pLeaf(pLeaf), m_position(position)
+		{}
+
+		ElementType& operator*() const
+		{
+			return m_pLeaf->m_elts[m_position];
+		}
+
+		ElementType* operator->() const
+		{
+			return &m_pLeaf->m_elts[m_position];
+		}
+
+		Iterator& operator++()
+		{
+			if (++m_position == m_pLeaf->m_count) {
+				m_pLeaf = m_pLeaf->m_pNext;
+				m_position = 0;
+			}
+			return *this;
+		}
+
+		Iterator operator++(int)
+		{
+			Iterator old = *this;
+			++(*this);
+			return old;
+		}
+
+		// Decrementing end() gives the last element.
+		Iterator& operator--()
+		{
+			if (m_pLeaf == nullptr) {
+				m_pLeaf = m_pSeq->getLastLeaf();
+				m_position = m_pLeaf->m_count;
+			} else if (m_position == 0) {
+				m_pLeaf = m_pLeaf->m_pPrev;
+				m_position = m_pLeaf->m_count;
+			}
+			m_position--;
+			return *this;
+		}
+
+		Iterator operator--(int)
+		{
+			Iterator old = *this;
+			--(*this);
+			return old;
+		}
+
+		bool operator==(const Iterator& that) const
+		{
+			return (m_pLeaf == that.m_pLeaf) && (m_position == that.m_position);
+		}
+
+		bool operator!=(const Iterator& that) const
+		{
+			return !(*this == that);
+		}
+
+	private:
+		const BTreeSequence* m_pSeq = nullptr;
+
+		// The current leaf and position in it, or nullptr at the end.
+		Leaf* m_pLeaf = nullptr;
+		IndexType m_position = 0;
+	};
+
+	// Constructor
+	BTreeSequence()
+	{}
+
+	BTreeSequence(const BTreeSequence&) = delete;
+	BTreeSequence& operator=(const BTreeSequence&) = delete;
+
+	// Virtual destructor
+	virtual ~BTreeSequence()
+	{
+		clear();
+	}
+
+	// Destroys all elements of the sequence, so it can be reused.
+	void clear()
+	{
+		destroySubtree(m_pRoot);
+		m_pRoot = nullptr;
+	}
+
+	// Current length of the sequence.  This is one more than the last
+	// index.  Initial length of the sequence is zero.
+	IndexType getLength() const
+	{
+		return weightOf(m_pRoot);
+	}
+
+	// To insert an element at a particular (zero-based) index.  Valid
+	// indices are from zero to length().  If the index is length(),
+	// then the new element is inserted at the end (appended).  The last
+	// defaulted parameter provides the width of the new element.
+	void insertAtIndex(const ElementType& elt, IndexType atIndex, IndexType width = 0)
+	{
+		if (atIndex > getLength()) {
+			// Error
+			throw std::length_error("Invalid index!");
+		}
+
+		// The element is copied before anything is changed, so that if
+		// the copy throws, the sequence is unchanged.
+		ElementType copy = elt;
+
+		if (m_pRoot == nullptr) {
+			m_pRoot = new Leaf();
+		}
+
+		// Descend to the leaf, choosing the last child whose range
+		// precedes atIndex, so that an append goes to the last leaf.
+		Path path;
+		Node* pNode = m_pRoot;
+		IndexType index = atIndex;
+		while (!pNode->m_isLeaf) {
+			Branch* pBranch = (Branch*) pNode;
+			IndexType position = std::min(countBelow(pBranch->m_prefixWeight, index),
+					                      pBranch->m_count - 1);
+			index -= weightBefore(pBranch, position);
+			path.push(pBranch, position);
+			pNode = pBranch->m_children[position];
+		}
+
+		Leaf* pLeaf = (Leaf*) pNode;
+		std::move_backward(pLeaf->m_elts + index, pLeaf->m_elts + pLeaf->m_count,
+				           pLeaf->m_elts + pLeaf->m_count + 1);
+		std::move_backward(pLeaf->m_widths + index, pLeaf->m_widths + pLeaf->m_count,
+				           pLeaf->m_widths + pLeaf->m_count + 1);
+		pLeaf->m_elts[index] = std::move(copy);
+		pLeaf->m_widths[index] = width;
+		pLeaf->m_count++;
+		pLeaf->m_cumWidth += width;
+
+		// Fix up the ancestors bottom-up.  A node that overflows is split,
+		// and its new sibling is inserted in its parent.
+		Node* pSibling = (pLeaf->m_count > LeafCapacity) ? splitLeaf(pLeaf) : nullptr;
+		for (IndexType level = path.m_depth; level-- > 0; ) {
+			Branch* pBranch = path.m_branches[level];
+			IndexType position = path.m_positions[level];
+			addToPrefixes(pBranch, position, 1, width);
+
+			pSibling = (pSibling == nullptr) ? nullptr : insertChild(pBranch, position, pSibling);
+		}
+
+		if (pSibling != nullptr) {
+			Branch* pRoot = new Branch();
+			pRoot->m_children[0] = m_pRoot;
+			pRoot->m_children[1] = pSibling;
+			pRoot->m_count = 2;
+			refresh(pRoot, 0);
+			m_pRoot = pRoot;
+		}
+	}
+
+	// To append an element.  The last defaulted parameter provides the width
+	// of the new element.
+	void append(const ElementType& elt, IndexType width = 0)
+	{
+		insertAtIndex(elt, getLength(), width);
+	}
+
+	// To remove an element from the sequence.  The element is destroyed.
+	void remove(IndexType index)
+	{
+		Path path;
+		IndexType position = findLeaf(index, path);
+		Leaf* pLeaf = (Leaf*) path.m_pNode;
+		IndexType width = pLeaf->m_widths[position];
+
+		std::move(pLeaf->m_elts + position + 1, pLeaf->m_elts + pLeaf->m_count,
+				  pLeaf->m_elts + position);
+		std::move(pLeaf->m_widths + position + 1, pLeaf->m_widths + pLeaf->m_count,
+				  pLeaf->m_widths + position);
+		pLeaf->m_count--;
+		pLeaf->m_cumWidth -= width;
+
+		// Release whatever the element holds.
+		pLeaf->m_elts[pLeaf->m_count] = ElementType();
+
+		// Fix up the ancestors bottom-up.  A child that underflows is
+		// merged with, or borrows from, a sibling.
+		for (IndexType level = path.m_depth; level-- > 0; ) {
+			Branch* pBranch = path.m_branches[level];
+			IndexType childPosition = path.m_positions[level];
+			addToPrefixes(pBranch, childPosition, -1, -width);
+			rebalanceChild(pBranch, childPosition);
+		}
+
+		// The root may be left with a single child, or no elements.
+		while (!m_pRoot->m_isLeaf && (m_pRoot->m_count == 1)) {
+			Branch* pRoot = (Branch*) m_pRoot;
+			m_pRoot = pRoot->m_children[0];
+			delete pRoot;
+		}
+
+		if (m_pRoot->m_count == 0) {
+			destroySubtree(m_pRoot);
+			m_pRoot = nullptr;
+		}
+	}
+
+	// This method will throw an exception unless index is between 0 and
+	// count-1 where count is the number of elements in the sequence.
+	ElementType& operator[](IndexType index)
+	{
+		Path path;
+		IndexType position = findLeaf(index, path);
+		return ((Leaf*) path.m_pNode)->m_elts[position];
+	}
+
+	// Each Element has a "width" attribute that indicates how much space
+	// it occupies.  This is by default 0 if not specified.  It can be
+	// specified by this method.
+	void setWidth(IndexType index, IndexType width)
+	{
+		Path path;
+		IndexType position = findLeaf(index, path);
+		Leaf* pLeaf = (Leaf*) path.m_pNode;
+		IndexType delta = width - pLeaf->m_widths[position];
+
+		pLeaf->m_widths[position] = width;
+		pLeaf->m_cumWidth += delta;
+		for (IndexType level = 0; level < path.m_depth; level++) {
+			addToPrefixes(path.m_branches[level], path.m_positions[level], 0, delta);
+		}
+	}
+
+	// The width of an Element can be queried.
+	IndexType getWidth(IndexType index) const
+	{
+		Path path;
+		IndexType position = findLeaf(index, path);
+		return ((Leaf*) path.m_pNode)->m_widths[position];
+	}
+
+	// The start offset of an element can be queried.
+	IndexType getStartOffset(IndexType index) const
+	{
+		Path path;
+		IndexType position = findLeaf(index, path);
+
+		IndexType startOffset = 0;
+		for (IndexType level = 0; level < path.m_depth; level++) {
+			startOffset += widthBefore(path.m_branches[level], path.m_positions[level]);
+		}
+
+		const Leaf* pLeaf = (const Leaf*) path.m_pNode;
+		for (IndexType i = 0; i < position; i++) {
+			startOffset += pLeaf->m_widths[i];
+		}
+
+		return startOffset;
+	}
+
+	// Each element occupies an extant specified by its start offset and
+	// its width.  This gets the element whose extent spans the given offset.
+	ElementType getElementAtOffset(IndexType offset) const
+	{
+		if (offset >= widthOf(m_pRoot)) {
+			throw std::range_error("Invalid index!");
+		}
+
+		// A child with the offset is the first whose prefix width exceeds
+		// it, which skips children of zero width.
+		const Node* pNode = m_pRoot;
+		while (!pNode->m_isLeaf) {
+			const Branch* pBranch = (const Branch*) pNode;
+			IndexType position = countAtMost(pBranch->m_prefixWidth, offset);
+			offset -= widthBefore(pBranch, position);
+			pNode = pBranch->m_children[position];
+		}
+
+		const Leaf* pLeaf = (const Leaf*) pNode;
+		IndexType position = 0;
+		while (offset >= pLeaf->m_widths[position]) {
+			offset -= pLeaf->m_widths[position];
+			position++;
+		}
+
+		return pLeaf->m_elts[position];
+	}
+
+	// Iterators over the elements in order.  end() is past the last
+	// element.
+	Iterator begin() const
+	{
+		if (m_pRoot == nullptr) {
+			return end();
+		}
+
+		Node* pNode = m_pRoot;
+		while (!pNode->m_isLeaf) {
+			pNode = ((Branch*) pNode)->m_children[0];
+		}
+
+		return Iterator(this, (Leaf*) pNode, 0);
+	}
+
+	Iterator end() const
+	{
+		return Iterator(this, nullptr, 0);
+	}
+
+	// An iterator at a particular (zero-based) index.  If the index is
+	// length() or more, this is end().
+	Iterator iteratorAt(IndexType index) const
+	{
+		if (index >= getLength()) {
+			return end();
+		}
+
+		Path path;
+		IndexType position = findLeaf(index, path);
+		return Iterator(this, (Leaf*) path.m_pNode, position);
+	}
+
+	// To verify tree properties.  The prefix weights and widths need to
+	// be correct, the nodes at least half full, the leaves at the same
+	// depth and linked in order.  It throws an exception on the first
+	// node that is not.  This method is used in testing.
+	void verify() const
+	{
+		if (m_pRoot == nullptr) {
+			return;
+		}
+
+		const Leaf* pPrev = nullptr;
+		IndexType leafDepth = Sequence::UndefinedIndex;
+		verify(m_pRoot, 0, leafDepth, pPrev);
+		if (pPrev->m_pNext != nullptr) {
+			throw logic_error("Last leaf has a successor!");
+		}
+	}
+
+private:
+	// The value of the unused prefix entries of a branch.
+	static constexpr IndexType NoEntry = std::numeric_limits<IndexType>::max();
+
+	// Levels of a tree of at least BranchCapacity/2 >= 2 children per branch.
+	static constexpr IndexType MaxDepth = std::numeric_limits<IndexType>::digits;
+
+	struct Node
+	{
+		Node(bool isLeaf)
+		: m_isLeaf(isLeaf)
+		{}
+
+		bool m_isLeaf;
+
+		// Number of elements of a leaf, or children of a branch.
+		IndexType m_count = 0;
+	};
+
+	// The arrays have room for one more entry than the capacity, which
+	// is used until an overflowing node is split.
+	struct Leaf : public Node
+	{
+		Leaf()
+		: Node(true)
+		{}
+
+		ElementType m_elts[LeafCapacity + 1];
+		IndexType m_widths[LeafCapacity + 1];
+		IndexType m_cumWidth = 0;
+		Leaf* m_pPrev = nullptr;
+		Leaf* m_pNext = nullptr;
+	};
+
+	struct Branch : public Node
+	{
+		Branch()
+		: Node(false)
+		{
+			std::fill(m_prefixWeight, m_prefixWeight + BranchCapacity + 1, NoEntry);
+			std::fill(m_prefixWidth, m_prefixWidth + BranchCapacity + 1, NoEntry);
+		}
+
+		Node* m_children[BranchCapacity + 1];
+
+		// The total weight and width of children 0 .. i.
+		IndexType m_prefixWeight[BranchCapacity + 1];
+		IndexType m_prefixWidth[BranchCapacity + 1];
+	};
+
+	// The branches and child positions from the root to a leaf.
+	struct Path
+	{
+		void push(Branch* pBranch, IndexType position)
+		{
+			m_branches[m_depth] = pBranch;
+			m_positions[m_depth] = position;
+			m_depth++;
+		}
+
+		Branch* m_branches[MaxDepth];
+		IndexType m_positions[MaxDepth];
+		IndexType m_depth = 0;
+
+		// The leaf
+		Node* m_pNode = nullptr;
+	};
+
+	Node* m_pRoot = nullptr;
+
+	static IndexType weightOf(const Node* pNode)
+	{
+		if (pNode == nullptr) {
+			return 0;
+		}
+
+		return pNode->m_isLeaf ? pNode->m_count
+				               : ((const Branch*) pNode)->m_prefixWeight[pNode->m_count - 1];
+	}
+
+	static IndexType widthOf(const Node* pNode)
+	{
+		if (pNode == nullptr) {
+			return 0;
+		}
+
+		return pNode->m_isLeaf ? ((const Leaf*) pNode)->m_cumWidth
+				               : ((const Branch*) pNode)->m_prefixWidth[pNode->m_count - 1];
+	}
+
+	static IndexType weightBefore(const Branch* pBranch, IndexType position)
+	{
+		return (position == 0) ? 0 : pBranch->m_prefixWeight[position - 1];
+	}
+
+	static IndexType widthBefore(const Branch* pBranch, IndexType position)
+	{
+		return (position == 0) ? 0 : pBranch->m_prefixWidth[position - 1];
+	}
+
+	// The number of prefix entries that are less than (or at most) the
+	// key.  The loops have a fixed length and no branches, so that they
+	// are vectorized.  The unused entries are NoEntry, and so not counted.
+	static IndexType countBelow(const IndexType* prefix, IndexType key)
+	{
+		IndexType count = 0;
+		for (IndexType i = 0; i < BranchCapacity; i++) {
+			count += (prefix[i] < key);
+		}
+		return count;
+	}
+
+	static IndexType countAtMost(const IndexType* prefix, IndexType key)
+	{
+		IndexType count = 0;
+		for (IndexType i = 0; i < BranchCapacity; i++) {
+			count += (prefix[i] <= key);
+		}
+		return count;
+	}
+
+	// Finds the leaf and position of the element at index.  The branches
+	// on the way are recorded in path.
+	IndexType findLeaf(IndexType index, Path& path) const
+	{
+		if (index >= getLength()) {
+			throw std::range_error("Invalid index!");
+		}
+
+		Node* pNode = m_pRoot;
+		while (!pNode->m_isLeaf) {
+			Branch* pBranch = (Branch*) pNode;
+			IndexType position = countAtMost(pBranch->m_prefixWeight, index);
+			index -= weightBefore(pBranch, position);
+			path.push(pBranch, position);
+			pNode = pBranch->m_children[position];
+		}
+
+		path.m_pNode = pNode;
+		return index;
+	}
+
+	Leaf* getLastLeaf() const
+	{
+		Node* pNode = m_pRoot;
+		while (!pNode->m_isLeaf) {
+			pNode = ((Branch*) pNode)->m_children[pNode->m_count - 1];
+		}
+
+		return (Leaf*) pNode;
+	}
+
+	// Adds to the prefixes of the children from position onwards.  The
+	// arithmetic is modulo, so that negative deltas can be passed.
+	static void addToPrefixes(Branch* pBranch, IndexType position,
+			                  IndexType weightDelta, IndexType widthDelta)
+	{
+		for (IndexType i = position; i < pBranch->m_count; i++) {
+			pBranch->m_prefixWeight[i] += weightDelta;
+			pBranch->m_prefixWidth[i] += widthDelta;
+		}
+	}
+
+	// Recomputes the prefixes of the children from position onwards, and
+	// resets the unused entries.
+	static void refresh(Branch* pBranch, IndexType position)
+	{
+		for (IndexType i = position; i < pBranch->m_count; i++) {
+			const Node* pChild = pBranch->m_children[i];
+			pBranch->m_prefixWeight[i] = weightBefore(pBranch, i) + weightOf(pChild);
+			pBranch->m_prefixWidth[i] = widthBefore(pBranch, i) + widthOf(pChild);
+		}
+
+		std::fill(pBranch->m_prefixWeight + pBranch->m_count,
+				  pBranch->m_prefixWeight + BranchCapacity + 1, NoEntry);
+		std::fill(pBranch->m_prefixWidth + pBranch->m_count,
+				  pBranch->m_prefixWidth + BranchCapacity + 1, NoEntry);
+	}
+
+	// Moves the upper half of an overflowing leaf to a new leaf, which
+	// is returned.
+	static Leaf* splitLeaf(Leaf* pLeaf)
+	{
+		Leaf* pSibling = new Leaf();
+		IndexType half = pLeaf->m_count / 2;
+		moveElements(pLeaf, half, pLeaf->m_count - half, pSibling, 0);
+
+		pSibling->m_pNext = pLeaf->m_pNext;
+		pSibling->m_pPrev = pLeaf;
+		if (pLeaf->m_pNext != nullptr) {
+			pLeaf->m_pNext->m_pPrev = pSibling;
+		}
+		pLeaf->m_pNext = pSibling;
+		return pSibling;
+	}
+
+	// Moves count elements from position from of pFrom to position to of
+	// pTo, making room in pTo and closing the gap in pFrom.
+	static void moveElements(Leaf* pFrom, IndexType from, IndexType count,
+			                 Leaf* pTo, IndexType to)
+	{
+		std::move_backward(pTo->m_elts + to, pTo->m_elts + pTo->m_count,
+				           pTo->m_elts + pTo->m_count + count);
+		std::move_backward(pTo->m_widths + to, pTo->m_widths + pTo->m_count,
+				           pTo->m_widths + pTo->m_count + count);
+
+		IndexType width = 0;
+		for (IndexType i = 0; i < count; i++) {
+			pTo->m_elts[to + i] = std::move(pFrom->m_elts[from + i]);
+			pTo->m_widths[to + i] = pFrom->m_widths[from + i];
+			width += pFrom->m_widths[from + i];
+		}
+
+		std::move(pFrom->m_elts + from + count, pFrom->m_elts + pFrom->m_count,
+				  pFrom->m_elts + from);
+		std::move(pFrom->m_widths + from + count, pFrom->m_widths + pFrom->m_count,
+				  pFrom->m_widths + from);
+		for (IndexType i = pFrom->m_count - count; i < pFrom->m_count; i++) {
+			pFrom->m_elts[i] = ElementType();
+		}
+
+		pTo->m_count += count;
+		pTo->m_cumWidth += width;
+		pFrom->m_count -= count;
+		pFrom->m_cumWidth -= width;
+	}
+
+	// Moves count children from position from of pFrom to position to of
+	// pTo, and recomputes the prefixes of both.
+	static void moveChildren(Branch* pFrom, IndexType from, IndexType count,
+			                 Branch* pTo, IndexType to)
+	{
+		std::move_backward(pTo->m_children + to, pTo->m_children + pTo->m_count,
+				           pTo->m_children + pTo->m_count + count);
+		std::copy(pFrom->m_children + from, pFrom->m_children + from + count,
+				  pTo->m_children + to);
+		std::move(pFrom->m_children + from + count, pFrom->m_children + pFrom->m_count,
+				  pFrom->m_children + from);
+
+		pTo->m_count += count;
+		pFrom->m_count -= count;
+		refresh(pTo, 0);
+		refresh(pFrom, 0);
+	}
+
+	// Inserts pSibling after the child at position, whose prefix includes
+	// both of them.  If the branch overflows, its upper half is moved to
+	// a new branch, which is returned.
+	static Branch* insertChild(Branch* pBranch, IndexType position, Node* pSibling)
+	{
+		std::move_backward(pBranch->m_children + position + 1,
+				           pBranch->m_children + pBranch->m_count,
+				           pBranch->m_children + pBranch->m_count + 1);
+		std::move_backward(pBranch->m_prefixWeight + position + 1,
+				           pBranch->m_prefixWeight + pBranch->m_count,
+				           pBranch->m_prefixWeight + pBranch->m_count + 1);
+		std::move_backward(pBranch->m_prefixWidth + position + 1,
+				           pBranch->m_prefixWidth + pBranch->m_count,
+				           pBranch->m_prefixWidth + pBranch->m_count + 1);
+		pBranch->m_children[position + 1] = pSibling;
+		pBranch->m_count++;
+
+		// The prefix after the sibling is unchanged.
+		pBranch->m_prefixWeight[position + 1] = pBranch->m_prefixWeight[position];
+		pBranch->m_prefixWidth[position + 1] = pBranch->m_prefixWidth[position];
+		pBranch->m_prefixWeight[position] = weightBefore(pBranch, position) +
+				                            weightOf(pBranch->m_children[position]);
+		pBranch->m_prefixWidth[position] = widthBefore(pBranch, position) +
+				                           widthOf(pBranch->m_children[position]);
+
+		if (pBranch->m_count <= BranchCapacity) {
+			return nullptr;
+		}
+
+		Branch* pNew = new Branch();
+		IndexType half = pBranch->m_count / 2;
+		moveChildren(pBranch, half, pBranch->m_count - half, pNew, 0);
+		return pNew;
+	}
+
+	// If the child at position is less than half full, it is merged with
+	// a sibling, or takes children or elements from it.
+	static void rebalanceChild(Branch* pBranch, IndexType position)
+	{
+		Node* pChild = pBranch->m_children[position];
+		IndexType capacity = pChild->m_isLeaf ? LeafCapacity : BranchCapacity;
+		if ((pChild->m_count >= capacity/2) || (pBranch->m_count < 2)) {
+			return;
+		}
+
+		// The left and right of a pair of adjacent children
+		IndexType leftPosition = (position > 0) ? position - 1 : position;
+		Node* pLeft = pBranch->m_children[leftPosition];
+		Node* pRight = pBranch->m_children[leftPosition + 1];
+		IndexType total = pLeft->m_count + pRight->m_count;
+
+		if (total <= capacity) {
+			// Merge the right into the left.
+			if (pLeft->m_isLeaf) {
+				Leaf* pRightLeaf = (Leaf*) pRight;
+				moveElements(pRightLeaf, 0, pRightLeaf->m_count,
+						     (Leaf*) pLeft, pLeft->m_count);
+				((Leaf*) pLeft)->m_pNext = pRightLeaf->m_pNext;
+				if (pRightLeaf->m_pNext != nullptr) {
+					pRightLeaf->m_pNext->m_pPrev = (Leaf*) pLeft;
+				}
+				delete pRightLeaf;
+			} else {
+				moveChildren((Branch*) pRight, 0, pRight->m_count,
+						     (Branch*) pLeft, pLeft->m_count);
+				delete (Branch*) pRight;
+			}
+
+			std::move(pBranch->m_children + leftPosition + 2,
+					  pBranch->m_children + pBranch->m_count,
+					  pBranch->m_children + leftPosition + 1);
+			pBranch->m_count--;
+		} else {
+			// Share them evenly.
+			IndexType leftCount = total / 2;
+			if (pLeft->m_isLeaf) {
+				if (pLeft->m_count < leftCount) {
+					moveElements((Leaf*) pRight, 0, leftCount - pLeft->m_count,
+							     (Leaf*) pLeft, pLeft->m_count);
+				} else {
+					moveElements((Leaf*) pLeft, leftCount, pLeft->m_count - leftCount,
+							     (Leaf*) pRight, 0);
+				}
+			} else {
+				if (pLeft->m_count < leftCount) {
+					moveChildren((Branch*) pRight, 0, leftCount - pLeft->m_count,
+							     (Branch*) pLeft, pLeft->m_count);
+				} else {
+					moveChildren((Branch*) pLeft, leftCount, pLeft->m_count - leftCount,
+							     (Branch*) pRight, 0);
+				}
+			}
+		}
+
+		refresh(pBranch, leftPosition);
+	}
+
+	static void destroySubtree(Node* pNode)
+	{
+		if (pNode == nullptr) {
+			return;
+		}
+
+		if (pNode->m_isLeaf) {
+			delete (Leaf*) pNode;
+			return;
+		}
+
+		Branch* pBranch = (Branch*) pNode;
+		for (IndexType i = 0; i < pBranch->m_count; i++) {
+			destroySubtree(pBranch->m_children[i]);
+		}
+		delete pBranch;
+	}
+
+	void verify(const Node* pNode, IndexType depth, IndexType& leafDepth,
+			    const Leaf*& pPrev) const
+	{
+		IndexType capacity = pNode->m_isLeaf ? LeafCapacity : BranchCapacity;
+		if ((pNode->m_count > capacity) ||
+			((pNode != m_pRoot) && (pNode->m_count < capacity/2))) {
+			throw logic_error("Node at depth " + std::to_string(depth) +
+					          " has " + std::to_string(pNode->m_count) + " entries!");
+		}
+
+		if (pNode->m_isLeaf) {
+			const Leaf* pLeaf = (const Leaf*) pNode;
+			if (leafDepth == Sequence::UndefinedIndex) {
+				leafDepth = depth;
+			} else if (leafDepth != depth) {
+				throw logic_error("Leaves are at different depths!");
+			}
+
+			if ((pLeaf->m_pPrev != pPrev) ||
+				((pPrev != nullptr) && (pPrev->m_pNext != pLeaf))) {
+				throw logic_error("Leaves are not linked in order!");
+			}
+			pPrev = pLeaf;
+
+			IndexType width = 0;
+			for (IndexType i = 0; i < pLeaf->m_count; i++) {
+				width += pLeaf->m_widths[i];
+			}
+			if (width != pLeaf->m_cumWidth) {
+				throw logic_error("Leaf has incorrect width!");
+			}
+			return;
+		}
+
+		const Branch* pBranch = (const Branch*) pNode;
+		IndexType weight = 0;
+		IndexType width = 0;
+		for (IndexType i = 0; i < pBranch->m_count; i++) {
+			const Node* pChild = pBranch->m_children[i];
+			verify(pChild, depth + 1, leafDepth, pPrev);
+
+			weight += weightOf(pChild);
+			width += widthOf(pChild);
+			if ((pBranch->m_prefixWeight[i] != weight) ||
+				(pBranch->m_prefixWidth[i] != width)) {
+				throw logic_error("Branch has incorrect prefixes!");
+			}
+		}
+
+		for (IndexType i = pBranch->m_count; i < BranchCapacity; i++) {
+			if ((pBranch->m_prefixWeight[i] != NoEntry) ||
+				(pBranch->m_prefixWidth[i] != NoEntry)) {
+				throw logic_error("Branch has unused prefixes!");
+			}
+		}
+	}
+};
@@ -0,0 +1,112 @@
+/*
+ * CombiningSequence.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: R. Krishnaswamy
+ *
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include "inc/Sequence.h"
+
+using namespace std;
+
+// A CombiningSequence lets many threads edit one Sequence, by flat
+// combining rather than by handing a mutex from thread to thread.
+//
+//    - A thread publishes its operation in a slot, and waits for it to
+//      be done.
+//    - Whichever waiting thread gets the lock becomes the combiner.  It
+//      applies all the operations published in the slots, in one batch,
+//      with the usual Sequence methods, and hands each thread its result
+//      or exception.
+//    - The other threads only watch their own slot, so the lock and the
+//      tree stay in the cache of the combiner for the whole batch.
+//
+// Each operation is applied atomically, in some order consistent with
+// the order in which the threads called.
+class CombiningSequence
+{
+public:
+	// The number of operations that may be published at the same time.
+	// More threads wait for a free slot.
+	static constexpr IndexType SlotCount = 128;
+
+	// The number of passes a combiner makes over the slots before it
+	// gives up the lock.  Later passes pick up the operations published
+	// meanwhile.
+	static constexpr IndexType CombinePasses = 3;
+
+	// Constructor.  All the access to seq must then be through this
+	// CombiningSequence, while it exists.
+	explicit CombiningSequence(Sequence& seq);
+
+	CombiningSequence(const CombiningSequence&) = delete;
+	CombiningSequence& operator=(const CombiningSequence&) = delete;
+
+	// As the Sequence methods of the same names.
+	void insertAtIndex(Sequence::Element* pNewElt, IndexType atIndex, IndexType width = 0);
+	void remove(IndexType index);
+	Sequence::Element* getElement(IndexType index);
+	IndexType getLength();
+
+	// To run op(seq) as one operation, e.g. for several edits that are
+	// to be done together.  Exceptions thrown by op are rethrown here.
+	template <class Operation>
+	void execute(Operation& op)
+	{
+		execute(&invoke<Operation>, &op);
+	}
+
+	// The number of batches applied so far, and the number of operations
+	// in them.  These are used in testing and benchmarking.
+	IndexType getBatchCount() const
+	{
+		return m_batchCount;
+	}
+
+	IndexType getCombinedCount() const
+	{
+		return m_combinedCount;
+	}
+
+private:
+	enum SlotState { Free, Claimed, Pending, Done };
+
+	// A slot is on its own cache line, so that the waiting threads do
+	// not disturb each other.
+	struct alignas(64) Slot
+	{
+		std::atomic<int> m_state{Free};
+		void (*m_pInvoke)(void* pOp, Sequence& seq) = nullptr;
+		void* m_pOp = nullptr;
+		std::exception_ptr m_error;
+	};
+
+	template <class Operation>
+	static void invoke(void* pOp, Sequence& seq)
+	{
+		(*static_cast<Operation*>(pOp))(seq);
+	}
+
+	void execute(void (*pInvoke)(void* pOp, Sequence& seq), void* pOp);
+
+	// To apply the pending operations, holding the lock.
+	void combine();
+
+	Sequence& m_seq;
+	std::mutex m_mutex;
+	std::array<Slot, SlotCount> m_slots;
+
+	// The slots from m_usedSlots on have never been claimed.
+	std::atomic<IndexType> m_usedSlots{0};
+
+	// Updated by the combiner only.
+	IndexType m_batchCount = 0;
+	IndexType m_combinedCount = 0;
+};
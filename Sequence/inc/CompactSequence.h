@@ -0,0 +1,711 @@
+/*
+ * CompactSequence.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: R. Krishnaswamy
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "inc/Sequence.h"
+
+using namespace std;
+
+// The template CompactSequence has the same index and offset API as
+// GenericSequence, with a much smaller node.  A GenericSequence wraps each
+// ElementType in a GenericElement, which derives from the polymorphic
+// Sequence::Element, and so carries a vtable pointer, three pointers,
+// a word for the height and the flags of the pending range updates, and
+// three IndexType counters besides the ElementType.  A CompactSequence
+// node is a plain struct with the ElementType inline, and:
+//    - The parent and child links are positions in an array of nodes,
+//      of type Index, rather than pointers.
+//    - The weight and cumulative width are of type Index.
+//    - The height is a single byte.
+// With Index = uint32_t this is 21 bytes besides the ElementType, as
+// against 64 bytes for a GenericElement (72 in all for a size_t), so
+// that more than twice as many nodes fit in a cache line.  The length
+// and the total width of the sequence are limited to the range of Index.
+//
+// The nodes are kept in a single array, and the node of a removed element
+// is reused by the next insertion.  The tree is an AVL tree, balanced in
+// the same way as that of Sequence.
+
+template <
+// The class ElementType is expected to be default constructible and
+// assignable.
+class ElementType,
+
+// An unsigned integer type for the links, weights and widths.
+class Index = uint32_t
+>
+class CompactSequence
+{
+public:
+	// The value of a missing link.
+	static constexpr Index NoNode = std::numeric_limits<Index>::max();
+
+	struct Node
+	{
+		ElementType m_data;
+		Index m_parent;
+		Index m_left;
+		Index m_right;
+
+		// Number of nodes, and cumulative width of the nodes, in the
+		// subtree rooted by this node.
+		Index m_weight;
+		Index m_cumWidth;
+
+		// Maximum distance to a leaf node of the subtree.
+		uint8_t m_height;
+	};
+
+	// An Iterator visits the elements in order.  It is a bidirectional
+	// iterator.
+	class Iterator
+	{
+	public:
+		typedef std::bidirectional_iterator_tag iterator_category;
+		typedef ElementType value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef ElementType* pointer;
+		typedef ElementType& reference;
+
+		Iterator()
+		{}
+
+		Iterator(const CompactSequence* pSeq, Index node)
+		: m_pSeq(pSeq), m_node(node)
+		{}
+
+		ElementType& operator*() const
+		{
+			return const_cast<CompactSequence*>(m_pSeq)->m_nodes[m_node].m_data;
+		}
+
+		ElementType* operator->() const
+		{
+			return &(**this);
+		}
+
+		Iterator& operator++()
+		{
+			m_node = m_pSeq->successor(m_node);
+			return *this;
+		}
+
+		Iterator operator++(int)
+		{
+			Iterator old = *this;
+			++(*this);
+			return old;
+		}
+
+		// Decrementing end() gives the last element.
+		Iterator& operator--()
+		{
+			if (m_node == NoNode) {
+				m_node = m_pSeq->extreme(m_pSeq->m_root, false);
+			} else {
+				m_node = m_pSeq->predecessor(m_node);
+			}
+			return *this;
+		}
+
+		Iterator operator--(int)
+		{
+			Iterator old = *this;
+			--(*this);
+			return old;
+		}
+
+		bool operator==(const Iterator& that) const
+		{
+			return m_node == that.m_node;
+		}
+
+		bool operator!=(const Iterator& that) const
+		{
+			return m_node != that.m_node;
+		}
+
+	private:
+		const CompactSequence* m_pSeq = nullptr;
+
+		// The current node, or NoNode at the end.
+		Index m_node = NoNode;
+	};
+
+	// Constructor
+	CompactSequence()
+	{}
+
+	// Virtual destructor
+	virtual ~CompactSequence()
+	{}
+
+	// Destroys all elements of the sequence, so it can be reused.  The
+	// array of nodes is released in bulk.
+	void clear()
+	{
+		m_nodes.clear();
+		m_root = NoNode;
+		m_freeList = NoNode;
+	}
+
+	// Current length of the sequence.  This is one more than the last
+	// index.  Initial length of the sequence is zero.
+	IndexType getLength() const
+	{
+		return weight(m_root);
+	}
+
+	// To insert an element at a particular (zero-based) index.  Valid
+	// indices are from zero to length().  If the index is length(),
+	// then the new element is inserted at the end (appended).  The last
+	// defaulted parameter provides the width of the new element.
+	void insertAtIndex(const ElementType& elt, IndexType atIndex, IndexType width = 0)
+	{
+		if (atIndex > getLength()) {
+			// Error
+			throw std::length_error("Invalid index!");
+		}
+
+		if ((IndexType) cumWidth(m_root) + width >= NoNode) {
+			throw std::length_error("Total width is too large!");
+		}
+
+		Index node = allocateNode(elt, width);
+		if (m_root == NoNode) {
+			m_root = node;
+			return;
+		}
+
+		// Descend to the position of the new leaf.
+		Index parent = m_root;
+		IndexType indexInParent = atIndex;
+		while (true) {
+			Node& parentNode = m_nodes[parent];
+			IndexType leftWeight = weight(parentNode.m_left);
+			if (indexInParent <= leftWeight) {
+				if (parentNode.m_left == NoNode) {
+					parentNode.m_left = node;
+					break;
+				}
+				parent = parentNode.m_left;
+			} else {
+				indexInParent -= leftWeight + 1;
+				if (parentNode.m_right == NoNode) {
+					parentNode.m_right = node;
+					break;
+				}
+				parent = parentNode.m_right;
+			}
+		}
+
+		m_nodes[node].m_parent = parent;
+		retrace(parent, true, (Index) width);
+	}
+
+	// To append an element.  The last defaulted parameter provides the width
+	// of the new element.
+	void append(const ElementType& elt, IndexType width = 0)
+	{
+		insertAtIndex(elt, getLength(), width);
+	}
+
+	// To build the sequence from a range of ElementType values in O(n).
+	// Any existing elements are destroyed first.  widthOf(elt) provides
+	// the width of each element.  The nodes are in order in memory.
+	template <class Iterator, class WidthOf>
+	void build(Iterator first, Iterator last, WidthOf widthOf)
+	{
+		clear();
+
+		IndexType totalWidth = 0;
+		for (; first != last; ++first) {
+			IndexType width = widthOf(*first);
+			totalWidth += width;
+			if ((m_nodes.size() >= NoNode) || (totalWidth >= NoNode)) {
+				throw std::length_error("Sequence is too large!");
+			}
+
+			allocateNode(*first, width);
+		}
+
+		m_root = buildSubtree(0, (Index) m_nodes.size(), NoNode);
+	}
+
+	// To remove an element from the sequence.  The element is destroyed.
+	void remove(IndexType index)
+	{
+		Index node = getNode(index);
+		Node& removed = m_nodes[node];
+		Index width = ownWidth(node);
+		Index parent = removed.m_parent;
+		Index replacement;
+		Index fixupFrom;
+		Index moved = NoNode;
+		Index movedWidth = 0;
+
+		if ((removed.m_left != NoNode) && (removed.m_right != NoNode)) {
+			// The successor is relinked in the position of the removed
+			// node, as in Sequence::remove.
+			moved = extreme(removed.m_right, true);
+			movedWidth = ownWidth(moved);
+			Node& movedNode = m_nodes[moved];
+
+			if (moved == removed.m_right) {
+				fixupFrom = moved;
+			} else {
+				fixupFrom = movedNode.m_parent;
+				m_nodes[fixupFrom].m_left = movedNode.m_right;
+				setParent(movedNode.m_right, fixupFrom);
+				movedNode.m_right = removed.m_right;
+				setParent(movedNode.m_right, moved);
+			}
+
+			movedNode.m_left = removed.m_left;
+			setParent(movedNode.m_left, moved);
+			replacement = moved;
+		} else {
+			replacement = (removed.m_left != NoNode) ? removed.m_left : removed.m_right;
+			fixupFrom = parent;
+		}
+
+		replaceChild(parent, node, replacement);
+		freeNode(node);
+
+		if (moved == NoNode) {
+			retrace(fixupFrom, false, width);
+		} else {
+			// The nodes below the moved node lost it, and the nodes from
+			// the moved node upwards lost the removed node.
+			Index rover = fixupFrom;
+			while (rover != moved) {
+				rover = adjust(rover, false, movedWidth);
+			}
+
+			setAttributes(moved, movedWidth);
+			moved = rebalance(moved);
+			retrace(m_nodes[moved].m_parent, false, width);
+		}
+	}
+
+	// This method will throw an exception unless index is between 0 and
+	// count-1 where count is the number of elements in the sequence.
+	ElementType& operator[](IndexType index)
+	{
+		return m_nodes[getNode(index)].m_data;
+	}
+
+	// Each Element has a "width" attribute that indicates how much space
+	// it occupies.  This is by default 0 if not specified.  It can be
+	// specified by this method.
+	void setWidth(IndexType index, IndexType width)
+	{
+		Index node = getNode(index);
+		Index oldWidth = ownWidth(node);
+		if ((IndexType) cumWidth(m_root) - oldWidth + width >= NoNode) {
+			throw std::length_error("Total width is too large!");
+		}
+
+		for (Index rover = node; rover != NoNode; rover = m_nodes[rover].m_parent) {
+			m_nodes[rover].m_cumWidth = m_nodes[rover].m_cumWidth - oldWidth + (Index) width;
+		}
+	}
+
+	// The width of an Element can be queried.
+	IndexType getWidth(IndexType index) const
+	{
+		return ownWidth(getNode(index));
+	}
+
+	// The start offset of an element can be queried.
+	IndexType getStartOffset(IndexType index) const
+	{
+		Index node = getNode(index);
+		IndexType startOffset = cumWidth(m_nodes[node].m_left);
+
+		Index parent = m_nodes[node].m_parent;
+		while (parent != NoNode) {
+			if (m_nodes[parent].m_right == node) {
+				startOffset += cumWidth(m_nodes[parent].m_left) + ownWidth(parent);
+			}
+			node = parent;
+			parent = m_nodes[node].m_parent;
+		}
+
+		return startOffset;
+	}
+
+	// Each element occupies an extant specified by its start offset and
+	// its width.  This gets the element whose extent spans the given offset.
+	ElementType getElementAtOffset(IndexType offset) const
+	{
+		if (offset >= cumWidth(m_root)) {
+			throw std::range_error("Invalid index!");
+		}
+
+		Index node = m_root;
+		IndexType offsetInNode = offset;
+		while (true) {
+			const Node& current = m_nodes[node];
+			IndexType leftWidth = cumWidth(current.m_left);
+			if (offsetInNode < leftWidth) {
+				node = current.m_left;
+				continue;
+			}
+
+			offsetInNode -= leftWidth;
+			IndexType width = ownWidth(node);
+			if (offsetInNode < width) {
+				return current.m_data;
+			}
+
+			offsetInNode -= width;
+			node = current.m_right;
+		}
+	}
+
+	// Iterators over the elements in order.  end() is past the last
+	// element.
+	Iterator begin() const
+	{
+		return Iterator(this, extreme(m_root, true));
+	}
+
+	Iterator end() const
+	{
+		return Iterator(this, NoNode);
+	}
+
+	// An iterator at a particular (zero-based) index, in O(log n).  If
+	// the index is length() or more, this is end().
+	Iterator iteratorAt(IndexType index) const
+	{
+		if (index >= getLength()) {
+			return end();
+		}
+
+		return Iterator(this, getNode(index));
+	}
+
+	// To verify tree properties.  The height, weight and width of nodes
+	// need to be correct, and the tree should be balanced.  It throws an
+	// exception on the first node that is not.  This method is used in
+	// testing.
+	void verify() const
+	{
+		verify(m_root, NoNode);
+	}
+
+private:
+	// The nodes, including the free ones.
+	vector<Node> m_nodes;
+
+	Index m_root = NoNode;
+
+	// The free nodes are linked through m_parent.
+	Index m_freeList = NoNode;
+
+	IndexType weight(Index node) const
+	{
+		return (node == NoNode) ? 0 : m_nodes[node].m_weight;
+	}
+
+	IndexType cumWidth(Index node) const
+	{
+		return (node == NoNode) ? 0 : m_nodes[node].m_cumWidth;
+	}
+
+	int height(Index node) const
+	{
+		return (node == NoNode) ? -1 : m_nodes[node].m_height;
+	}
+
+	int heightDelta(Index node) const
+	{
+		return height(m_nodes[node].m_left) - height(m_nodes[node].m_right);
+	}
+
+	Index ownWidth(Index node) const
+	{
+		const Node& current = m_nodes[node];
+		return current.m_cumWidth - (Index) cumWidth(current.m_left)
+				                  - (Index) cumWidth(current.m_right);
+	}
+
+	void setParent(Index node, Index parent)
+	{
+		if (node != NoNode) {
+			m_nodes[node].m_parent = parent;
+		}
+	}
+
+	// Replaces the child oldChild of parent by newChild.
+	void replaceChild(Index parent, Index oldChild, Index newChild)
+	{
+		setParent(newChild, parent);
+		if (parent == NoNode) {
+			m_root = newChild;
+		} else if (m_nodes[parent].m_left == oldChild) {
+			m_nodes[parent].m_left = newChild;
+		} else {
+			m_nodes[parent].m_right = newChild;
+		}
+	}
+
+	Index allocateNode(const ElementType& elt, IndexType width)
+	{
+		Index node;
+		if (m_freeList != NoNode) {
+			node = m_freeList;
+			m_freeList = m_nodes[node].m_parent;
+		} else {
+			if (m_nodes.size() >= NoNode) {
+				throw std::length_error("Sequence is too large!");
+			}
+			node = (Index) m_nodes.size();
+			m_nodes.emplace_back();
+		}
+
+		Node& newNode = m_nodes[node];
+		newNode.m_data = elt;
+		newNode.m_parent = NoNode;
+		newNode.m_left = NoNode;
+		newNode.m_right = NoNode;
+		newNode.m_weight = 1;
+		newNode.m_cumWidth = (Index) width;
+		newNode.m_height = 0;
+		return node;
+	}
+
+	void freeNode(Index node)
+	{
+		// Release whatever the element holds.
+		m_nodes[node].m_data = ElementType();
+		m_nodes[node].m_parent = m_freeList;
+		m_freeList = node;
+	}
+
+	Index getNode(IndexType index) const
+	{
+		if (index >= getLength()) {
+			throw std::range_error("Invalid index!");
+		}
+
+		Index node = m_root;
+		while (true) {
+			const Node& current = m_nodes[node];
+			IndexType leftWeight = weight(current.m_left);
+			if (index < leftWeight) {
+				node = current.m_left;
+			} else if (index == leftWeight) {
+				return node;
+			} else {
+				index -= leftWeight + 1;
+				node = current.m_right;
+			}
+		}
+	}
+
+	// The leftmost (or rightmost) node of the subtree at node.
+	Index extreme(Index node, bool isLeftmost) const
+	{
+		if (node == NoNode) {
+			return NoNode;
+		}
+
+		while (true) {
+			Index child = isLeftmost ? m_nodes[node].m_left : m_nodes[node].m_right;
+			if (child == NoNode) {
+				return node;
+			}
+			node = child;
+		}
+	}
+
+	Index successor(Index node) const
+	{
+		if (m_nodes[node].m_right != NoNode) {
+			return extreme(m_nodes[node].m_right, true);
+		}
+
+		Index parent = m_nodes[node].m_parent;
+		while ((parent != NoNode) && (m_nodes[parent].m_right == node)) {
+			node = parent;
+			parent = m_nodes[node].m_parent;
+		}
+		return parent;
+	}
+
+	Index predecessor(Index node) const
+	{
+		if (m_nodes[node].m_left != NoNode) {
+			return extreme(m_nodes[node].m_left, false);
+		}
+
+		Index parent = m_nodes[node].m_parent;
+		while ((parent != NoNode) && (m_nodes[parent].m_left == node)) {
+			node = parent;
+			parent = m_nodes[node].m_parent;
+		}
+		return parent;
+	}
+
+	// Sets the height, weight and cumulative width of node from its
+	// children, given its own width.
+	void setAttributes(Index node, Index width)
+	{
+		Node& current = m_nodes[node];
+		current.m_height = (uint8_t) (std::max(height(current.m_left),
+				                               height(current.m_right)) + 1);
+		current.m_weight = (Index) (1 + weight(current.m_left) + weight(current.m_right));
+		current.m_cumWidth = (Index) (width + cumWidth(current.m_left)
+				                            + cumWidth(current.m_right));
+	}
+
+	// Single rotations, as in Sequence::rebalanceSubtree.  The new
+	// subtree root is returned.
+	Index rotateLeft(Index node)
+	{
+		Index pivot = m_nodes[node].m_right;
+		Index nodeWidth = ownWidth(node);
+		Index pivotWidth = ownWidth(pivot);
+
+		replaceChild(m_nodes[node].m_parent, node, pivot);
+		m_nodes[node].m_right = m_nodes[pivot].m_left;
+		setParent(m_nodes[node].m_right, node);
+		m_nodes[pivot].m_left = node;
+		m_nodes[node].m_parent = pivot;
+
+		setAttributes(node, nodeWidth);
+		setAttributes(pivot, pivotWidth);
+		return pivot;
+	}
+
+	Index rotateRight(Index node)
+	{
+		Index pivot = m_nodes[node].m_left;
+		Index nodeWidth = ownWidth(node);
+		Index pivotWidth = ownWidth(pivot);
+
+		replaceChild(m_nodes[node].m_parent, node, pivot);
+		m_nodes[node].m_left = m_nodes[pivot].m_right;
+		setParent(m_nodes[node].m_left, node);
+		m_nodes[pivot].m_right = node;
+		m_nodes[node].m_parent = pivot;
+
+		setAttributes(node, nodeWidth);
+		setAttributes(pivot, pivotWidth);
+		return pivot;
+	}
+
+	// Rebalances the subtree at node if its height-delta is 2 or -2,
+	// and returns the root of the subtree.
+	Index rebalance(Index node)
+	{
+		int delta = heightDelta(node);
+		if (delta == 2) {
+			if (heightDelta(m_nodes[node].m_left) < 0) {
+				rotateLeft(m_nodes[node].m_left);
+			}
+			return rotateRight(node);
+		} else if (delta == -2) {
+			if (heightDelta(m_nodes[node].m_right) > 0) {
+				rotateRight(m_nodes[node].m_right);
+			}
+			return rotateLeft(node);
+		}
+
+		return node;
+	}
+
+	// Adjusts node for an element of the given width that was inserted
+	// or removed below it, rebalances it, and returns the parent of the
+	// rebalanced subtree.
+	Index adjust(Index node, bool isInsert, Index width)
+	{
+		Node& current = m_nodes[node];
+		if (isInsert) {
+			current.m_weight++;
+			current.m_cumWidth += width;
+		} else {
+			current.m_weight--;
+			current.m_cumWidth -= width;
+		}
+
+		current.m_height = (uint8_t) (std::max(height(current.m_left),
+				                               height(current.m_right)) + 1);
+
+		return m_nodes[rebalance(node)].m_parent;
+	}
+
+	// A single pass from node to the root, as in Sequence::retrace.
+	void retrace(Index node, bool isInsert, Index width)
+	{
+		while (node != NoNode) {
+			node = adjust(node, isInsert, width);
+		}
+	}
+
+	// Links the nodes first .. last-1, which are in order, into a
+	// balanced subtree and returns its root.  On entry m_cumWidth of
+	// each node is its own width.
+	Index buildSubtree(Index first, Index last, Index parent)
+	{
+		if (first == last) {
+			return NoNode;
+		}
+
+		Index mid = first + (last - first)/2;
+		Node& midNode = m_nodes[mid];
+		Index width = midNode.m_cumWidth;
+		midNode.m_parent = parent;
+		midNode.m_left = buildSubtree(first, mid, mid);
+		midNode.m_right = buildSubtree(mid + 1, last, mid);
+		setAttributes(mid, width);
+		return mid;
+	}
+
+	void verify(Index node, Index parent) const
+	{
+		if (node == NoNode) {
+			return;
+		}
+
+		const Node& current = m_nodes[node];
+		string msg = "Node " + std::to_string(node);
+		if (current.m_parent != parent) {
+			throw logic_error(msg + " has incorrect parent!");
+		}
+
+		int delta = heightDelta(node);
+		if ((delta < -1) || (delta > 1)) {
+			throw logic_error(msg + " is unbalanced!");
+		}
+
+		if (current.m_weight != 1 + weight(current.m_left) + weight(current.m_right)) {
+			throw logic_error(msg + " has incorrect weight!");
+		}
+
+		if (current.m_height != std::max(height(current.m_left),
+				                         height(current.m_right)) + 1) {
+			throw logic_error(msg + " has incorrect height!");
+		}
+
+		verify(current.m_left, node);
+		verify(current.m_right, node);
+	}
+};
@@ -0,0 +1,686 @@
+/*
+ * ConcurrentSequence.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: R. Krishnaswamy
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "inc/Sequence.h"
+#include "inc/ElementPool.h"
+
+using namespace std;
+
+// The template ConcurrentSequence is a sequence with one writer and any
+// number of readers, which run their index and offset lookups without
+// taking locks and without waiting for the writer.
+//
+// The writer never changes a node that readers may see.  An edit copies
+// the nodes on the path from the root to the edited element, rebalancing
+// the copies, and then publishes the new tree with a single atomic store
+// of the root.  A reader loads the root once per lookup, and so sees the
+// tree either wholly before or wholly after any edit.
+//
+// The nodes that an edit replaces are retired, and reclaimed by epochs.
+// A reader announces the current epoch in a slot of its own while it
+// runs, and the writer advances the epoch after each edit.  A retired
+// node is reclaimed once every announced epoch is later than the one
+// in which it was retired, as no reader can then still reach it.  The
+// readers write only to their own slots, which are on separate cache
+// lines, so that they scale with the number of cores.
+//
+// The writer methods must not be called concurrently with each other.
+// Readers get copies of the elements, since the nodes may be reclaimed
+// as soon as a lookup is done.
+
+template <
+// The class ElementType is expected to be copy constructible.
+class ElementType
+>
+class ConcurrentSequence
+{
+public:
+	// The number of readers that may be in a lookup at the same time.
+	// More readers wait for a free slot.
+	static constexpr IndexType ReaderSlotCount = 128;
+
+	// The writer tries to reclaim retired nodes once there are this
+	// many of them.
+	static constexpr IndexType ReclaimThreshold = 1024;
+
+	// Constructor
+	ConcurrentSequence()
+	: m_pool(sizeof(Node))
+	{}
+
+	// Destructor.  There must be no readers left.
+	virtual ~ConcurrentSequence()
+	{
+		destroySubtree(m_pRoot.load(std::memory_order_relaxed));
+		for (const Retired& retired : m_retired) {
+			destroyNode(retired.m_pNode);
+		}
+	}
+
+	ConcurrentSequence(const ConcurrentSequence&) = delete;
+	ConcurrentSequence& operator=(const ConcurrentSequence&) = delete;
+
+	// ----- Readers.  These may be called from any thread. -----
+
+	// Current length of the sequence.  This is one more than the last
+	// index.  Initial length of the sequence is zero.
+	IndexType getLength() const
+	{
+		ReadGuard guard(*this);
+		return weight(guard.getRoot());
+	}
+
+	// A copy of the element at index.  An exception is thrown unless
+	// index is less than the length.
+	ElementType get(IndexType index) const
+	{
+		ReadGuard guard(*this);
+		return getNode(guard.getRoot(), index)->m_data;
+	}
+
+	// The width of the element at index.
+	IndexType getWidth(IndexType index) const
+	{
+		ReadGuard guard(*this);
+		return getNode(guard.getRoot(), index)->m_width;
+	}
+
+	// The start offset of the element at index.
+	IndexType getStartOffset(IndexType index) const
+	{
+		ReadGuard guard(*this);
+		const Node* pNode = guard.getRoot();
+		checkIndex(pNode, index);
+
+		IndexType startOffset = 0;
+		while (true) {
+			IndexType leftWeight = weight(pNode->m_pLeft);
+			if (index < leftWeight) {
+				pNode = pNode->m_pLeft;
+				continue;
+			}
+
+			startOffset += cumWidth(pNode->m_pLeft);
+			if (index == leftWeight) {
+				return startOffset;
+			}
+
+			index -= leftWeight + 1;
+			startOffset += pNode->m_width;
+			pNode = pNode->m_pRight;
+		}
+	}
+
+	// Each element occupies an extant specified by its start offset and
+	// its width.  This gets a copy of the element whose extent spans the
+	// given offset.
+	ElementType getElementAtOffset(IndexType offset) const
+	{
+		ReadGuard guard(*this);
+		const Node* pNode = guard.getRoot();
+		if (offset >= cumWidth(pNode)) {
+			throw std::range_error("Invalid index!");
+		}
+
+		while (true) {
+			IndexType leftWidth = cumWidth(pNode->m_pLeft);
+			if (offset < leftWidth) {
+				pNode = pNode->m_pLeft;
+				continue;
+			}
+
+			offset -= leftWidth;
+			if (offset < pNode->m_width) {
+				return pNode->m_data;
+			}
+
+			offset -= pNode->m_width;
+			pNode = pNode->m_pRight;
+		}
+	}
+
+	// To visit the elements at indices from, from+1, ..., to-1 in
+	// order, all from the same version of the sequence.  An exception
+	// is thrown unless from <= to <= length().  The writer is not held
+	// up, but the nodes retired meanwhile are not reclaimed until this
+	// returns.
+	void visitRange
+	        (IndexType from, IndexType to,
+	         std::function<void(const ElementType& elt)> visitElt) const
+	{
+		ReadGuard guard(*this);
+		const Node* pRoot = guard.getRoot();
+		if ((from > to) || (to > weight(pRoot))) {
+			// Error
+			throw std::length_error("Invalid index!");
+		}
+
+		visitSubtree(pRoot, 0, from, to, visitElt);
+	}
+
+	// ----- The writer. -----
+
+	// To insert an element at a particular (zero-based) index.  Valid
+	// indices are from zero to length().  If the index is length(),
+	// then the new element is inserted at the end (appended).  The last
+	// defaulted parameter provides the width of the new element.
+	void insertAtIndex(const ElementType& elt, IndexType atIndex, IndexType width = 0)
+	{
+		const Node* pRoot = getWriterRoot();
+		if (atIndex > weight(pRoot)) {
+			// Error
+			throw std::length_error("Invalid index!");
+		}
+
+		edit([&]() { return insert(pRoot, atIndex, elt, width); });
+	}
+
+	// To append an element.  The last defaulted parameter provides the width
+	// of the new element.
+	void append(const ElementType& elt, IndexType width = 0)
+	{
+		insertAtIndex(elt, weight(getWriterRoot()), width);
+	}
+
+	// To remove an element from the sequence.
+	void remove(IndexType index)
+	{
+		const Node* pRoot = getWriterRoot();
+		checkIndex(pRoot, index);
+		edit([&]() { return remove(pRoot, index); });
+	}
+
+	// To replace the element at an index, keeping its width.
+	void set(IndexType index, const ElementType& elt)
+	{
+		const Node* pRoot = getWriterRoot();
+		IndexType width = getNode(pRoot, index)->m_width;
+		edit([&]() { return update(pRoot, index, &elt, width); });
+	}
+
+	// Each Element has a "width" attribute that indicates how much space
+	// it occupies.  This is by default 0 if not specified.  It can be
+	// specified by this method.
+	void setWidth(IndexType index, IndexType width)
+	{
+		const Node* pRoot = getWriterRoot();
+		checkIndex(pRoot, index);
+		edit([&]() { return update(pRoot, index, nullptr, width); });
+	}
+
+	// To remove all the elements.
+	void clear()
+	{
+		edit([&]() {
+			retireSubtree(getWriterRoot());
+			return (const Node*) nullptr;
+		});
+	}
+
+	// To reclaim the retired nodes that no reader can reach any more.
+	// This is done by the writer every ReclaimThreshold retirements.
+	void reclaim()
+	{
+		uint64_t oldest = std::numeric_limits<uint64_t>::max();
+		for (const ReaderSlot& slot : m_slots) {
+			uint64_t epoch = slot.m_epoch.load();
+			if ((epoch != 0) && (epoch < oldest)) {
+				oldest = epoch;
+			}
+		}
+
+		IndexType kept = 0;
+		for (const Retired& retired : m_retired) {
+			if (retired.m_epoch < oldest) {
+				destroyNode(retired.m_pNode);
+			} else {
+				m_retired[kept++] = retired;
+			}
+		}
+		m_retired.resize(kept);
+	}
+
+	// The number of retired nodes that are not yet reclaimed.  This is
+	// used in testing.
+	IndexType getRetiredCount() const
+	{
+		return m_retired.size();
+	}
+
+	// To verify tree properties, from the writer.  The height, weight and
+	// width of nodes need to be correct, and the tree should be balanced.
+	// It throws an exception on the first node that is not.  This method
+	// is used in testing.
+	void verify() const
+	{
+		verify(getWriterRoot());
+	}
+
+private:
+	struct Node
+	{
+		Node(const ElementType& data, IndexType width,
+			 const Node* pLeft, const Node* pRight, uint64_t edit)
+		: m_data(data), m_pLeft(pLeft), m_pRight(pRight),
+		  m_width(width), m_edit(edit)
+		{
+			m_weight = 1 + weight(pLeft) + weight(pRight);
+			m_cumWidth = width + cumWidth(pLeft) + cumWidth(pRight);
+			m_height = 1 + std::max(height(pLeft), height(pRight));
+		}
+
+		ElementType m_data;
+		const Node* m_pLeft;
+		const Node* m_pRight;
+		IndexType m_width;
+
+		// Number of nodes, and cumulative width of the nodes, in the
+		// subtree rooted by this node.
+		IndexType m_weight;
+		IndexType m_cumWidth;
+
+		// Maximum distance to a leaf node of the subtree.
+		int m_height;
+
+		// The edit that made the node.  A node made by the current edit
+		// has not been published, and can be destroyed at once.
+		uint64_t m_edit;
+	};
+
+	// The epoch announced by a reader, or 0 if the slot is free.
+	struct alignas(64) ReaderSlot
+	{
+		std::atomic<uint64_t> m_epoch{0};
+	};
+
+	struct Retired
+	{
+		uint64_t m_epoch;
+		const Node* m_pNode;
+	};
+
+	// A ReadGuard announces the current epoch in a free slot for as long
+	// as a reader runs, and loads the root after that.
+	class ReadGuard
+	{
+	public:
+		ReadGuard(const ConcurrentSequence& seq)
+		{
+			// Each thread starts from its own slot, so that the slots are
+			// normally free and stay in the cache of their thread.
+			static thread_local IndexType hint =
+					std::hash<std::thread::id>()(std::this_thread::get_id());
+
+			uint64_t epoch = seq.m_epoch.load();
+			for (IndexType i = hint; ; i++) {
+				ReaderSlot& slot = seq.m_slots[i % ReaderSlotCount];
+				uint64_t expected = 0;
+				if (slot.m_epoch.compare_exchange_strong(expected, epoch)) {
+					m_pSlot = &slot;
+					break;
+				}
+			}
+
+			m_pRoot = seq.m_pRoot.load();
+		}
+
+		~ReadGuard()
+		{
+			m_pSlot->m_epoch.store(0, std::memory_order_release);
+		}
+
+		const Node* getRoot() const
+		{
+			return m_pRoot;
+		}
+
+	private:
+		ReaderSlot* m_pSlot;
+		const Node* m_pRoot;
+	};
+
+	std::atomic<const Node*> m_pRoot{nullptr};
+
+	// The current epoch.  It starts at 1, since 0 marks a free slot.
+	std::atomic<uint64_t> m_epoch{1};
+
+	mutable std::array<ReaderSlot, ReaderSlotCount> m_slots;
+
+	// The rest is used only by the writer.  The nodes are allocated in
+	// a pool, which only the writer uses.
+	ElementPool m_pool;
+	vector<Retired> m_retired;
+	uint64_t m_editCount = 1;
+
+	// The nodes that the current edit has made, and those of them that
+	// it has dropped again.  Until the edit is published, none of them
+	// is reachable by readers.
+	vector<const Node*> m_made;
+	vector<const Node*> m_dropped;
+
+	// The published nodes that the current edit replaces.  They are
+	// retired only once the edit is published, as until then they are
+	// still in the tree.
+	vector<const Node*> m_replaced;
+
+	static IndexType weight(const Node* pNode)
+	{
+		return (pNode == nullptr) ? 0 : pNode->m_weight;
+	}
+
+	static IndexType cumWidth(const Node* pNode)
+	{
+		return (pNode == nullptr) ? 0 : pNode->m_cumWidth;
+	}
+
+	static int height(const Node* pNode)
+	{
+		return (pNode == nullptr) ? -1 : pNode->m_height;
+	}
+
+	static void checkIndex(const Node* pRoot, IndexType index)
+	{
+		if (index >= weight(pRoot)) {
+			// Error
+			throw std::length_error("Invalid index!");
+		}
+	}
+
+	static const Node* getNode(const Node* pNode, IndexType index)
+	{
+		checkIndex(pNode, index);
+
+		while (true) {
+			IndexType leftWeight = weight(pNode->m_pLeft);
+			if (index < leftWeight) {
+				pNode = pNode->m_pLeft;
+			} else if (index == leftWeight) {
+				return pNode;
+			} else {
+				index -= leftWeight + 1;
+				pNode = pNode->m_pRight;
+			}
+		}
+	}
+
+	// To visit the elements of the subtree at pNode, whose first index
+	// is firstIndex, that are at indices in [from, to).
+	static void visitSubtree(const Node* pNode, IndexType firstIndex,
+			                 IndexType from, IndexType to,
+			                 std::function<void(const ElementType& elt)>& visitElt)
+	{
+		if ((pNode == nullptr) || (from >= firstIndex + pNode->m_weight) ||
+			(to <= firstIndex)) {
+			return;
+		}
+
+		IndexType index = firstIndex + weight(pNode->m_pLeft);
+		visitSubtree(pNode->m_pLeft, firstIndex, from, to, visitElt);
+		if ((from <= index) && (index < to)) {
+			visitElt(pNode->m_data);
+		}
+		visitSubtree(pNode->m_pRight, index + 1, from, to, visitElt);
+	}
+
+	// The writer reads the root that it stored itself.
+	const Node* getWriterRoot() const
+	{
+		return m_pRoot.load(std::memory_order_relaxed);
+	}
+
+	// To publish the tree whose root makeRoot returns.  If makeRoot
+	// throws, as a copy of an element may, the nodes that it has made are
+	// destroyed, and the published tree is unchanged.
+	template <class MakeRoot>
+	void edit(MakeRoot&& makeRoot)
+	{
+		try {
+			const Node* pRoot = makeRoot();
+			m_retired.reserve(m_retired.size() + m_replaced.size());
+			publish(pRoot);
+		} catch (...) {
+			for (const Node* pNode : m_made) {
+				if (pNode != nullptr) {
+					destroyNode(pNode);
+				}
+			}
+			m_made.clear();
+			m_dropped.clear();
+			m_replaced.clear();
+			throw;
+		}
+	}
+
+	// To make a new tree visible to the readers, and start a new epoch.
+	// The nodes replaced by the edit are retired with the previous epoch,
+	// and those that it made and dropped are destroyed.
+	void publish(const Node* pRoot)
+	{
+		m_pRoot.store(pRoot);
+		uint64_t epoch = m_epoch.fetch_add(1);
+		m_editCount++;
+
+		for (const Node* pNode : m_replaced) {
+			m_retired.push_back({epoch, pNode});
+		}
+
+		for (const Node* pNode : m_dropped) {
+			destroyNode(pNode);
+		}
+		m_made.clear();
+		m_dropped.clear();
+		m_replaced.clear();
+
+		if (m_retired.size() >= ReclaimThreshold) {
+			reclaim();
+		}
+	}
+
+	const Node* makeNode(const ElementType& data, IndexType width,
+			             const Node* pLeft, const Node* pRight)
+	{
+		// The slot is taken first, so that the node is recorded even if
+		// the copy of the element throws.
+		m_made.push_back(nullptr);
+		const Node* pNode = m_pool.template create<Node>(data, width, pLeft, pRight,
+				                                          m_editCount);
+		m_made.back() = pNode;
+		return pNode;
+	}
+
+	void destroyNode(const Node* pNode)
+	{
+		Node* pMutable = const_cast<Node*>(pNode);
+		pMutable->~Node();
+		m_pool.deallocateSlot(pMutable);
+	}
+
+	// To drop a node that the edit has replaced.  If it was published,
+	// readers may still be on it, so it is retired once the edit is
+	// published.  Otherwise it is destroyed then.
+	void discard(const Node* pNode)
+	{
+		if (pNode->m_edit == m_editCount) {
+			m_dropped.push_back(pNode);
+		} else {
+			m_replaced.push_back(pNode);
+		}
+	}
+
+	void retireSubtree(const Node* pNode)
+	{
+		if (pNode != nullptr) {
+			retireSubtree(pNode->m_pLeft);
+			retireSubtree(pNode->m_pRight);
+			discard(pNode);
+		}
+	}
+
+	void destroySubtree(const Node* pNode)
+	{
+		if (pNode != nullptr) {
+			destroySubtree(pNode->m_pLeft);
+			destroySubtree(pNode->m_pRight);
+			destroyNode(pNode);
+		}
+	}
+
+	// A new node with the given element and subtrees, whose heights
+	// differ by at most 2, rotated as needed to be balanced.  The roots
+	// of the subtrees that are rotated are replaced by new nodes.
+	const Node* balance(const ElementType& data, IndexType width,
+			            const Node* pLeft, const Node* pRight)
+	{
+		const Node* pResult;
+		if (height(pLeft) > height(pRight) + 1) {
+			if (height(pLeft->m_pLeft) >= height(pLeft->m_pRight)) {
+				// Single right rotation.
+				pResult = makeNode(pLeft->m_data, pLeft->m_width, pLeft->m_pLeft,
+						makeNode(data, width, pLeft->m_pRight, pRight));
+			} else {
+				// Left-right double rotation.
+				const Node* pMiddle = pLeft->m_pRight;
+				pResult = makeNode(pMiddle->m_data, pMiddle->m_width,
+						makeNode(pLeft->m_data, pLeft->m_width, pLeft->m_pLeft, pMiddle->m_pLeft),
+						makeNode(data, width, pMiddle->m_pRight, pRight));
+				discard(pMiddle);
+			}
+			discard(pLeft);
+			return pResult;
+		}
+
+		if (height(pRight) > height(pLeft) + 1) {
+			if (height(pRight->m_pRight) >= height(pRight->m_pLeft)) {
+				// Single left rotation.
+				pResult = makeNode(pRight->m_data, pRight->m_width,
+						makeNode(data, width, pLeft, pRight->m_pLeft),
+						pRight->m_pRight);
+			} else {
+				// Right-left double rotation.
+				const Node* pMiddle = pRight->m_pLeft;
+				pResult = makeNode(pMiddle->m_data, pMiddle->m_width,
+						makeNode(data, width, pLeft, pMiddle->m_pLeft),
+						makeNode(pRight->m_data, pRight->m_width, pMiddle->m_pRight, pRight->m_pRight));
+				discard(pMiddle);
+			}
+			discard(pRight);
+			return pResult;
+		}
+
+		return makeNode(data, width, pLeft, pRight);
+	}
+
+	const Node* insert(const Node* pNode, IndexType index,
+			           const ElementType& elt, IndexType width)
+	{
+		if (pNode == nullptr) {
+			return makeNode(elt, width, nullptr, nullptr);
+		}
+
+		const Node* pResult;
+		IndexType leftWeight = weight(pNode->m_pLeft);
+		if (index <= leftWeight) {
+			pResult = balance(pNode->m_data, pNode->m_width,
+					insert(pNode->m_pLeft, index, elt, width), pNode->m_pRight);
+		} else {
+			pResult = balance(pNode->m_data, pNode->m_width, pNode->m_pLeft,
+					insert(pNode->m_pRight, index - leftWeight - 1, elt, width));
+		}
+
+		discard(pNode);
+		return pResult;
+	}
+
+	const Node* remove(const Node* pNode, IndexType index)
+	{
+		const Node* pResult;
+		IndexType leftWeight = weight(pNode->m_pLeft);
+		if (index < leftWeight) {
+			pResult = balance(pNode->m_data, pNode->m_width,
+					remove(pNode->m_pLeft, index), pNode->m_pRight);
+		} else if (index > leftWeight) {
+			pResult = balance(pNode->m_data, pNode->m_width, pNode->m_pLeft,
+					remove(pNode->m_pRight, index - leftWeight - 1));
+		} else if (pNode->m_pLeft == nullptr) {
+			pResult = pNode->m_pRight;
+		} else if (pNode->m_pRight == nullptr) {
+			pResult = pNode->m_pLeft;
+		} else {
+			// The successor takes the place of the removed node, as in
+			// Sequence::remove.  It is copied before it is retired.
+			const Node* pSuccessor = pNode->m_pRight;
+			while (pSuccessor->m_pLeft != nullptr) {
+				pSuccessor = pSuccessor->m_pLeft;
+			}
+
+			ElementType data = pSuccessor->m_data;
+			IndexType width = pSuccessor->m_width;
+			pResult = balance(data, width, pNode->m_pLeft, remove(pNode->m_pRight, 0));
+		}
+
+		discard(pNode);
+		return pResult;
+	}
+
+	// A copy of the path to the element at index, with the element
+	// replaced by *pElt if that is non-null, and its width set to width.
+	const Node* update(const Node* pNode, IndexType index,
+			           const ElementType* pElt, IndexType width)
+	{
+		const Node* pResult;
+		IndexType leftWeight = weight(pNode->m_pLeft);
+		if (index < leftWeight) {
+			pResult = makeNode(pNode->m_data, pNode->m_width,
+					update(pNode->m_pLeft, index, pElt, width), pNode->m_pRight);
+		} else if (index > leftWeight) {
+			pResult = makeNode(pNode->m_data, pNode->m_width, pNode->m_pLeft,
+					update(pNode->m_pRight, index - leftWeight - 1, pElt, width));
+		} else {
+			pResult = makeNode((pElt != nullptr) ? *pElt : pNode->m_data, width,
+					           pNode->m_pLeft, pNode->m_pRight);
+		}
+
+		discard(pNode);
+		return pResult;
+	}
+
+	static void verify(const Node* pNode)
+	{
+		if (pNode == nullptr) {
+			return;
+		}
+
+		verify(pNode->m_pLeft);
+		verify(pNode->m_pRight);
+
+		int leftHeight = height(pNode->m_pLeft);
+		int rightHeight = height(pNode->m_pRight);
+		if ((pNode->m_height != 1 + std::max(leftHeight, rightHeight)) ||
+			(leftHeight - rightHeight > 1) || (rightHeight - leftHeight > 1)) {
+			throw logic_error("Unbalanced or incorrect height in ConcurrentSequence");
+		}
+
+		if ((pNode->m_weight != 1 + weight(pNode->m_pLeft) + weight(pNode->m_pRight)) ||
+			(pNode->m_cumWidth != pNode->m_width + cumWidth(pNode->m_pLeft) +
+				                  cumWidth(pNode->m_pRight))) {
+			throw logic_error("Incorrect weight or width in ConcurrentSequence");
+		}
+	}
+};
@@ -0,0 +1,118 @@
+/*
+ * ElementPool.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: R. Krishnaswamy
+ *
+ */
+
+#pragma once
+
+#include <memory_resource>
+#include <new>
+#include <utility>
+#include <vector>
+#include "inc/Sequence.h"
+
+using namespace std;
+
+// An ElementPool is a slab allocator for the Elements of a Sequence.
+// Storage is obtained from an upstream memory resource in large slabs,
+// and carved into fixed size slots, each of which holds one Element.
+//
+//    - A slot that is freed goes on a free list, and is reused by the
+//      next allocation.
+//    - Slots are handed out from a slab in address order, so Elements
+//      that are created one after another (e.g. by successive appends)
+//      are adjacent in memory.
+//    - release() returns all the slabs to the upstream resource in one
+//      go, without visiting the individual slots.
+//
+// An ElementPool is a std::pmr::memory_resource, so it may also be
+// given to the std::pmr containers.  Requests larger than the slot size
+// cannot be satisfied, and throw std::bad_alloc.
+class ElementPool : public std::pmr::memory_resource
+{
+public:
+	// Constructor.  Every slot has room for slotSize bytes.  Slabs of
+	// slotsPerSlab slots are obtained from pUpstream.
+	ElementPool(IndexType slotSize,
+			    IndexType slotsPerSlab = 1024,
+			    std::pmr::memory_resource* pUpstream
+			        = std::pmr::get_default_resource());
+
+	// Virtual destructor.  All the slabs are released.
+	virtual ~ElementPool();
+
+	ElementPool(const ElementPool&) = delete;
+	ElementPool& operator=(const ElementPool&) = delete;
+
+	// To get a slot.  The slot is uninitialized storage.
+	void* allocateSlot();
+
+	// To return a slot, so that it can be reused.
+	void deallocateSlot(void* pSlot);
+
+	// To construct an Element of type T in a slot.  T must fit in
+	// a slot.  If the constructor throws, the slot is returned.
+	template <class T, class... Args>
+	T* create(Args&&... args)
+	{
+		static_assert(alignof(T) <= alignof(std::max_align_t),
+				      "Element is over-aligned for an ElementPool");
+		if (sizeof(T) > m_slotSize) {
+			throw std::bad_alloc();
+		}
+
+		void* pSlot = allocateSlot();
+		try {
+			return new (pSlot) T(std::forward<Args>(args)...);
+		} catch (...) {
+			deallocateSlot(pSlot);
+			throw;
+		}
+	}
+
+	// Returns all the slabs to the upstream resource.  Every slot that
+	// was handed out becomes invalid.  Destructors are not run.
+	void release();
+
+	// The size of a slot in bytes.
+	IndexType getSlotSize() const;
+
+	// The number of slots currently handed out.
+	IndexType getSlotsInUse() const;
+
+private:
+	// A free slot holds the link to the next free slot.
+	struct FreeSlot
+	{
+		FreeSlot* m_pNext;
+	};
+
+	virtual void* do_allocate(size_t bytes, size_t alignment) override;
+
+	virtual void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+
+	virtual bool do_is_equal(const std::pmr::memory_resource& that)
+			const noexcept override;
+
+	// Gets a new slab from the upstream resource.
+	void addSlab();
+
+	IndexType m_slotSize;
+	IndexType m_slotsPerSlab;
+	std::pmr::memory_resource* m_pUpstream;
+
+	// Slabs obtained from m_pUpstream.
+	vector<char*> m_slabs;
+
+	// Free list of slots that were deallocated.
+	FreeSlot* m_pFreeList = nullptr;
+
+	// Unused part of the most recent slab.
+	char* m_pNextSlot = nullptr;
+	char* m_pSlabEnd = nullptr;
+
+	IndexType m_slotsInUse = 0;
+};
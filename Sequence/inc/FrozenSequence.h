@@ -0,0 +1,255 @@
+/*
+ * FrozenSequence.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: R. Krishnaswamy
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "inc/Sequence.h"
+
+using namespace std;
+
+// A FrozenSequence is an immutable copy of a sequence, made by
+// Sequence::freeze or GenericSequence::freeze, for a sequence that is
+// built once and then only looked up.  It has no nodes, parent pointers
+// or vtables, but plain arrays:
+//
+//    - The elements, and the end offsets of their extents, in index
+//      order.  An element is found by its index in O(1).
+//    - The end offsets again, in Eytzinger order, i.e. the order of a
+//      breadth-first walk of a complete binary search tree, where the
+//      children of the node at k are at 2k and 2k+1.  An element is
+//      found by an offset with a descent of that tree, in O(log n).
+//      The top levels of the tree share a few cache lines, and the
+//      descent has no branch to mispredict and prefetches the nodes a
+//      few levels below, so that it is much faster than on the
+//      pointer-based tree.  The index of a node is computed from its
+//      position, so it is not stored.
+template <
+// The class ElementType is expected to be copyable.
+class ElementType
+>
+class FrozenSequence
+{
+public:
+	typedef typename vector<ElementType>::const_iterator Iterator;
+
+	// Constructor.  An empty sequence.
+	FrozenSequence()
+	{}
+
+	// Constructor.  The sequence of values, with their widths, which
+	// must have the same length.
+	FrozenSequence(vector<ElementType>&& values, const vector<IndexType>& widths)
+	: m_values(std::move(values)), m_ends(widths.size())
+	{
+		if (m_values.size() != widths.size()) {
+			throw std::length_error("Invalid index!");
+		}
+
+		IndexType end = 0;
+		for (IndexType i = 0; i < widths.size(); i++) {
+			end += widths[i];
+			m_ends[i] = end;
+		}
+
+		// The tree is placed in its vector so that it starts on a cache
+		// line, and each group of great-grandchildren is one line.
+		m_tree.resize(m_ends.size() + 1 + LineNodes);
+		IndexType address = (IndexType) m_tree.data();
+		m_treeStart = (LineBytes - address % LineBytes) % LineBytes / sizeof(IndexType);
+		fillTree(0, 1);
+
+		if (!m_ends.empty()) {
+			m_treeHeight = floorLog2(m_ends.size());
+			m_lastLevelCount = m_ends.size() - ((IndexType) 1 << m_treeHeight) + 1;
+		}
+	}
+
+	// A FrozenSequence is moved but not copied, which would not keep
+	// the alignment of the tree.
+	FrozenSequence(FrozenSequence&&) = default;
+	FrozenSequence& operator=(FrozenSequence&&) = default;
+	FrozenSequence(const FrozenSequence&) = delete;
+	FrozenSequence& operator=(const FrozenSequence&) = delete;
+
+	// The length of the sequence.
+	IndexType getLength() const
+	{
+		return m_values.size();
+	}
+
+	// This method will throw an exception unless index is between 0 and
+	// count-1 where count is the number of elements in the sequence.
+	const ElementType& operator[](IndexType index) const
+	{
+		return m_values[checkIndex(index)];
+	}
+
+	// The width of an Element can be queried.
+	IndexType getWidth(IndexType index) const
+	{
+		return m_ends[checkIndex(index)] - getStartOffset(index);
+	}
+
+	// The start offset of an element can be queried.
+	IndexType getStartOffset(IndexType index) const
+	{
+		checkIndex(index);
+		return (index == 0) ? 0 : m_ends[index - 1];
+	}
+
+	// Each element occupies an extant specified by its start offset and
+	// its width.  This gets the element whose extent spans the given offset.
+	const ElementType& getElementAtOffset(IndexType offset) const
+	{
+		return m_values[getIndexAtOffset(offset)];
+	}
+
+	// The index of the element whose extent spans the given offset.  This
+	// is the first element that ends after the offset.  An exception is
+	// thrown if there is none.
+	IndexType getIndexAtOffset(IndexType offset) const
+	{
+		IndexType length = m_values.size();
+		const IndexType* pTreeEnds = m_tree.data() + m_treeStart;
+
+		// Each step goes to the right child if the node ends at or
+		// before the offset, and otherwise to the left child.  The
+		// great-grandchildren of a node are consecutive, so the line
+		// three levels down is prefetched.
+		IndexType k = 1;
+		while (k <= length) {
+			prefetch(pTreeEnds + std::min(k * LineNodes, length));
+			k = 2 * k + (pTreeEnds[k] <= offset);
+		}
+
+		// The node found is the last one at which the descent went left,
+		// so the trailing right steps and that left step are dropped.
+		k >>= trailingOnes(k) + 1;
+		if (k == 0) {
+			throw std::range_error("Invalid index!");
+		}
+
+		return indexOf(k);
+	}
+
+	// Iterators over the elements in order.  end() is past the last
+	// element.
+	Iterator begin() const
+	{
+		return m_values.begin();
+	}
+
+	Iterator end() const
+	{
+		return m_values.end();
+	}
+
+	// An iterator at a particular (zero-based) index.  If the index is
+	// length() or more, this is end().
+	Iterator iteratorAt(IndexType index) const
+	{
+		return m_values.begin() + std::min(index, getLength());
+	}
+
+private:
+	// A cache line holds the eight great-grandchildren of a node.
+	static constexpr IndexType LineBytes = 64;
+	static constexpr IndexType LineNodes = LineBytes / sizeof(IndexType);
+
+	IndexType checkIndex(IndexType index) const
+	{
+		if (index >= m_values.size()) {
+			// Error
+			throw std::length_error("Invalid index!");
+		}
+
+		return index;
+	}
+
+	// Fills the subtree at node k of the Eytzinger tree with the ends
+	// from index on, in order, and returns the index after them.
+	IndexType fillTree(IndexType index, IndexType k)
+	{
+		if (k <= m_ends.size()) {
+			index = fillTree(index, 2 * k);
+			m_tree[m_treeStart + k] = m_ends[index];
+			index = fillTree(index + 1, 2 * k + 1);
+		}
+
+		return index;
+	}
+
+	// The index of the element at node k, i.e. the number of nodes
+	// before it in order.  In a perfect tree, the node at position j of
+	// its level, with h levels below it, has (2j + 1) * 2^h - 1 nodes
+	// before it.  The nodes of the last level are to the left, so those
+	// missing are subtracted.
+	IndexType indexOf(IndexType k) const
+	{
+		IndexType depth = floorLog2(k);
+		IndexType position = k - ((IndexType) 1 << depth);
+		IndexType below = m_treeHeight - depth;
+		IndexType index = ((2 * position + 1) << below) - 1;
+		if (below > 0) {
+			IndexType lastLevelBefore = (2 * position + 1) << (below - 1);
+			index -= lastLevelBefore - std::min(lastLevelBefore, m_lastLevelCount);
+		}
+
+		return index;
+	}
+
+	static void prefetch(const IndexType* pNode)
+	{
+#if defined(__GNUC__)
+		__builtin_prefetch(pNode);
+#endif
+	}
+
+	static IndexType floorLog2(IndexType k)
+	{
+#if defined(__GNUC__)
+		return 63 - __builtin_clzll((unsigned long long) k);
+#else
+		IndexType log = 0;
+		for (; k > 1; k >>= 1) {
+			log++;
+		}
+		return log;
+#endif
+	}
+
+	static IndexType trailingOnes(IndexType k)
+	{
+#if defined(__GNUC__)
+		return __builtin_ctzll(~(unsigned long long) k);
+#else
+		IndexType count = 0;
+		for (; (k & 1) != 0; k >>= 1) {
+			count++;
+		}
+		return count;
+#endif
+	}
+
+	// The elements, and the end offsets of their extents, in index order.
+	vector<ElementType> m_values;
+	vector<IndexType> m_ends;
+
+	// The end offsets in Eytzinger order, from position m_treeStart + 1
+	// of m_tree.  Position m_treeStart is not used.
+	vector<IndexType> m_tree;
+	IndexType m_treeStart = 0;
+
+	// The depth of the last level of the tree, and its number of nodes.
+	IndexType m_treeHeight = 0;
+	IndexType m_lastLevelCount = 0;
+};
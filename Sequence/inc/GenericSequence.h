@@ -7,11 +7,36 @@
  */
 
 #include "inc/Sequence.h"
+#include "inc/ElementPool.h"
+#include "inc/Aggregate.h"
+#include "inc/ThreadPool.h"
+#include "inc/SequenceFile.h"
+#include "inc/FrozenSequence.h"
+#include <array>
+#include <cstddef>
+#include <fstream>
+#include <iostream>
+#include <memory_resource>
+#include <optional>
+#include <type_traits>
 
 #pragma once
 
 using namespace std;
 
+// The aggregate kept by each element of a GenericSequence.  It takes
+// no space if the Aggregate policy keeps no aggregates.
+template <class Aggregate, bool isEnabled = Aggregate::isEnabled>
+struct AggregateStorage
+{
+	typename Aggregate::ValueType m_aggregate;
+};
+
+template <class Aggregate>
+struct AggregateStorage<Aggregate, false>
+{};
+
+
 // The template GenericSequence is an efficient sequence data structure.
 // It is parameterized by the type Element, and is a container of Elements
 // each of which can be accessed by its index in the sequence.  It enables
@@ -25,13 +50,31 @@ template <
 //       virtual string image() const;
 //   - An assignment operator
 //       virtual ElementType& operator =(const ElementType& that);
-class ElementType
+class ElementType,
+
+// The Aggregate policy (see Aggregate.h) gives an aggregate over ranges
+// of elements, such as a sum, minimum or maximum.  By default there is
+// none.
+class Aggregate = NoAggregate<ElementType>,
+
+// Up to SmallCapacity elements are kept in a flat array within the
+// GenericSequence, with the prefix sums of their widths, instead of in
+// the tree.  Then insertions and removals are moves within the array,
+// and lookups are linear scans.  The tree is built when the sequence
+// grows past SmallCapacity, and dropped when it shrinks to half of it.
+// By default there is no array, and the code for it is not compiled.
+// If SmallCapacity is not zero, ElementType must also be default
+// constructible.
+IndexType SmallCapacity = 0
 >
 class GenericSequence
 {
 public:
+	typedef typename Aggregate::ValueType AggregateType;
+
 	// The Sequence is a sequence of GenericElement
-	class GenericElement : public Sequence::Element
+	class GenericElement : public Sequence::Element,
+	                       public AggregateStorage<Aggregate>
 	{
 	public:
 		// Constructor
@@ -61,30 +104,266 @@ public:
 			return Sequence::Element::operator =(that);
 		}
 
+	protected:
+		// The aggregate of the subtree is that of the left subtree, this
+		// element and the right subtree, in that order.
+		virtual void updateAggregate()
+		{
+			if constexpr (Aggregate::isEnabled) {
+				AggregateType value = Aggregate::of(m_data, getWidth());
+				if (m_left != nullptr) {
+					value = Aggregate::combine(
+							((GenericElement*) m_left)->m_aggregate, value);
+				}
+				if (m_right != nullptr) {
+					value = Aggregate::combine(
+							value, ((GenericElement*) m_right)->m_aggregate);
+				}
+				this->m_aggregate = value;
+			}
+		}
+
 	private:
 		ElementType m_data;
 		friend GenericSequence;
 	};
 
-	// Constructor
-	GenericSequence()
-	{}
+	// An Iterator visits the ElementType values in order.  It is a
+	// bidirectional iterator, and dereferences to the value held in
+	// the sequence.  A ConstIterator is the same, but dereferences to a
+	// const value.  An Iterator converts to a ConstIterator.
+	template <class Value>
+	class BasicIterator
+	{
+	public:
+		typedef std::bidirectional_iterator_tag iterator_category;
+		typedef ElementType value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef Value* pointer;
+		typedef Value& reference;
+
+		BasicIterator()
+		{}
+
+		BasicIterator(const Sequence::Iterator& it)
+		: m_it(it)
+		{}
+
+		// An iterator over the flat array of a small sequence.
+		BasicIterator(Value* pSmall)
+		: m_pSmall(pSmall)
+		{}
+
+		BasicIterator(const BasicIterator<ElementType>& that)
+		: m_it(that.m_it), m_pSmall(that.m_pSmall)
+		{}
+
+		Value& operator*() const
+		{
+			if (m_pSmall != nullptr) {
+				return *m_pSmall;
+			}
+
+			return ((GenericElement*) *m_it)->m_data;
+		}
+
+		Value* operator->() const
+		{
+			return &(**this);
+		}
+
+		BasicIterator& operator++()
+		{
+			if (m_pSmall != nullptr) {
+				++m_pSmall;
+			} else {
+				++m_it;
+			}
+			return *this;
+		}
+
+		BasicIterator operator++(int)
+		{
+			BasicIterator old = *this;
+			++(*this);
+			return old;
+		}
+
+		BasicIterator& operator--()
+		{
+			if (m_pSmall != nullptr) {
+				--m_pSmall;
+			} else {
+				--m_it;
+			}
+			return *this;
+		}
+
+		BasicIterator operator--(int)
+		{
+			BasicIterator old = *this;
+			--(*this);
+			return old;
+		}
+
+		template <class ThatValue>
+		bool operator==(const BasicIterator<ThatValue>& that) const
+		{
+			return (m_pSmall == that.m_pSmall) && (m_it == that.m_it);
+		}
+
+		template <class ThatValue>
+		bool operator!=(const BasicIterator<ThatValue>& that) const
+		{
+			return !(*this == that);
+		}
+
+	private:
+		Sequence::Iterator m_it;
+
+		// The position in the flat array, or nullptr for the tree.
+		Value* m_pSmall = nullptr;
+
+		template <class ThatValue>
+		friend class BasicIterator;
+
+		friend GenericSequence;
+	};
+
+	typedef BasicIterator<ElementType> Iterator;
+	typedef BasicIterator<const ElementType> ConstIterator;
+
+	// A Cursor is a position between two elements, at which a burst of
+	// edits is made in amortized O(1) each, and applied to the tree by
+	// commit() in O(k + log n) for k elements (see Sequence::Cursor).  A
+	// small sequence is moved to the tree when a cursor is placed in it.
+	class Cursor
+	{
+	public:
+		// A cursor before the element at index, or at the end if index
+		// is the length.
+		Cursor(GenericSequence& seq, IndexType index)
+		: m_pool(seq.m_pool), m_cursor(seq.getTree(), index)
+		{}
+
+		// The element after the cursor, or nullptr at the end.  If the
+		// sequence keeps aggregates, an element that is changed through
+		// the returned pointer leaves them stale.
+		ElementType* get()
+		{
+			GenericElement* pGenElt = (GenericElement*) m_cursor.get();
+			return (pGenElt == nullptr) ? nullptr : &pGenElt->m_data;
+		}
+
+		// The index of the element after the cursor, counting the edits.
+		IndexType getIndex() const
+		{
+			return m_cursor.getIndex();
+		}
+
+		// To move the cursor over the next (or previous) element.  These
+		// return false at the end (or beginning) of the sequence.
+		bool next()
+		{
+			return m_cursor.next();
+		}
+
+		bool prev()
+		{
+			return m_cursor.prev();
+		}
+
+		// To insert an element before the cursor.  The last defaulted
+		// parameter provides the width of the new element.
+		void insertBefore(const ElementType& elt, IndexType width = 0)
+		{
+			GenericElement* pGenElt = m_pool.template create<GenericElement>(elt);
+			try {
+				m_cursor.insertBefore(pGenElt, width);
+			} catch (...) {
+				pGenElt->~GenericElement();
+				m_pool.deallocateSlot(pGenElt);
+				throw;
+			}
+		}
+
+		// To remove the element after the cursor.  An exception is
+		// thrown at the end.
+		void erase()
+		{
+			m_cursor.erase();
+		}
+
+		// To change the width of the element after the cursor.  An
+		// exception is thrown at the end.
+		void setWidth(IndexType width)
+		{
+			m_cursor.setWidth(width);
+		}
+
+		// Applies the edits to the sequence.
+		void commit()
+		{
+			m_cursor.commit();
+		}
+
+	private:
+		ElementPool& m_pool;
+		Sequence::Cursor m_cursor;
+	};
+
+	// Constructor.  The elements are allocated in slabs of
+	// slotsPerSlab elements, which are obtained from pResource.
+	GenericSequence(std::pmr::memory_resource* pResource
+			            = std::pmr::get_default_resource(),
+			        IndexType slotsPerSlab = 1024)
+	: m_pool(sizeof(GenericElement), slotsPerSlab, pResource)
+	{
+		m_seq.setElementPool(&m_pool);
+		m_seq.setAggregateEnabled(Aggregate::isEnabled);
+	}
 
 	// Virtual destructor
 	virtual ~GenericSequence()
-	{}
+	{
+		clear();
+	}
 
 	// Destroys all elements of the sequence, so it can be reused.
+	// If ElementType needs no destruction, the elements are not
+	// visited at all, and their storage is released in bulk.
 	void clear()
 	{
-		m_seq.clear();
+		clearTree();
+
+		// Release whatever the elements of the flat array hold.
+		for (IndexType i = 0; i < m_smallCount; i++) {
+			m_small[i] = ElementType();
+		}
+		m_smallCount = 0;
+		m_isSmall = (SmallCapacity > 0);
 	}
 
 	// Current length of the sequence.  This is one more than the last
 	// index.  Initial length of the sequence is zero.
-	IndexType getLength()
+	IndexType getLength() const
 	{
-		return m_seq.getLength();
+		return m_isSmall ? m_smallCount : m_seq.getLength();
+	}
+
+	// Whether the elements are in the flat array rather than the tree.
+	bool isSmall() const
+	{
+		return m_isSmall;
+	}
+
+	// Enables the finger of the tree (see Sequence::setFingerEnabled),
+	// for lookups near the previous one.  Then the lookups write to the
+	// sequence, so it must not be read concurrently, and
+	// parallelForEach and parallelReduce throw an exception.
+	void setFingerEnabled(bool isEnabled)
+	{
+		m_seq.setFingerEnabled(isEnabled);
 	}
 
 	// To insert an element at a particular (zero-based) index.  Valid
@@ -93,28 +372,291 @@ public:
 	// defaulted parameter provides the width of the new element.
 	void insertAtIndex(const ElementType& elt, IndexType atIndex, IndexType width = 0)
 	{
-		GenericElement* pGenElt = new GenericElement(elt);
-		m_seq.insertAtIndex(pGenElt, atIndex, width);
+		if constexpr (SmallCapacity > 0) {
+			if (m_isSmall) {
+				if (atIndex > m_smallCount) {
+					// Error
+					throw std::length_error("Invalid index!");
+				}
+
+				if (m_smallCount < SmallCapacity) {
+					insertSmall(elt, atIndex, width);
+					return;
+				}
+
+				moveToTree();
+			}
+		}
+
+		GenericElement* pGenElt = m_pool.template create<GenericElement>(elt);
+		try {
+			m_seq.insertAtIndex(pGenElt, atIndex, width);
+		} catch (...) {
+			pGenElt->~GenericElement();
+			m_pool.deallocateSlot(pGenElt);
+			throw;
+		}
 	}
 
 	// To append an element.  The last defaulted parameter provides the width
 	// of the new element.
 	void append(const ElementType& elt, IndexType width = 0)
 	{
-		GenericElement* pGenElt = new GenericElement(elt);
-		m_seq.append(pGenElt, width);
+		if constexpr (SmallCapacity > 0) {
+			if (m_isSmall) {
+				insertAtIndex(elt, m_smallCount, width);
+				return;
+			}
+		}
+
+		GenericElement* pGenElt = m_pool.template create<GenericElement>(elt);
+		try {
+			m_seq.append(pGenElt, width);
+		} catch (...) {
+			pGenElt->~GenericElement();
+			m_pool.deallocateSlot(pGenElt);
+			throw;
+		}
+	}
+
+	// To build the sequence from a range of ElementType values in O(n).
+	// Any existing elements are destroyed first.  widthOf(elt) provides
+	// the width of each element.  The elements are allocated in order,
+	// so they are adjacent in memory.
+	template <class Iterator, class WidthOf>
+	void build(Iterator first, Iterator last, WidthOf widthOf)
+	{
+		clear();
+
+		vector<Sequence::Element*> elts;
+		for (; first != last; ++first) {
+			if constexpr (SmallCapacity > 0) {
+				if (m_isSmall) {
+					if (m_smallCount < SmallCapacity) {
+						insertSmall(*first, m_smallCount, widthOf(*first));
+						continue;
+					}
+
+					// The range does not fit the flat array.
+					for (IndexType i = 0; i < m_smallCount; i++) {
+						elts.push_back(m_pool.template create<GenericElement>(m_small[i]));
+						m_small[i] = ElementType();
+					}
+					m_smallCount = 0;
+					m_isSmall = false;
+				}
+			}
+
+			elts.push_back(m_pool.template create<GenericElement>(*first));
+		}
+
+		if constexpr (SmallCapacity > 0) {
+			if (m_isSmall) {
+				return;
+			}
+		}
+
+		m_seq.build(elts.begin(), elts.end(),
+			[&widthOf](const Sequence::Element* pElt)->IndexType {
+				return widthOf(((const GenericElement*) pElt)->m_data);
+			});
+	}
+
+	// To build the sequence from a range of ElementType values in O(n),
+	// with all widths zero.
+	template <class Iterator>
+	void build(Iterator first, Iterator last)
+	{
+		build(first, last, [](const ElementType&)->IndexType { return 0; });
+	}
+
+	// To write the sequence to out in the binary format of SequenceFile,
+	// in one pass in index order.  ElementType must be trivially
+	// copyable.  An exception is thrown if out fails.
+	void save(std::ostream& out) const
+	{
+		SequenceFileHeader header = SequenceFile::makeHeader<ElementType>(getLength());
+		out.write((const char*) &header, sizeof(header));
+
+		// The records are laid out in a buffer of bytes that is cleared
+		// once, and only their fields are written, so that the padding
+		// stays zero and equal sequences give equal files.
+		vector<unsigned char> buffer(SequenceFile::BufferRecords * sizeof(FileRecord), 0);
+		IndexType buffered = 0;
+		IndexType end = 0;
+		auto addRecord = [&](const ElementType& elt, IndexType width) {
+			unsigned char* pRecord = buffer.data() + buffered * sizeof(FileRecord);
+			end += width;
+			std::memcpy(pRecord + offsetof(FileRecord, m_end), &end, sizeof(end));
+			std::memcpy(pRecord + offsetof(FileRecord, m_data), &elt, sizeof(elt));
+
+			if (++buffered == SequenceFile::BufferRecords) {
+				out.write((const char*) buffer.data(), buffered * sizeof(FileRecord));
+				buffered = 0;
+			}
+		};
+
+		if constexpr (SmallCapacity > 0) {
+			if (m_isSmall) {
+				for (IndexType i = 0; i < m_smallCount; i++) {
+					addRecord(m_small[i], m_smallEnds[i] - smallStart(i));
+				}
+			}
+		}
+
+		if (!m_isSmall) {
+			for (const Sequence::Element* pElt = m_seq.getFirst(); pElt != nullptr;
+				 pElt = Sequence::successor(pElt)) {
+				addRecord(((const GenericElement*) pElt)->m_data, pElt->getWidth());
+			}
+		}
+
+		out.write((const char*) buffer.data(), buffered * sizeof(FileRecord));
+		if (!out) {
+			throw std::runtime_error("Cannot write sequence file!");
+		}
+	}
+
+	void save(const string& path) const
+	{
+		std::ofstream out(path, std::ios::binary);
+		if (!out) {
+			throw std::runtime_error("Cannot open sequence file!");
+		}
+		save(out);
+	}
+
+	// To read a sequence written by save(), in O(n).  Any existing
+	// elements are destroyed first.  The elements are allocated in
+	// order, and the tree is built bottom-up, as by build().  An
+	// exception is thrown if in is not a sequence file of ElementType.
+	void load(std::istream& in)
+	{
+		SequenceFileHeader header;
+		if (!in.read((char*) &header, sizeof(header))) {
+			throw std::runtime_error("Not a sequence file!");
+		}
+		SequenceFile::checkHeader<ElementType>(header);
+
+		clear();
+
+		IndexType count = header.m_count;
+		bool isSmall = (count <= SmallCapacity);
+		vector<Sequence::Element*> elts;
+		vector<IndexType> widths;
+		if (!isSmall) {
+			// The count is not trusted until the records are read, so
+			// that a corrupt header cannot exhaust the memory.
+			elts.reserve(std::min(count, SequenceFile::BufferRecords));
+			widths.reserve(std::min(count, SequenceFile::BufferRecords));
+		}
+
+		vector<FileRecord> buffer(SequenceFile::BufferRecords);
+		IndexType start = 0;
+		for (IndexType done = 0; done < count; ) {
+			IndexType chunk = std::min(SequenceFile::BufferRecords, count - done);
+			bool isValid = (bool) in.read((char*) buffer.data(), chunk * sizeof(FileRecord));
+
+			for (IndexType i = 0; isValid && (i < chunk); i++) {
+				const FileRecord& record = buffer[i];
+				if (record.m_end < start) {
+					isValid = false;
+				} else if (isSmall) {
+					insertSmall(record.m_data, m_smallCount, record.m_end - start);
+				} else {
+					elts.push_back(m_pool.template create<GenericElement>(record.m_data));
+					widths.push_back(record.m_end - start);
+				}
+				start = record.m_end;
+			}
+
+			if (!isValid) {
+				for (Sequence::Element* pElt : elts) {
+					GenericElement* pGenElt = (GenericElement*) pElt;
+					pGenElt->~GenericElement();
+					m_pool.deallocateSlot(pGenElt);
+				}
+				clear();
+				throw std::runtime_error("Sequence file is truncated or corrupt!");
+			}
+			done += chunk;
+		}
+
+		if (!isSmall) {
+			IndexType index = 0;
+			m_seq.build(elts.begin(), elts.end(),
+				[&widths, &index](const Sequence::Element*)->IndexType {
+					return widths[index++];
+				});
+			m_isSmall = false;
+		}
+	}
+
+	void load(const string& path)
+	{
+		std::ifstream in(path, std::ios::binary);
+		if (!in) {
+			throw std::runtime_error("Cannot open sequence file!");
+		}
+		load(in);
 	}
 
 	// To remove an element from the sequence.  The element is destroyed.
+	// It throws an exception unless index is between 0 and count-1.
 	void remove(IndexType index)
 	{
-		m_seq.remove(index);
+		if constexpr (SmallCapacity > 0) {
+			if (m_isSmall) {
+				removeSmall(index);
+				return;
+			}
+		}
+
+		Sequence::Element* pElt = m_seq.getElement(index);
+		if (pElt == nullptr) {
+			throw std::range_error("Invalid index!");
+		}
+
+		m_seq.remove(pElt);
+		if ((SmallCapacity > 0) && (m_seq.getLength() <= SmallCapacity/2)) {
+			moveToSmall();
+		}
+	}
+
+	// To change the element at a particular (zero-based) index.  This
+	// updates the aggregates.  It throws an exception unless index is
+	// between 0 and count-1.
+	void set(IndexType index, const ElementType& elt)
+	{
+		if constexpr (SmallCapacity > 0) {
+			if (m_isSmall) {
+				m_small[checkSmallIndex(index)] = elt;
+				return;
+			}
+		}
+
+		GenericElement* pGenElt = (GenericElement*) m_seq.getElement(index);
+		if (pGenElt == nullptr) {
+			throw std::range_error("Invalid index!");
+		}
+
+		pGenElt->m_data = elt;
+		m_seq.updateAggregates(pGenElt);
 	}
 
 	// This method will throw an exception unless index is between 0 and
 	// count-1 where count is the number of elements in the GenericSequence.
+	// If the sequence keeps aggregates, an element that is changed through
+	// the returned reference must be followed by a call to set(), or the
+	// aggregates are stale.
 	ElementType& operator[](IndexType index)
 	{
+		if constexpr (SmallCapacity > 0) {
+			if (m_isSmall) {
+				return m_small[checkSmallIndex(index)];
+			}
+		}
+
 		GenericElement* pGenElt = (GenericElement*) m_seq.getElement(index);
 		if (pGenElt == nullptr) {
 			throw std::range_error("Invalid index!");
@@ -128,6 +670,16 @@ public:
 	// specified by this method.
 	void setWidth(IndexType index, IndexType width)
 	{
+		if constexpr (SmallCapacity > 0) {
+			if (m_isSmall) {
+				IndexType delta = width - getWidth(index);
+				for (IndexType i = index; i < m_smallCount; i++) {
+					m_smallEnds[i] += delta;
+				}
+				return;
+			}
+		}
+
 		GenericElement* pGenElt = (GenericElement*) m_seq.getElement(index);
 		if (pGenElt == nullptr) {
 			throw std::range_error("Invalid index!");
@@ -136,9 +688,123 @@ public:
 		m_seq.setWidth(pGenElt, width);
 	}
 
+	// To add delta to the widths of the elements at indices from,
+	// from+1, ..., to-1, or to set them all to width, in O(log n) (see
+	// Sequence::rangeAddWidth).  The aggregates would not be kept, so
+	// these are only for a sequence that keeps none.
+	void rangeAddWidth(IndexType from, IndexType to, long delta)
+	{
+		static_assert(!Aggregate::isEnabled,
+				      "Range width updates do not keep the aggregates");
+
+		if constexpr (SmallCapacity > 0) {
+			if (m_isSmall) {
+				if ((from > to) || (to > m_smallCount)) {
+					throw std::length_error("Invalid index!");
+				}
+
+				IndexType added = 0;
+				for (IndexType i = from; i < m_smallCount; i++) {
+					if (i < to) {
+						added += delta;
+					}
+					m_smallEnds[i] += added;
+				}
+				return;
+			}
+		}
+
+		m_seq.rangeAddWidth(from, to, delta);
+	}
+
+	void rangeSetWidth(IndexType from, IndexType to, IndexType width)
+	{
+		static_assert(!Aggregate::isEnabled,
+				      "Range width updates do not keep the aggregates");
+
+		if constexpr (SmallCapacity > 0) {
+			if (m_isSmall) {
+				if ((from > to) || (to > m_smallCount)) {
+					throw std::length_error("Invalid index!");
+				}
+
+				// The ends are rewritten in place, so the old start of each
+				// element is kept aside.
+				IndexType oldStart = smallStart(from);
+				IndexType end = oldStart;
+				for (IndexType i = from; i < m_smallCount; i++) {
+					IndexType oldEnd = m_smallEnds[i];
+					end += (i < to) ? width : oldEnd - oldStart;
+					oldStart = oldEnd;
+					m_smallEnds[i] = end;
+				}
+				return;
+			}
+		}
+
+		m_seq.rangeSetWidth(from, to, width);
+	}
+
+	// To reverse the order of the elements at indices from, from+1, ...,
+	// to-1, in O(log n) (see Sequence::reverseRange).  The aggregates
+	// would not be kept, so this is only for a sequence that keeps none.
+	void reverseRange(IndexType from, IndexType to)
+	{
+		static_assert(!Aggregate::isEnabled,
+				      "Reversals do not keep the aggregates");
+
+		if constexpr (SmallCapacity > 0) {
+			if (m_isSmall) {
+				if ((from > to) || (to > m_smallCount)) {
+					throw std::length_error("Invalid index!");
+				}
+
+				rearrangeSmall(from, [from, to](auto pFirst) {
+					std::reverse(pFirst + from, pFirst + to);
+				});
+				return;
+			}
+		}
+
+		m_seq.reverseRange(from, to);
+	}
+
+	// To move the elements at indices from, from+1, ..., to-1 to index
+	// dest of the sequence without them, in O(log n) (see
+	// Sequence::moveRange).
+	void moveRange(IndexType from, IndexType to, IndexType dest)
+	{
+		if constexpr (SmallCapacity > 0) {
+			if (m_isSmall) {
+				if ((from > to) || (to > m_smallCount) ||
+					(dest > m_smallCount - (to - from))) {
+					throw std::length_error("Invalid index!");
+				}
+
+				// The range is rotated forwards or backwards into place.
+				rearrangeSmall(std::min(from, dest), [from, to, dest](auto pFirst) {
+					if (dest < from) {
+						std::rotate(pFirst + dest, pFirst + from, pFirst + to);
+					} else {
+						std::rotate(pFirst + from, pFirst + to, pFirst + to + dest - from);
+					}
+				});
+				return;
+			}
+		}
+
+		m_seq.moveRange(from, to, dest);
+	}
+
 	// The width of an Element can be queried.
 	IndexType getWidth(IndexType index) const
 	{
+		if constexpr (SmallCapacity > 0) {
+			if (m_isSmall) {
+				return m_smallEnds[checkSmallIndex(index)] - smallStart(index);
+			}
+		}
+
 		GenericElement* pGenElt = (GenericElement*) m_seq.getElement(index);
 		if (pGenElt == nullptr) {
 			throw std::range_error("Invalid index!");
@@ -150,6 +816,12 @@ public:
 	// The start offset of an element can be queried.
 	IndexType getStartOffset(IndexType index) const
 	{
+		if constexpr (SmallCapacity > 0) {
+			if (m_isSmall) {
+				return smallStart(checkSmallIndex(index));
+			}
+		}
+
 		GenericElement* pGenElt = (GenericElement*) m_seq.getElement(index);
 		if (pGenElt == nullptr) {
 			throw std::range_error("Invalid index!");
@@ -162,6 +834,16 @@ public:
 	// its width.  This gets the element whose extent spans the given offset.
 	ElementType getElementAtOffset(IndexType offset) const
 	{
+		if constexpr (SmallCapacity > 0) {
+			if (m_isSmall) {
+				IndexType index = findSmallOffset(offset);
+				if (index == m_smallCount) {
+					throw std::range_error("Invalid index!");
+				}
+				return m_small[index];
+			}
+		}
+
 		GenericElement* pGenElt = (GenericElement*) m_seq.getElementAtOffset(offset);
 		if (pGenElt == nullptr) {
 			throw std::range_error("Invalid index!");
@@ -170,24 +852,354 @@ public:
 		return pGenElt->m_data;
 	}
 
+	// To make an immutable copy of the sequence that is laid out for
+	// lookups, with the values in an array rather than in nodes (see
+	// FrozenSequence), in O(n).
+	FrozenSequence<ElementType> freeze() const
+	{
+		vector<ElementType> values;
+		vector<IndexType> widths;
+		values.reserve(getLength());
+		widths.reserve(getLength());
+
+		if constexpr (SmallCapacity > 0) {
+			if (m_isSmall) {
+				for (IndexType i = 0; i < m_smallCount; i++) {
+					values.push_back(m_small[i]);
+					widths.push_back(m_smallEnds[i] - smallStart(i));
+				}
+			}
+		}
+
+		if (!m_isSmall) {
+			for (const Sequence::Element* pElt : m_seq) {
+				values.push_back(((const GenericElement*) pElt)->m_data);
+				widths.push_back(pElt->getWidth());
+			}
+		}
+
+		return FrozenSequence<ElementType>(std::move(values), widths);
+	}
+
+	// To get the elements at many indices, or spanning many offsets, at
+	// once.  The targets must be in ascending order.  Each lookup starts
+	// from the element found by the one before, so that k lookups that
+	// are close together take O(k + log n) (see Sequence::getElements).
+	// An exception is thrown if there is no element for a target.
+	void getElements(const vector<IndexType>& indices, vector<ElementType>& values) const
+	{
+		findSorted(indices, false, values);
+	}
+
+	void getElementsAtOffsets(const vector<IndexType>& offsets,
+			                  vector<ElementType>& values) const
+	{
+		findSorted(offsets, true, values);
+	}
+
+	// Iterators over the elements in order.  end() is past the last
+	// element.
+	ConstIterator begin() const
+	{
+		if constexpr (SmallCapacity > 0) {
+			if (m_isSmall) {
+				return ConstIterator(smallAt(0));
+			}
+		}
+
+		return ConstIterator(m_seq.begin());
+	}
+
+	ConstIterator end() const
+	{
+		if constexpr (SmallCapacity > 0) {
+			if (m_isSmall) {
+				return ConstIterator(smallAt(m_smallCount));
+			}
+		}
+
+		return ConstIterator(m_seq.end());
+	}
+
+	Iterator begin()
+	{
+		return toIterator(std::as_const(*this).begin());
+	}
+
+	Iterator end()
+	{
+		return toIterator(std::as_const(*this).end());
+	}
+
+	// An iterator at a particular (zero-based) index, in O(log n).  If
+	// the index is length() or more, this is end().
+	ConstIterator iteratorAt(IndexType index) const
+	{
+		if constexpr (SmallCapacity > 0) {
+			if (m_isSmall) {
+				return ConstIterator(smallAt(std::min(index, m_smallCount)));
+			}
+		}
+
+		return ConstIterator(m_seq.iteratorAt(index));
+	}
+
+	Iterator iteratorAt(IndexType index)
+	{
+		return toIterator(std::as_const(*this).iteratorAt(index));
+	}
+
+	// An iterator at the element whose extent spans the given offset,
+	// in O(log n).  If there is no such element, this is end().
+	ConstIterator iteratorAtOffset(IndexType offset) const
+	{
+		if constexpr (SmallCapacity > 0) {
+			if (m_isSmall) {
+				return ConstIterator(smallAt(findSmallOffset(offset)));
+			}
+		}
+
+		return ConstIterator(m_seq.iteratorAtOffset(offset));
+	}
+
+	Iterator iteratorAtOffset(IndexType offset)
+	{
+		return toIterator(std::as_const(*this).iteratorAtOffset(offset));
+	}
+
+	// To visit the elements at indices from, from+1, ..., to-1 in
+	// order, in O(log n + k) for k elements.  An exception is thrown
+	// unless from <= to <= length().
+	void visitRange
+	        (IndexType from, IndexType to,
+	         std::function<void(const ElementType& elt)> visitElt) const
+	{
+		if constexpr (SmallCapacity > 0) {
+			if (m_isSmall) {
+				if ((from > to) || (to > m_smallCount)) {
+					throw std::length_error("Invalid index!");
+				}
+
+				for (IndexType i = from; i < to; i++) {
+					visitElt(m_small[i]);
+				}
+				return;
+			}
+		}
+
+		m_seq.visitRange(from, to, [&visitElt](const Sequence::Element* pElt) {
+			visitElt(((const GenericElement*) pElt)->m_data);
+		});
+	}
+
+	// To visit, in order, the elements whose extents overlap the offsets
+	// [fromOffset, toOffset), in O(log n + k) for k elements.  An element
+	// of zero width is visited if its start offset is in that range.
+	void visitOffsetRange
+	        (IndexType fromOffset, IndexType toOffset,
+	         std::function<void(const ElementType& elt)> visitElt) const
+	{
+		if constexpr (SmallCapacity > 0) {
+			if (m_isSmall) {
+				for (IndexType i = 0; i < m_smallCount; i++) {
+					IndexType start = smallStart(i);
+					if (start >= toOffset) {
+						break;
+					}
+
+					if ((m_smallEnds[i] > fromOffset) ||
+						((start == m_smallEnds[i]) && (start >= fromOffset))) {
+						visitElt(m_small[i]);
+					}
+				}
+				return;
+			}
+		}
+
+		m_seq.visitOffsetRange(fromOffset, toOffset,
+			[&visitElt](const Sequence::Element* pElt) {
+				visitElt(((const GenericElement*) pElt)->m_data);
+			});
+	}
+
 	// To visit all the nodes in order.
 	void visitInOrder
 	        (std::function<void(const ElementType& elt)> visitElt)
 	{
-		m_seq.visitInOrder([visitElt](GenericElement* pGenElt)->void {
-			visitElt(pGenElt->m_data);
-		});
+		for (const ElementType& elt : *this) {
+			visitElt(elt);
+		}
+	}
+
+	// The smallest number of elements that parallelForEach and
+	// parallelReduce give to a task, and the number of tasks made per
+	// thread, so that work stealing can even out slow tasks.
+	static constexpr IndexType ParallelGrain = 1 << 12;
+	static constexpr IndexType TasksPerThread = 8;
+
+	// To call visitElt on every element, using the threads of pool.
+	// The sequence is split into chunks by the subtree weights, and each
+	// chunk is visited in order by one task, but the chunks run
+	// concurrently, so visitElt must be safe to call from several
+	// threads.  The sequence must not be changed meanwhile.
+	template <class Visit>
+	void parallelForEach(Visit visitElt,
+			             ThreadPool& pool = ThreadPool::getDefault(),
+			             IndexType grain = ParallelGrain) const
+	{
+		runChunks(pool, grain,
+			[](IndexType) {},
+			[this, &visitElt](IndexType, const Sequence::Element* pFirst, IndexType count) {
+				walkChunk(pFirst, count, visitElt);
+			});
+	}
+
+	// To reduce the elements, using the threads of pool.  Each task
+	// starts from identity and calls accumulate(result, elt) on the
+	// elements of its chunk in order, and the results of the chunks
+	// are then combined in index order by combine(left, right).  So
+	// combine need only be associative, not commutative, and the result
+	// is that of a serial left-to-right reduction.
+	template <class Result, class Accumulate, class Combine>
+	Result parallelReduce(const Result& identity,
+			              Accumulate accumulate,
+			              Combine combine,
+			              ThreadPool& pool = ThreadPool::getDefault(),
+			              IndexType grain = ParallelGrain) const
+	{
+		// Each task writes only its own slot, once it is done.
+		vector<std::optional<Result>> results;
+		runChunks(pool, grain,
+			[&results](IndexType chunkCount) {
+				results.resize(chunkCount);
+			},
+			[&](IndexType chunk, const Sequence::Element* pFirst, IndexType count) {
+				Result chunkResult = identity;
+				walkChunk(pFirst, count, [&](const ElementType& elt) {
+					accumulate(chunkResult, elt);
+				});
+				results[chunk] = std::move(chunkResult);
+			});
+
+		Result result = identity;
+		for (const std::optional<Result>& chunkResult : results) {
+			result = combine(result, *chunkResult);
+		}
+		return result;
+	}
+
+	// The aggregate of the elements at indices from, from+1, ..., to-1,
+	// in O(log n).  An exception is thrown unless from <= to <= length().
+	AggregateType aggregate(IndexType from, IndexType to) const
+	{
+		static_assert(Aggregate::isEnabled, "The sequence keeps no aggregates");
+
+		if ((from > to) || (to > getLength())) {
+			throw std::length_error("Invalid index!");
+		}
+
+		if (from == to) {
+			return Aggregate::identity();
+		}
+
+		if constexpr (SmallCapacity > 0) {
+			if (m_isSmall) {
+				AggregateType value = Aggregate::identity();
+				for (IndexType i = from; i < to; i++) {
+					value = Aggregate::combine(value,
+							Aggregate::of(m_small[i], m_smallEnds[i] - smallStart(i)));
+				}
+				return value;
+			}
+		}
+
+		return aggregateSubtree(m_seq.m_root, from, to);
+	}
+
+	// The first index i at which isReached(aggregate(0, i+1)) is true,
+	// in O(log n), or Sequence::UndefinedIndex if there is none.
+	// isReached must be monotonic, i.e. once it is true for a prefix it
+	// is true for all the longer prefixes.  For instance, with a
+	// SumAggregate of widths this is getElementAtOffset().
+	template <class Predicate>
+	IndexType findFirst(Predicate isReached) const
+	{
+		static_assert(Aggregate::isEnabled, "The sequence keeps no aggregates");
+
+		AggregateType prefix = Aggregate::identity();
+		AggregateType candidate;
+		IndexType index = 0;
+
+		if constexpr (SmallCapacity > 0) {
+			if (m_isSmall) {
+				for (; index < m_smallCount; index++) {
+					prefix = Aggregate::combine(prefix,
+							Aggregate::of(m_small[index],
+									      m_smallEnds[index] - smallStart(index)));
+					if (isReached(prefix)) {
+						return index;
+					}
+				}
+				return Sequence::UndefinedIndex;
+			}
+		}
+
+		const Sequence::Element* pElt = m_seq.m_root;
+
+		while (pElt != nullptr) {
+			const Sequence::Element* pLeft = pElt->m_left;
+			if (pLeft != nullptr) {
+				candidate = Aggregate::combine(
+						prefix, ((const GenericElement*) pLeft)->m_aggregate);
+				if (isReached(candidate)) {
+					pElt = pLeft;
+					continue;
+				}
+
+				prefix = candidate;
+				index += pLeft->m_weight;
+			}
+
+			candidate = Aggregate::combine(prefix,
+					Aggregate::of(((const GenericElement*) pElt)->m_data,
+							      pElt->getWidth()));
+			if (isReached(candidate)) {
+				return index;
+			}
+
+			prefix = candidate;
+			index++;
+			pElt = pElt->m_right;
+		}
+
+		return Sequence::UndefinedIndex;
 	}
 
 	// For printing the sequence
 	void print()
 	{
+		if constexpr (SmallCapacity > 0) {
+			if (m_isSmall) {
+				for (IndexType i = 0; i < m_smallCount; i++) {
+					std::cout << i << ": " << m_small[i].image() << std::endl;
+				}
+				return;
+			}
+		}
+
 		m_seq.print();
 	}
 
 	// For printing the sequence as a tree.
 	void printTree()
 	{
+		if constexpr (SmallCapacity > 0) {
+			if (m_isSmall) {
+				print();
+				return;
+			}
+		}
+
 		m_seq.printTree();
 	}
 
@@ -199,10 +1211,312 @@ public:
 	// used in testing.
 	void verify() const
 	{
+		if constexpr (SmallCapacity > 0) {
+			if (m_isSmall) {
+				if ((m_smallCount > SmallCapacity) || (m_seq.getLength() != 0)) {
+					throw logic_error("Small sequence has incorrect length!");
+				}
+
+				for (IndexType i = 0; i < m_smallCount; i++) {
+					if (m_smallEnds[i] < smallStart(i)) {
+						throw logic_error("Small sequence has incorrect widths!");
+					}
+				}
+				return;
+			}
+		}
+
 		m_seq.verify();
 	}
 private:
+	// A record of the sequence file of the sequence.
+	typedef SequenceFileRecord<ElementType> FileRecord;
+
+	// To split the sequence into chunks of at least grain elements,
+	// about TasksPerThread per thread of pool, and run a task on each.
+	// prepare(chunkCount) is called first, then visitChunk(chunk, pFirst,
+	// count) for each chunk, with the first element and the length of
+	// the chunk.  A small sequence is one chunk, with pFirst null.
+	template <class Prepare, class VisitChunk>
+	void runChunks(ThreadPool& pool, IndexType grain,
+			       Prepare prepare, VisitChunk visitChunk) const
+	{
+		if (m_seq.isFingerEnabled()) {
+			throw std::logic_error("Cannot visit in parallel with the finger enabled!");
+		}
+
+		IndexType length = getLength();
+		if (m_isSmall || (length == 0)) {
+			prepare(1);
+			visitChunk(0, nullptr, length);
+			return;
+		}
+
+		IndexType taskCount = pool.getThreadCount() * TasksPerThread;
+		IndexType chunkLength = std::max(std::max(grain, (IndexType) 1),
+				                         (length + taskCount - 1) / taskCount);
+
+		vector<Sequence::Element*> firsts;
+		m_seq.splitIntoChunks(chunkLength, firsts);
+		prepare(firsts.size());
+
+		pool.run(firsts.size(),
+			[&firsts, &visitChunk, chunkLength, length](IndexType chunk) {
+				IndexType count = std::min(chunkLength, length - chunk * chunkLength);
+				visitChunk(chunk, firsts[chunk], count);
+			});
+	}
+
+	// To visit count elements in order, from pFirst, or from the first
+	// element of the small array if pFirst is null.
+	template <class Visit>
+	void walkChunk(const Sequence::Element* pFirst, IndexType count, Visit&& visitElt) const
+	{
+		if (pFirst == nullptr) {
+			for (IndexType i = 0; i < count; i++) {
+				visitElt(m_small[i]);
+			}
+			return;
+		}
+
+		const Sequence::Element* pElt = pFirst;
+		for (IndexType i = 0; i < count; i++) {
+			visitElt(((const GenericElement*) pElt)->m_data);
+			pElt = Sequence::successor(pElt);
+		}
+	}
+
+	// The tree, to which the elements of a small sequence are moved.
+	Sequence& getTree()
+	{
+		if constexpr (SmallCapacity > 0) {
+			if (m_isSmall) {
+				moveToTree();
+			}
+		}
+
+		return m_seq;
+	}
+
+	// Destroys the elements of the tree, and releases their storage.
+	// If ElementType needs no destruction, the elements are not
+	// visited at all.
+	void clearTree()
+	{
+		if (std::is_trivially_destructible<ElementType>::value) {
+			m_seq.forgetElements();
+		} else {
+			m_seq.clear();
+		}
+
+		m_pool.release();
+	}
+
+	IndexType checkSmallIndex(IndexType index) const
+	{
+		if (index >= m_smallCount) {
+			throw std::range_error("Invalid index!");
+		}
+
+		return index;
+	}
+
+	IndexType smallStart(IndexType index) const
+	{
+		return (index == 0) ? 0 : m_smallEnds[index - 1];
+	}
+
+	const ElementType* smallAt(IndexType index) const
+	{
+		return m_small.data() + index;
+	}
+
+	// The Iterator at the same position as it, in a sequence that is
+	// not const.
+	static Iterator toIterator(const ConstIterator& it)
+	{
+		Iterator result(it.m_it);
+		result.m_pSmall = const_cast<ElementType*>(it.m_pSmall);
+		return result;
+	}
+
+	// The index of the first element of the flat array whose extent
+	// spans the offset, or m_smallCount if there is none.
+	IndexType findSmallOffset(IndexType offset) const
+	{
+		IndexType index = 0;
+		while ((index < m_smallCount) && (m_smallEnds[index] <= offset)) {
+			index++;
+		}
+		return index;
+	}
+
+	void insertSmall(const ElementType& elt, IndexType atIndex, IndexType width)
+	{
+		IndexType start = smallStart(atIndex);
+		std::move_backward(m_small.begin() + atIndex, m_small.begin() + m_smallCount,
+				           m_small.begin() + m_smallCount + 1);
+		for (IndexType i = m_smallCount; i > atIndex; i--) {
+			m_smallEnds[i] = m_smallEnds[i - 1] + width;
+		}
+
+		m_small[atIndex] = elt;
+		m_smallEnds[atIndex] = start + width;
+		m_smallCount++;
+	}
+
+	void removeSmall(IndexType index)
+	{
+		IndexType width = getWidth(index);
+		std::move(m_small.begin() + index + 1, m_small.begin() + m_smallCount,
+				  m_small.begin() + index);
+		for (IndexType i = index; i + 1 < m_smallCount; i++) {
+			m_smallEnds[i] = m_smallEnds[i + 1] - width;
+		}
+
+		m_smallCount--;
+		m_small[m_smallCount] = ElementType();
+	}
+
+	void findSorted(const vector<IndexType>& targets, bool isByOffset,
+			        vector<ElementType>& values) const
+	{
+		values.clear();
+		if constexpr (SmallCapacity > 0) {
+			if (m_isSmall) {
+				if (!std::is_sorted(targets.begin(), targets.end())) {
+					throw std::logic_error("Lookups are not sorted!");
+				}
+
+				for (IndexType target : targets) {
+					IndexType index = isByOffset ? findSmallOffset(target) : target;
+					if (index >= m_smallCount) {
+						throw std::range_error("Invalid index!");
+					}
+					values.push_back(m_small[index]);
+				}
+				return;
+			}
+		}
+
+		vector<Sequence::Element*> elts;
+		if (isByOffset) {
+			m_seq.getElementsAtOffsets(targets, elts);
+		} else {
+			m_seq.getElements(targets, elts);
+		}
+
+		for (Sequence::Element* pElt : elts) {
+			if (pElt == nullptr) {
+				throw std::range_error("Invalid index!");
+			}
+			values.push_back(((const GenericElement*) pElt)->m_data);
+		}
+	}
+
+	// Applies rearrange(pFirst) to the elements of the flat array and to
+	// their widths, where pFirst is at index 0, and then recomputes the
+	// ends from index from, before which nothing is rearranged.
+	template <class Rearrange>
+	void rearrangeSmall(IndexType from, Rearrange rearrange)
+	{
+		std::array<IndexType, SmallCapacity> widths;
+		for (IndexType i = from; i < m_smallCount; i++) {
+			widths[i] = m_smallEnds[i] - smallStart(i);
+		}
+
+		rearrange(m_small.begin());
+		rearrange(widths.begin());
+
+		IndexType end = smallStart(from);
+		for (IndexType i = from; i < m_smallCount; i++) {
+			end += widths[i];
+			m_smallEnds[i] = end;
+		}
+	}
+
+	// Moves the elements of the flat array into the tree.
+	void moveToTree()
+	{
+		vector<Sequence::Element*> elts;
+		for (IndexType i = 0; i < m_smallCount; i++) {
+			elts.push_back(m_pool.template create<GenericElement>(m_small[i]));
+		}
+
+		IndexType index = 0;
+		m_seq.build(elts.begin(), elts.end(),
+			[this, &index](const Sequence::Element*)->IndexType {
+				IndexType width = m_smallEnds[index] - smallStart(index);
+				index++;
+				return width;
+			});
+
+		for (IndexType i = 0; i < m_smallCount; i++) {
+			m_small[i] = ElementType();
+		}
+		m_smallCount = 0;
+		m_isSmall = false;
+	}
+
+	// Moves the elements of the tree into the flat array.
+	void moveToSmall()
+	{
+		for (Sequence::Element* pElt : m_seq) {
+			m_small[m_smallCount] = ((GenericElement*) pElt)->m_data;
+			m_smallEnds[m_smallCount] = smallStart(m_smallCount) + pElt->getWidth();
+			m_smallCount++;
+		}
+
+		clearTree();
+		m_isSmall = true;
+	}
+
+	// The aggregate of the indices from, ..., to-1 of the subtree at
+	// pElt, where from < to.
+	static AggregateType aggregateSubtree(const Sequence::Element* pElt,
+			                              IndexType from, IndexType to)
+	{
+		const GenericElement* pGenElt = (const GenericElement*) pElt;
+		if ((from == 0) && (to == pElt->m_weight)) {
+			return pGenElt->m_aggregate;
+		}
+
+		IndexType leftWeight = (pElt->m_left == nullptr)
+				                   ? 0 : pElt->m_left->m_weight;
+		AggregateType value = Aggregate::identity();
+
+		if (from < leftWeight) {
+			value = aggregateSubtree(pElt->m_left, from,
+					                 std::min(to, leftWeight));
+		}
+
+		if ((from <= leftWeight) && (leftWeight < to)) {
+			value = Aggregate::combine(value,
+					Aggregate::of(pGenElt->m_data, pElt->getWidth()));
+		}
+
+		if (to > leftWeight + 1) {
+			IndexType rightFrom = (from > leftWeight + 1)
+					                  ? from - leftWeight - 1 : 0;
+			value = Aggregate::combine(value,
+					aggregateSubtree(pElt->m_right, rightFrom,
+							         to - leftWeight - 1));
+		}
+
+		return value;
+	}
+
+	// The pool is declared before m_seq, so that the elements are
+	// destroyed before their storage is.
+	ElementPool m_pool;
 	Sequence m_seq;
+
+	// The flat array of a small sequence, with the end offset of each
+	// element.
+	bool m_isSmall = (SmallCapacity > 0);
+	IndexType m_smallCount = 0;
+	std::array<ElementType, SmallCapacity> m_small;
+	std::array<IndexType, SmallCapacity> m_smallEnds;
 };
 
 
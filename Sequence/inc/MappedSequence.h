@@ -0,0 +1,237 @@
+/*
+ * MappedSequence.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: R. Krishnaswamy
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "inc/Sequence.h"
+#include "inc/SequenceFile.h"
+
+using namespace std;
+
+// A MappedSequence is a read-only view of a sequence file, written by
+// GenericSequence::save, that is mapped into memory rather than read.
+// Opening it takes O(1), whatever the length, and the pages of the file
+// are read in by the operating system as they are used.
+//
+// The records of the file are in index order, with the end offset of
+// each element, so an element is found by its index in O(1), and by an
+// offset with a binary search in O(log n).  To edit the sequence, load
+// the file into a GenericSequence instead.
+//
+// Opening checks the header and the size of the file, but not the
+// records, which would take O(n).  So if the end offsets of a corrupt
+// file decrease, the widths, and the lookups by offset, are undefined;
+// GenericSequence::load does check them.
+template <
+// The class ElementType is expected to be trivially copyable.
+class ElementType
+>
+class MappedSequence
+{
+public:
+	typedef SequenceFileRecord<ElementType> Record;
+
+	// An Iterator visits the elements in order.  It is a bidirectional
+	// iterator.
+	class Iterator
+	{
+	public:
+		typedef std::bidirectional_iterator_tag iterator_category;
+		typedef ElementType value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef const ElementType* pointer;
+		typedef const ElementType& reference;
+
+		Iterator()
+		{}
+
+		explicit Iterator(const Record* pRecord)
+		: m_pRecord(pRecord)
+		{}
+
+		const ElementType& operator*() const
+		{
+			return m_pRecord->m_data;
+		}
+
+		const ElementType* operator->() const
+		{
+			return &m_pRecord->m_data;
+		}
+
+		Iterator& operator++()
+		{
+			m_pRecord++;
+			return *this;
+		}
+
+		Iterator operator++(int)
+		{
+			Iterator old = *this;
+			m_pRecord++;
+			return old;
+		}
+
+		Iterator& operator--()
+		{
+			m_pRecord--;
+			return *this;
+		}
+
+		Iterator operator--(int)
+		{
+			Iterator old = *this;
+			m_pRecord--;
+			return old;
+		}
+
+		bool operator==(const Iterator& that) const
+		{
+			return m_pRecord == that.m_pRecord;
+		}
+
+		bool operator!=(const Iterator& that) const
+		{
+			return m_pRecord != that.m_pRecord;
+		}
+
+	private:
+		const Record* m_pRecord = nullptr;
+	};
+
+	// Constructor.  The file at path is mapped.  An exception is thrown
+	// if it cannot be, or if it is not a sequence file of ElementType.
+	explicit MappedSequence(const string& path)
+	{
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			throw std::runtime_error("Cannot open sequence file!");
+		}
+
+		struct stat status;
+		if ((::fstat(fd, &status) != 0) ||
+			((IndexType) status.st_size < sizeof(SequenceFileHeader))) {
+			::close(fd);
+			throw std::runtime_error("Not a sequence file!");
+		}
+
+		m_size = status.st_size;
+		m_pBase = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (m_pBase == MAP_FAILED) {
+			throw std::runtime_error("Cannot map sequence file!");
+		}
+
+		const SequenceFileHeader* pHeader = (const SequenceFileHeader*) m_pBase;
+		try {
+			SequenceFile::checkHeader<ElementType>(*pHeader, m_size);
+		} catch (...) {
+			::munmap(m_pBase, m_size);
+			throw;
+		}
+
+		m_length = pHeader->m_count;
+		m_pRecords = (const Record*) (pHeader + 1);
+	}
+
+	// Destructor.  The file is unmapped.
+	virtual ~MappedSequence()
+	{
+		::munmap(m_pBase, m_size);
+	}
+
+	MappedSequence(const MappedSequence&) = delete;
+	MappedSequence& operator=(const MappedSequence&) = delete;
+
+	// The length of the sequence.
+	IndexType getLength() const
+	{
+		return m_length;
+	}
+
+	// This method will throw an exception unless index is between 0 and
+	// count-1 where count is the number of elements in the sequence.
+	const ElementType& operator[](IndexType index) const
+	{
+		checkIndex(index);
+		return m_pRecords[index].m_data;
+	}
+
+	// The width of an Element can be queried.
+	IndexType getWidth(IndexType index) const
+	{
+		checkIndex(index);
+		return m_pRecords[index].m_end - getStartOffset(index);
+	}
+
+	// The start offset of an element can be queried.
+	IndexType getStartOffset(IndexType index) const
+	{
+		checkIndex(index);
+		return (index == 0) ? 0 : m_pRecords[index - 1].m_end;
+	}
+
+	// Each element occupies an extant specified by its start offset and
+	// its width.  This gets the element whose extent spans the given offset.
+	const ElementType& getElementAtOffset(IndexType offset) const
+	{
+		// The first element that ends after the offset.
+		const Record* pEnd = m_pRecords + m_length;
+		const Record* pRecord = std::upper_bound(m_pRecords, pEnd, offset,
+			[](IndexType offset, const Record& record) {
+				return offset < record.m_end;
+			});
+
+		if (pRecord == pEnd) {
+			throw std::range_error("Invalid index!");
+		}
+		return pRecord->m_data;
+	}
+
+	// Iterators over the elements in order.  end() is past the last
+	// element.
+	Iterator begin() const
+	{
+		return Iterator(m_pRecords);
+	}
+
+	Iterator end() const
+	{
+		return Iterator(m_pRecords + m_length);
+	}
+
+	// An iterator at a particular (zero-based) index.  If the index is
+	// length() or more, this is end().
+	Iterator iteratorAt(IndexType index) const
+	{
+		return Iterator(m_pRecords + std::min(index, m_length));
+	}
+
+private:
+	void checkIndex(IndexType index) const
+	{
+		if (index >= m_length) {
+			// Error
+			throw std::range_error("Invalid index!");
+		}
+	}
+
+	void* m_pBase = nullptr;
+	IndexType m_size = 0;
+	IndexType m_length = 0;
+	const Record* m_pRecords = nullptr;
+};
@@ -0,0 +1,583 @@
+/*
+ * PersistentSequence.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: R. Krishnaswamy
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "inc/Sequence.h"
+
+using namespace std;
+
+// The template PersistentSequence has the index and offset API of
+// GenericSequence, and O(1) snapshots.  A snapshot is a PersistentSequence
+// that keeps the contents as they were when it was taken, however the
+// sequence it was taken from is edited afterwards, and vice versa.
+//
+// The nodes are immutable, and shared between the sequence and its
+// snapshots.  They have no parent links, so that a node can be in any
+// number of trees.  An edit copies the nodes on the path from the root
+// to the edited element, O(log n) of them, and shares all the others.
+// The nodes are reference counted, and a node is destroyed once no
+// sequence or snapshot refers to it.
+//
+// Concurrency: snapshot() may be called from any thread while one writer
+// edits the sequence; the root is loaded and stored atomically.  The
+// snapshot can then be read by its thread without any locking, and
+// without stalling the writer.  All other methods need the usual
+// external synchronization.
+//
+// The tree is an AVL tree, balanced in the same way as that of Sequence.
+// Since edits copy the elements on the path, ElementType should be cheap
+// to copy.
+
+template <
+// The class ElementType is expected to be copy constructible.
+class ElementType
+>
+class PersistentSequence
+{
+public:
+	struct Node;
+	typedef std::shared_ptr<const Node> NodePtr;
+
+	struct Node
+	{
+		Node(const ElementType& data, IndexType width, NodePtr pLeft, NodePtr pRight)
+		: m_data(data),
+		  m_pLeft(std::move(pLeft)),
+		  m_pRight(std::move(pRight)),
+		  m_width(width)
+		{
+			m_weight = 1 + weight(m_pLeft) + weight(m_pRight);
+			m_cumWidth = width + cumWidth(m_pLeft) + cumWidth(m_pRight);
+			m_height = 1 + std::max(height(m_pLeft), height(m_pRight));
+		}
+
+		ElementType m_data;
+		NodePtr m_pLeft;
+		NodePtr m_pRight;
+		IndexType m_width;
+
+		// Number of nodes, and cumulative width of the nodes, in the
+		// subtree rooted by this node.
+		IndexType m_weight;
+		IndexType m_cumWidth;
+
+		// Maximum distance to a leaf node of the subtree.
+		int m_height;
+	};
+
+	// An Iterator visits the elements in order.  It is a forward
+	// iterator, which keeps the path from the root to the current node.
+	// It is invalidated by any edit of the sequence it is from, but not
+	// by edits of other snapshots.
+	class Iterator
+	{
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef ElementType value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef const ElementType* pointer;
+		typedef const ElementType& reference;
+
+		Iterator()
+		{}
+
+		const ElementType& operator*() const
+		{
+			return m_path.back()->m_data;
+		}
+
+		const ElementType* operator->() const
+		{
+			return &(**this);
+		}
+
+		Iterator& operator++()
+		{
+			const Node* pNode = m_path.back();
+			if (pNode->m_pRight != nullptr) {
+				pushLeftmost(pNode->m_pRight.get());
+				return *this;
+			}
+
+			// Up to the first ancestor of which this is in the left
+			// subtree.
+			m_path.pop_back();
+			while (!m_path.empty() && (m_path.back()->m_pRight.get() == pNode)) {
+				pNode = m_path.back();
+				m_path.pop_back();
+			}
+			return *this;
+		}
+
+		Iterator operator++(int)
+		{
+			Iterator old = *this;
+			++(*this);
+			return old;
+		}
+
+		bool operator==(const Iterator& that) const
+		{
+			return current() == that.current();
+		}
+
+		bool operator!=(const Iterator& that) const
+		{
+			return current() != that.current();
+		}
+
+	private:
+		friend class PersistentSequence;
+
+		void pushLeftmost(const Node* pNode)
+		{
+			for (; pNode != nullptr; pNode = pNode->m_pLeft.get()) {
+				m_path.push_back(pNode);
+			}
+		}
+
+		const Node* current() const
+		{
+			return m_path.empty() ? nullptr : m_path.back();
+		}
+
+		// The nodes from the root to the current node, or empty at the end.
+		vector<const Node*> m_path;
+	};
+
+	// Constructor
+	PersistentSequence()
+	{}
+
+	// Copying is O(1), and the copy is a snapshot.
+	PersistentSequence(const PersistentSequence& that)
+	: m_pRoot(std::atomic_load(&that.m_pRoot))
+	{}
+
+	PersistentSequence& operator=(const PersistentSequence& that)
+	{
+		setRoot(std::atomic_load(&that.m_pRoot));
+		return *this;
+	}
+
+	// Virtual destructor
+	virtual ~PersistentSequence()
+	{}
+
+	// A snapshot of the sequence, in O(1).
+	PersistentSequence snapshot() const
+	{
+		return PersistentSequence(*this);
+	}
+
+	// Destroys all elements of the sequence that are not in a snapshot,
+	// so it can be reused.
+	void clear()
+	{
+		setRoot(nullptr);
+	}
+
+	// Current length of the sequence.  This is one more than the last
+	// index.  Initial length of the sequence is zero.
+	IndexType getLength() const
+	{
+		return weight(m_pRoot);
+	}
+
+	// To insert an element at a particular (zero-based) index.  Valid
+	// indices are from zero to length().  If the index is length(),
+	// then the new element is inserted at the end (appended).  The last
+	// defaulted parameter provides the width of the new element.
+	void insertAtIndex(const ElementType& elt, IndexType atIndex, IndexType width = 0)
+	{
+		if (atIndex > getLength()) {
+			// Error
+			throw std::length_error("Invalid index!");
+		}
+
+		setRoot(insert(m_pRoot, atIndex, elt, width));
+	}
+
+	// To append an element.  The last defaulted parameter provides the width
+	// of the new element.
+	void append(const ElementType& elt, IndexType width = 0)
+	{
+		insertAtIndex(elt, getLength(), width);
+	}
+
+	// To build the sequence from a range of ElementType values in O(n).
+	// Any existing elements are dropped first.  widthOf(elt) provides
+	// the width of each element.
+	template <class Iterator, class WidthOf>
+	void build(Iterator first, Iterator last, WidthOf widthOf)
+	{
+		vector<ElementType> elts(first, last);
+		vector<IndexType> widths;
+		for (const ElementType& elt : elts) {
+			widths.push_back(widthOf(elt));
+		}
+
+		setRoot(buildSubtree(elts, widths, 0, elts.size()));
+	}
+
+	// To remove an element from the sequence.
+	void remove(IndexType index)
+	{
+		checkIndex(index);
+		setRoot(remove(m_pRoot, index));
+	}
+
+	// To replace the element at an index, keeping its width.
+	void set(IndexType index, const ElementType& elt)
+	{
+		checkIndex(index);
+		setRoot(update(m_pRoot, index, &elt, getWidth(index)));
+	}
+
+	// This method will throw an exception unless index is between 0 and
+	// count-1 where count is the number of elements in the sequence.
+	// The elements cannot be changed in place, since they may be shared
+	// with snapshots; use set().
+	const ElementType& operator[](IndexType index) const
+	{
+		return getNode(index)->m_data;
+	}
+
+	// Each Element has a "width" attribute that indicates how much space
+	// it occupies.  This is by default 0 if not specified.  It can be
+	// specified by this method.
+	void setWidth(IndexType index, IndexType width)
+	{
+		checkIndex(index);
+		setRoot(update(m_pRoot, index, nullptr, width));
+	}
+
+	// The width of an Element can be queried.
+	IndexType getWidth(IndexType index) const
+	{
+		return getNode(index)->m_width;
+	}
+
+	// The start offset of an element can be queried.
+	IndexType getStartOffset(IndexType index) const
+	{
+		checkIndex(index);
+
+		IndexType startOffset = 0;
+		const Node* pNode = m_pRoot.get();
+		while (true) {
+			IndexType leftWeight = weight(pNode->m_pLeft);
+			if (index < leftWeight) {
+				pNode = pNode->m_pLeft.get();
+				continue;
+			}
+
+			startOffset += cumWidth(pNode->m_pLeft);
+			if (index == leftWeight) {
+				return startOffset;
+			}
+
+			index -= leftWeight + 1;
+			startOffset += pNode->m_width;
+			pNode = pNode->m_pRight.get();
+		}
+	}
+
+	// Each element occupies an extant specified by its start offset and
+	// its width.  This gets the element whose extent spans the given offset.
+	const ElementType& getElementAtOffset(IndexType offset) const
+	{
+		if (offset >= cumWidth(m_pRoot)) {
+			throw std::range_error("Invalid index!");
+		}
+
+		const Node* pNode = m_pRoot.get();
+		while (true) {
+			IndexType leftWidth = cumWidth(pNode->m_pLeft);
+			if (offset < leftWidth) {
+				pNode = pNode->m_pLeft.get();
+				continue;
+			}
+
+			offset -= leftWidth;
+			if (offset < pNode->m_width) {
+				return pNode->m_data;
+			}
+
+			offset -= pNode->m_width;
+			pNode = pNode->m_pRight.get();
+		}
+	}
+
+	// Iterators over the elements in order.  end() is past the last
+	// element.
+	Iterator begin() const
+	{
+		Iterator iter;
+		iter.pushLeftmost(m_pRoot.get());
+		return iter;
+	}
+
+	Iterator end() const
+	{
+		return Iterator();
+	}
+
+	// An iterator at a particular (zero-based) index, in O(log n).  If
+	// the index is length() or more, this is end().
+	Iterator iteratorAt(IndexType index) const
+	{
+		Iterator iter;
+		if (index >= getLength()) {
+			return iter;
+		}
+
+		// Only the ancestors that the iterator goes back up to, i.e.
+		// those of which the element is in the left subtree, are kept.
+		const Node* pNode = m_pRoot.get();
+		while (true) {
+			IndexType leftWeight = weight(pNode->m_pLeft);
+			if (index < leftWeight) {
+				iter.m_path.push_back(pNode);
+				pNode = pNode->m_pLeft.get();
+			} else if (index == leftWeight) {
+				iter.m_path.push_back(pNode);
+				return iter;
+			} else {
+				index -= leftWeight + 1;
+				pNode = pNode->m_pRight.get();
+			}
+		}
+	}
+
+	// True if the root node is shared with that sequence, i.e. if
+	// neither has been edited since one was taken as a snapshot of the
+	// other.  This is used in testing.
+	bool isSharedWith(const PersistentSequence& that) const
+	{
+		return m_pRoot == that.m_pRoot;
+	}
+
+	// To verify tree properties.  The height, weight and width of nodes
+	// need to be correct, and the tree should be balanced.  It throws an
+	// exception on the first node that is not.  This method is used in
+	// testing.
+	void verify() const
+	{
+		verify(m_pRoot.get());
+	}
+
+private:
+	NodePtr m_pRoot;
+
+	static IndexType weight(const NodePtr& pNode)
+	{
+		return (pNode == nullptr) ? 0 : pNode->m_weight;
+	}
+
+	static IndexType cumWidth(const NodePtr& pNode)
+	{
+		return (pNode == nullptr) ? 0 : pNode->m_cumWidth;
+	}
+
+	static int height(const NodePtr& pNode)
+	{
+		return (pNode == nullptr) ? -1 : pNode->m_height;
+	}
+
+	// The root is stored atomically, for snapshot() on other threads.
+	void setRoot(NodePtr pRoot)
+	{
+		std::atomic_store(&m_pRoot, std::move(pRoot));
+	}
+
+	void checkIndex(IndexType index) const
+	{
+		if (index >= getLength()) {
+			// Error
+			throw std::length_error("Invalid index!");
+		}
+	}
+
+	const Node* getNode(IndexType index) const
+	{
+		checkIndex(index);
+
+		const Node* pNode = m_pRoot.get();
+		while (true) {
+			IndexType leftWeight = weight(pNode->m_pLeft);
+			if (index < leftWeight) {
+				pNode = pNode->m_pLeft.get();
+			} else if (index == leftWeight) {
+				return pNode;
+			} else {
+				index -= leftWeight + 1;
+				pNode = pNode->m_pRight.get();
+			}
+		}
+	}
+
+	static NodePtr makeNode(const ElementType& data, IndexType width,
+			                NodePtr pLeft, NodePtr pRight)
+	{
+		return std::make_shared<const Node>(data, width, std::move(pLeft), std::move(pRight));
+	}
+
+	// A new node with the given element and subtrees, whose heights
+	// differ by at most 2, rotated as needed to be balanced.  Only new
+	// nodes are made; the nodes of the subtrees are shared.
+	static NodePtr balance(const ElementType& data, IndexType width,
+			               NodePtr pLeft, NodePtr pRight)
+	{
+		if (height(pLeft) > height(pRight) + 1) {
+			if (height(pLeft->m_pLeft) >= height(pLeft->m_pRight)) {
+				// Single right rotation.
+				return makeNode(pLeft->m_data, pLeft->m_width, pLeft->m_pLeft,
+						makeNode(data, width, pLeft->m_pRight, std::move(pRight)));
+			}
+
+			// Left-right double rotation.
+			const NodePtr& pMiddle = pLeft->m_pRight;
+			return makeNode(pMiddle->m_data, pMiddle->m_width,
+					makeNode(pLeft->m_data, pLeft->m_width, pLeft->m_pLeft, pMiddle->m_pLeft),
+					makeNode(data, width, pMiddle->m_pRight, std::move(pRight)));
+		}
+
+		if (height(pRight) > height(pLeft) + 1) {
+			if (height(pRight->m_pRight) >= height(pRight->m_pLeft)) {
+				// Single left rotation.
+				return makeNode(pRight->m_data, pRight->m_width,
+						makeNode(data, width, std::move(pLeft), pRight->m_pLeft),
+						pRight->m_pRight);
+			}
+
+			// Right-left double rotation.
+			const NodePtr& pMiddle = pRight->m_pLeft;
+			return makeNode(pMiddle->m_data, pMiddle->m_width,
+					makeNode(data, width, std::move(pLeft), pMiddle->m_pLeft),
+					makeNode(pRight->m_data, pRight->m_width, pMiddle->m_pRight, pRight->m_pRight));
+		}
+
+		return makeNode(data, width, std::move(pLeft), std::move(pRight));
+	}
+
+	static NodePtr insert(const NodePtr& pNode, IndexType index,
+			              const ElementType& elt, IndexType width)
+	{
+		if (pNode == nullptr) {
+			return makeNode(elt, width, nullptr, nullptr);
+		}
+
+		IndexType leftWeight = weight(pNode->m_pLeft);
+		if (index <= leftWeight) {
+			return balance(pNode->m_data, pNode->m_width,
+					insert(pNode->m_pLeft, index, elt, width), pNode->m_pRight);
+		}
+
+		return balance(pNode->m_data, pNode->m_width, pNode->m_pLeft,
+				insert(pNode->m_pRight, index - leftWeight - 1, elt, width));
+	}
+
+	static NodePtr remove(const NodePtr& pNode, IndexType index)
+	{
+		IndexType leftWeight = weight(pNode->m_pLeft);
+		if (index < leftWeight) {
+			return balance(pNode->m_data, pNode->m_width,
+					remove(pNode->m_pLeft, index), pNode->m_pRight);
+		}
+
+		if (index > leftWeight) {
+			return balance(pNode->m_data, pNode->m_width, pNode->m_pLeft,
+					remove(pNode->m_pRight, index - leftWeight - 1));
+		}
+
+		if (pNode->m_pLeft == nullptr) {
+			return pNode->m_pRight;
+		}
+
+		if (pNode->m_pRight == nullptr) {
+			return pNode->m_pLeft;
+		}
+
+		// The successor takes the place of the removed node, as in
+		// Sequence::remove.
+		const Node* pSuccessor = pNode->m_pRight.get();
+		while (pSuccessor->m_pLeft != nullptr) {
+			pSuccessor = pSuccessor->m_pLeft.get();
+		}
+
+		return balance(pSuccessor->m_data, pSuccessor->m_width, pNode->m_pLeft,
+				remove(pNode->m_pRight, 0));
+	}
+
+	// A copy of the path to the element at index, with the element
+	// replaced by *pElt if that is non-null, and its width set to width.
+	static NodePtr update(const NodePtr& pNode, IndexType index,
+			              const ElementType* pElt, IndexType width)
+	{
+		IndexType leftWeight = weight(pNode->m_pLeft);
+		if (index < leftWeight) {
+			return makeNode(pNode->m_data, pNode->m_width,
+					update(pNode->m_pLeft, index, pElt, width), pNode->m_pRight);
+		}
+
+		if (index > leftWeight) {
+			return makeNode(pNode->m_data, pNode->m_width, pNode->m_pLeft,
+					update(pNode->m_pRight, index - leftWeight - 1, pElt, width));
+		}
+
+		return makeNode((pElt != nullptr) ? *pElt : pNode->m_data, width,
+				        pNode->m_pLeft, pNode->m_pRight);
+	}
+
+	// A perfectly balanced subtree of the elements [from, to).
+	static NodePtr buildSubtree(const vector<ElementType>& elts,
+			                    const vector<IndexType>& widths,
+			                    IndexType from, IndexType to)
+	{
+		if (from == to) {
+			return nullptr;
+		}
+
+		IndexType middle = from + (to - from) / 2;
+		return makeNode(elts[middle], widths[middle],
+				        buildSubtree(elts, widths, from, middle),
+				        buildSubtree(elts, widths, middle + 1, to));
+	}
+
+	static void verify(const Node* pNode)
+	{
+		if (pNode == nullptr) {
+			return;
+		}
+
+		verify(pNode->m_pLeft.get());
+		verify(pNode->m_pRight.get());
+
+		int leftHeight = height(pNode->m_pLeft);
+		int rightHeight = height(pNode->m_pRight);
+		if ((pNode->m_height != 1 + std::max(leftHeight, rightHeight)) ||
+			(leftHeight - rightHeight > 1) || (rightHeight - leftHeight > 1)) {
+			throw logic_error("Unbalanced or incorrect height in PersistentSequence");
+		}
+
+		if ((pNode->m_weight != 1 + weight(pNode->m_pLeft) + weight(pNode->m_pRight)) ||
+			(pNode->m_cumWidth != pNode->m_width + cumWidth(pNode->m_pLeft) +
+				                  cumWidth(pNode->m_pRight))) {
+			throw logic_error("Incorrect weight or width in PersistentSequence");
+		}
+	}
+};
@@ -7,7 +7,11 @@
 
 #pragma once
 
-#include <functional>
+#include <algorithm>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <utility>
 #include "inc/Sequence.h"
 
 // A Rotation specifies a rotation of the nodes of the tree that is
@@ -32,101 +36,173 @@
 //       4           5            0
 //       5           0            0
 //       6           0            0
-// A TreePatternEntry is a struct giving the left and right child.
 //
 // Spaces and commas can be used with a TreePattern expression for
 // readability.
-struct TreePatternEntry
+//
+// TreePatterns are built at compile time, so that a Rotation can be
+// expanded into straight-line code that relinks the matched nodes.
+struct TreePattern
 {
-	IndexType left = Sequence::UndefinedIndex;
-	IndexType right = Sequence::UndefinedIndex;
+	// The largest number of nodes in a pattern.
+	static constexpr IndexType MaxNodes = 8;
+
+	// The value of a missing child.
+	static constexpr IndexType NoChild = std::numeric_limits<IndexType>::max();
+
+	IndexType left[MaxNodes] = {};
+	IndexType right[MaxNodes] = {};
+
+	// Specifies which index is the root.
+	IndexType root = NoChild;
+
+	// Number of nodes $0 .. $(count-1) in the pattern.
+	IndexType count = 0;
 
-	bool isLeaf() {
-		return (left == Sequence::UndefinedIndex) &&
-			   (right == Sequence::UndefinedIndex);
+	// All the nodes in postorder, the root being the last.
+	IndexType postOrder[MaxNodes] = {};
+	IndexType postOrderCount = 0;
+
+	constexpr bool isLeaf(IndexType index) const
+	{
+		return (left[index] == NoChild) && (right[index] == NoChild);
+	}
+
+	constexpr void addPostOrder(IndexType index)
+	{
+		if (left[index] != NoChild) {
+			addPostOrder(left[index]);
+		}
+
+		if (right[index] != NoChild) {
+			addPostOrder(right[index]);
+		}
+
+		postOrder[postOrderCount++] = index;
 	}
 };
 
 
-// A TreePattern is merely a vector of TreePatternEntry's, specifying
-// for each node what its children are.
-class TreePattern : public vector<TreePatternEntry>
+// Builds a TreePattern from a pattern string, such as $0($1($2 $3) $4($5 0))
+// representing TreePattern
+//                $0
+//                 |
+//       $1------------------$4
+//        |                   |
+//   $2-------$3         $5-------nullptr
+constexpr TreePattern buildTreePattern(const char* pattern)
 {
-public:
-	// Specifies which index is the root.
-	IndexType root = Sequence::UndefinedIndex;
+	TreePattern treePattern;
+	for (IndexType i = 0; i < TreePattern::MaxNodes; i++) {
+		treePattern.left[i] = TreePattern::NoChild;
+		treePattern.right[i] = TreePattern::NoChild;
+	}
 
-	// Default constructor
-	TreePattern();
+	// A stack of the children that are still expected.  Each '('
+	// pushes the right and then the left child of the last node.
+	IndexType stackIndex[2*TreePattern::MaxNodes] = {};
+	bool stackLeftChild[2*TreePattern::MaxNodes] = {};
+	IndexType stackSize = 0;
+	IndexType lastIndex = TreePattern::NoChild;
 
-	// Copy constructor
-	TreePattern(const TreePattern& that);
+	for (const char* pChar = pattern; *pChar != '\0'; pChar++) {
+		switch (*pChar) {
+		case '$': {
+			// The number must be immediately after a $.
+			IndexType index = 0;
+			while ((pChar[1] >= '0') && (pChar[1] <= '9')) {
+				pChar++;
+				index = 10*index + (*pChar - '0');
+			}
 
-	void reset();
+			if (treePattern.count < index + 1) {
+				treePattern.count = index + 1;
+			}
 
-	// Visits in postorder.  The parameter is called on each index
-	// in postorder, the root being the last.
-	void postOrder(std::function<void(IndexType)> visit);
+			if (stackSize == 0) {
+				treePattern.root = index;
+			} else {
+				stackSize--;
+				if (stackLeftChild[stackSize]) {
+					treePattern.left[stackIndex[stackSize]] = index;
+				} else {
+					treePattern.right[stackIndex[stackSize]] = index;
+				}
+			}
 
-private:
-	void internalPostOrder(std::function<void(IndexType)> visit,
-			               IndexType fromIndex);
-};
+			lastIndex = index;
+			break;
+		}
+
+		case '(':
+			// Expecting left and right children.  Push them on the stack.
+			stackIndex[stackSize] = lastIndex;
+			stackLeftChild[stackSize] = false;
+			stackSize++;
+			stackIndex[stackSize] = lastIndex;
+			stackLeftChild[stackSize] = true;
+			stackSize++;
+			break;
+
+		case '0':
+			// This represents the nullptr in Sequence::Element.  The
+			// child is already NoChild.
+			if (stackSize > 0) {
+				stackSize--;
+			}
+			break;
 
-// We can now describe a Rotation.
+		default:
+			// Spaces, commas and ')'
+			break;
+		}
+	}
+
+	treePattern.addPostOrder(treePattern.root);
+	return treePattern;
+}
+
+
+// We can now describe a Rotation.  A Rotation is applied at an unbalanced
+// node that matches $0 of an input pattern, and it relinks the matched
+// nodes into the shape of an output pattern.  The patterns are given by
+// a class such as
+//
+//     struct LLbPatterns
+//     {
+//         static constexpr const char* input = "$0($1($2,$3),$4)";
+//         static constexpr const char* output = "$1($2,$0($3,$4))";
+//     };
+//
+// Note that the nodes $0, $1, etc must be enumerated in pre-order in the
+// input pattern, that is to say:
+//   - $0 must be the first pre-order node (the root).
+//   - $1 must be the second pre-order node
+// and so on.
+//
+// Note also that leaf-nodes of the input pattern must also be leaf-nodes
+// of the output pattern.  However non-leaf nodes of the input pattern
+// could become a leaf-node of the output pattern (e.g. Sequence.cpp has
+// pattern LL-a, where non-leaf node $0 of the input pattern becomes a
+// leaf-node in the output pattern).  A leaf-node of the input pattern
+// may match a nullptr.
+//
+// A Rotation does not check whether its input pattern matches the tree.
+// Sequence::rebalanceSubtree picks the rotation from the height-deltas
+// of the unbalanced node and its descendants, which determine the shape.
 class Rotation
 {
 public:
+	// Constructor.  The name is used to report the usage.
+	Rotation(const string& rotName);
 
-	// Default constructor
-	Rotation();
-
-	// Copy constructor
-	Rotation(const Rotation& that);
-
-	// An input pattern matches if the tree has the
-	// shape of inputPattern, and also if the for the node
-	// that matches $n, the left-subtree-height minus the
-	// right-subtree-height = deltas[n].  The value IGNORE_
-	// DELTA will be an ignored value for matching.
-	static const int IGNORE_DELTA;
-
-	// Initializes a rotation.
-	// Pattern strings are provided using a tree notation:
-	// such as $0($1($2 $3) $4($5 0)) representing TreePattern
-	//                $0
-	//                 |
-	//       $1------------------$4
-	//        |                   |
-	//   $2-------$3         $5-------nullptr
-	// The above TreePattern will be translated by this constructor into
-	// the TreePattern described earlier.  The heightDeltas vector specifies
-	// that for the node that matches $i, the left-subtree-height minus
-	// right-subtree-height should be deltas[i].  The value IGNORE_DELTA
-	// for an entry of heightDeltas will be an ignored value for matching.
-	//
-	// Note that the nodes $0, $1, etc must be enumerated in pre-order.
-	// that is to say:
-	//   - $0 must be the first pre-order node (the root).
-	//   - $1 must be the second pre-order node
-	// and so on.
-	//
-	// Note also that leaf-nodes of inPattern must also be leaf-nodes of
-	// outPattern.  However non-leaf nodes of an inPattern could become
-	// a leaf-node of the outPattern (e.g. Sequence.cpp has pattern RR-a,
-	// where non-leaf node $0 of inPattern becomes a leaf-node in outPattern).
-	void init(const string& rotName,
-			  const string& inPattern,
-		      const vector<int>& heightDeltas,
-		      const string& outPattern);
-
-	// Applies the rotation if the inputPattern matches, and the
-	// indicated unbalancedNode is unbalanced as specified.  If
-	// the input pattern matched and the rotation was applied,
-	// the method returns true.  The out-value of pElt is the
-	// new root if the rotation was applied, and unchanged
-	// otherwise.
-	bool rotate(Sequence& seq, Sequence::Element*& pElt);
+	// Applies the rotation given by Patterns at pElt, and returns the
+	// new root of the subtree.  The parent of pElt is relinked to the
+	// new root.  The heights, weights and widths of the nodes in the
+	// subtree are fixed up, but not those of the ancestors.  Their
+	// aggregates are recomputed only if hasAggregate.
+	template <class Patterns>
+	Sequence::Element* rotate(Sequence::Element* pElt, bool hasAggregate);
 
 	// Whether this rotation was ever used.
 	bool isUsed() const;
@@ -135,28 +211,134 @@ public:
 	string getName() const;
 
 private:
-	// The name of the rotation
-	string name = "";
+	// The input and output TreePatterns of a Patterns class.
+	template <class Patterns>
+	struct CompiledPatterns
+	{
+		static constexpr TreePattern input = buildTreePattern(Patterns::input);
+		static constexpr TreePattern output = buildTreePattern(Patterns::output);
 
-	// Input and output patterns
-	TreePattern inputPattern;
-	TreePattern outputPattern;
+		static_assert(input.root == 0, "$0 must be the root of the input pattern");
+		static_assert(input.count == output.count,
+				      "Input and output patterns must have the same nodes");
+	};
 
-	// These the height delta of the individual inputPattern
-	// nodes.  An input pattern matches if the tree has the
-	// shape of inputPattern, and also if the for the node
-	// that matches $n, the left-subtree-height minus the
-	// right-subtree-height = deltas[n].  The value IGNORE_
-	// DELTA will be an ignored value for matching.
-	vector<int> deltas;
+	// Calls visit(std::integral_constant<IndexType, i>()) for each i
+	// of the sequence, so that the body of visit is expanded once for
+	// each node of a pattern.
+	template <class Visit, IndexType... Indices>
+	static void forEachNode(Visit visit,
+			                std::integer_sequence<IndexType, Indices...>)
+	{
+		(visit(std::integral_constant<IndexType, Indices>()), ...);
+	}
 
-	// Postorder traversal of output pattern.  These are the
-	// indices that need to be fixed up in outputPattern
-	// to compute new heights.
-	vector<IndexType> heightFixupIndices;
+	// The name of the rotation
+	string name = "";
 
 	// Whether this rotation was ever matched.
 	bool isMatched = false;
 };
 
 
+template <class Patterns>
+Sequence::Element* Rotation::rotate(Sequence::Element* pElt, bool hasAggregate)
+{
+	using Compiled = CompiledPatterns<Patterns>;
+	constexpr IndexType count = Compiled::input.count;
+	constexpr IndexType NoChild = TreePattern::NoChild;
+
+	// Original parent of the root of the pattern
+	Sequence::Element* pOriginalParent = pElt->m_parent;
+	bool wasLeftChild = (pOriginalParent != nullptr) &&
+			            (pOriginalParent->m_left == pElt);
+
+	// The matched Elements of the pattern, and their own widths.
+	Sequence::Element* nodes[count];
+	IndexType widths[count];
+
+	// First populate the nodes.  The input pattern nodes are numbered
+	// in pre-order, so nodes[i] is known before its children are.
+	nodes[0] = pElt;
+	forEachNode([&](auto node) {
+		constexpr IndexType i = decltype(node)::value;
+		constexpr IndexType left = Compiled::input.left[i];
+		constexpr IndexType right = Compiled::input.right[i];
+
+		if constexpr (left != NoChild) {
+			nodes[left] = nodes[i]->m_left;
+		}
+
+		if constexpr (right != NoChild) {
+			nodes[right] = nodes[i]->m_right;
+		}
+
+		// The widths are needed before the children change.
+		widths[i] = (nodes[i] == nullptr) ? 0 : nodes[i]->getWidth();
+	}, std::make_integer_sequence<IndexType, count>());
+
+	// Mark the matched flag
+	isMatched = true;
+
+	// Now set the new children based on the output pattern, and fix up
+	// the heights, weights and widths bottom-up, in post-order.  A node
+	// that is a leaf in the input pattern and also a leaf in the output
+	// pattern is not rotated ... no children of such a node should change,
+	// and its attributes are those of a subtree outside the pattern.
+	forEachNode([&](auto position) {
+		constexpr IndexType i =
+				Compiled::output.postOrder[decltype(position)::value];
+		constexpr IndexType left = Compiled::output.left[i];
+		constexpr IndexType right = Compiled::output.right[i];
+
+		if constexpr (!(Compiled::input.isLeaf(i) &&
+				        Compiled::output.isLeaf(i))) {
+			Sequence::Element* pRover = nodes[i];
+			pRover->m_height = 0;
+			pRover->m_weight = 1;
+			pRover->m_cumWidth = widths[i];
+
+			pRover->m_left = nullptr;
+			if constexpr (left != NoChild) {
+				Sequence::Element* pChild = nodes[left];
+				pRover->m_left = pChild;
+				if (pChild != nullptr) {
+					pChild->m_parent = pRover;
+					pRover->m_height = pChild->m_height + 1;
+					pRover->m_weight += pChild->m_weight;
+					pRover->m_cumWidth += pChild->m_cumWidth;
+				}
+			}
+
+			pRover->m_right = nullptr;
+			if constexpr (right != NoChild) {
+				Sequence::Element* pChild = nodes[right];
+				pRover->m_right = pChild;
+				if (pChild != nullptr) {
+					pChild->m_parent = pRover;
+					pRover->m_height = std::max(pRover->m_height,
+							                    pChild->m_height + 1);
+					pRover->m_weight += pChild->m_weight;
+					pRover->m_cumWidth += pChild->m_cumWidth;
+				}
+			}
+
+			if (hasAggregate) {
+				pRover->updateAggregate();
+			}
+		}
+	}, std::make_integer_sequence<IndexType, Compiled::output.postOrderCount>());
+
+	// Fixup the original parent.
+	Sequence::Element* pRoot = nodes[Compiled::output.root];
+	pRoot->m_parent = pOriginalParent;
+	if (pOriginalParent != nullptr) {
+		if (wasLeftChild) {
+			pOriginalParent->m_left = pRoot;
+		} else {
+			pOriginalParent->m_right = pRoot;
+		}
+	}
+
+	return pRoot;
+}
@@ -10,7 +10,12 @@
 #include <string>
 #include <vector>
 #include <exception>
+#include <stdexcept>
 #include <functional>
+#include <iterator>
+#include <cstddef>
+#include <utility>
+#include <cstdint>
 
 #pragma once
 
@@ -19,8 +24,15 @@ using namespace std;
 // The Elements of a sequence are in zero-based indices.
 typedef size_t IndexType;
 
-// Forward declaration
+// Forward declarations
 class Rotation;
+class ElementPool;
+
+template <class ElementType, class Aggregate, IndexType SmallCapacity>
+class GenericSequence;
+
+template <class ElementType>
+class FrozenSequence;
 
 
 // The class Sequence is the base class of an efficient
@@ -28,6 +40,13 @@ class Rotation;
 // each of which can be accessed by its index in the sequence.
 // It is possible to insert and delete elements in the sequence
 // and efficiently maintain their indices.
+//
+// The lookups are const, but they may write to the tree: the finger
+// (see setFingerEnabled) records the element found, and the pending
+// range width updates and reversals (see rangeAddWidth) are pushed down
+// the paths descended and walked.  So concurrent lookups on a const
+// Sequence are safe only while the finger is disabled and there are no
+// pending updates (see flushUpdates).
 
 class Sequence
 {
@@ -68,8 +87,23 @@ public:
 		}
 
 		// The width of an Element can be queried.  The width
-		// must be set through Sequence::setWidth().
+		// must be set through Sequence::setWidth().  After a range
+		// width update (see Sequence::rangeAddWidth), this is current
+		// only for an element that has been handed out since, by a
+		// lookup or a traversal, as those push the update down its
+		// path; Sequence::getWidth() is always current.
 		IndexType getWidth() const;
+
+	protected:
+		// This is called by the Sequence whenever the subtree rooted
+		// by this Element has changed, after its children are up to
+		// date, if the aggregates of the sequence are enabled (see
+		// Sequence::setAggregateEnabled).  Subclasses that keep an
+		// aggregate over their subtree recompute it here.  By default
+		// there is no aggregate.
+		virtual void updateAggregate()
+		{}
+
 	private:
 		Element* m_parent = nullptr;
 		Element* m_left = nullptr;
@@ -81,8 +115,20 @@ public:
 		//    - Weight (number of nodes) in T
 		//    - Cumulative width of all the nodes in T
 
-		// Maximum distance to a leaf node of subtree T
-		IndexType m_height = 0;
+		// Maximum distance to a leaf node of subtree T.  This fits
+		// in 32 bits, so that the tag kind below shares its word.
+		uint32_t m_height = 0;
+
+		// A range width update of all the nodes of T that is pending,
+		// i.e. it has been applied to m_cumWidth of this node but not
+		// to its children yet.  The kind is a Sequence::WidthTag.
+		unsigned char m_tagKind = 0;
+
+		// A pending reversal of T.  The children of this node have
+		// been swapped, but those of its descendants not yet.
+		bool m_isReversed = false;
+
+		IndexType m_tagWidth = 0;
 
 		// Number of nodes in subtree T including this one itself.
 		IndexType m_weight = 0;
@@ -92,20 +138,208 @@ public:
 
 		friend class Sequence;
 		friend class Rotation;
+
+		template <class ElementType, class Aggregate, IndexType SmallCapacity>
+		friend class GenericSequence;
+	};
+
+	// An Iterator visits the Elements in order.  It is a bidirectional
+	// iterator.  Each step follows the parent and child pointers, which
+	// is amortized O(1), and needs neither recursion nor a stack.  An
+	// Iterator remains valid as long as its element is in the sequence.
+	class Iterator
+	{
+	public:
+		typedef std::bidirectional_iterator_tag iterator_category;
+		typedef Element* value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef Element* const* pointer;
+		typedef Element* const& reference;
+
+		Iterator()
+		{}
+
+		Iterator(const Sequence* pSeq, Element* pElt)
+		: m_pSeq(pSeq), m_pElt(pElt)
+		{}
+
+		Element* const& operator*() const
+		{
+			return m_pElt;
+		}
+
+		Iterator& operator++()
+		{
+			m_pElt = successor(m_pElt);
+			return *this;
+		}
+
+		Iterator operator++(int)
+		{
+			Iterator old = *this;
+			m_pElt = successor(m_pElt);
+			return old;
+		}
+
+		// Decrementing end() gives the last element.
+		Iterator& operator--()
+		{
+			if (m_pElt == nullptr) {
+				m_pElt = m_pSeq->getLast();
+			} else {
+				m_pElt = predecessor(m_pElt);
+			}
+			return *this;
+		}
+
+		Iterator operator--(int)
+		{
+			Iterator old = *this;
+			--(*this);
+			return old;
+		}
+
+		bool operator==(const Iterator& that) const
+		{
+			return m_pElt == that.m_pElt;
+		}
+
+		bool operator!=(const Iterator& that) const
+		{
+			return m_pElt != that.m_pElt;
+		}
+
+	private:
+		const Sequence* m_pSeq = nullptr;
+
+		// The current element, or nullptr at the end.
+		Element* m_pElt = nullptr;
+	};
+
+	// A Cursor is a position between two elements of a sequence, at
+	// which a burst of edits can be made.  The edits are kept in a gap
+	// buffer of the elements the cursor has passed over or inserted, and
+	// the tree is not changed until commit(), which replaces the range
+	// of elements passed over with the buffer in O(k + log n) for k
+	// elements.  Each other operation takes amortized O(1).  Until then,
+	// the sequence itself must not be changed, and lookups in it do not
+	// see the edits.  The destructor commits, but as it cannot throw, a
+	// commit that fails there is dropped; call commit() explicitly to
+	// see the error.
+	class Cursor
+	{
+	public:
+		// A cursor before the element at index, or at the end if index
+		// is the length.
+		Cursor(Sequence& seq, IndexType index);
+
+		Cursor(const Cursor&) = delete;
+		Cursor& operator=(const Cursor&) = delete;
+
+		~Cursor();
+
+		// The element after the cursor, or nullptr at the end.
+		Element* get();
+
+		// The index of the element after the cursor, counting the edits.
+		IndexType getIndex() const;
+
+		// To move the cursor over the next (or previous) element.  These
+		// return false at the end (or beginning) of the sequence.
+		bool next();
+		bool prev();
+
+		// To insert an element before the cursor, i.e. after the elements
+		// already inserted.  The last defaulted parameter provides the
+		// width of the new element.
+		void insertBefore(Element* pNewElt, IndexType width = 0);
+
+		// To remove the element after the cursor.  The element is
+		// destroyed on commit().  An exception is thrown at the end.
+		void erase();
+
+		// To change the width of the element after the cursor.  An
+		// exception is thrown at the end.
+		void setWidth(IndexType width);
+
+		// Applies the edits to the sequence.  The cursor stays at the
+		// same position.  If this throws, the sequence is unchanged.
+		void commit();
+
+	private:
+		Sequence& m_seq;
+
+		// The index in the sequence of the element after the cursor,
+		// when the cursor was placed or last committed.
+		IndexType m_start;
+
+		// The number of elements before and after m_start that have been
+		// taken into the gap buffer, and the nearest elements that have
+		// not.
+		IndexType m_takenBefore = 0;
+		IndexType m_takenAfter = 0;
+		Element* m_pLeft = nullptr;
+		Element* m_pRight = nullptr;
+
+		// The elements before the cursor in order, and those after it
+		// in reverse order, with their widths.
+		vector<std::pair<Element*, IndexType>> m_before;
+		vector<std::pair<Element*, IndexType>> m_after;
+
+		// The elements erased since the last commit.
+		vector<Element*> m_erased;
+
+		// Whether any element was inserted, erased or changed in width
+		// since the last commit.
+		bool m_isEdited = false;
+
+		// Places the cursor at m_start, with an empty gap buffer.
+		void reset();
+
+		// Takes the next element of the tree after the gap buffer into
+		// it.  Returns false at the end.
+		bool takeAfter();
 	};
 
 	// Constructor
 	Sequence();
 
+	// Move constructor.  The elements of that are moved into this
+	// sequence, and that is left empty.
+	Sequence(Sequence&& that);
+
+	// Sequences own their elements, and are not copied.
+	Sequence(const Sequence&) = delete;
+	Sequence& operator=(const Sequence&) = delete;
+
 	// Virtual destructor
 	virtual ~Sequence();
 
 	// Destroys all elements of the sequence, so it can be reused.
 	void clear();
 
+	// Elements are by default allocated by clients with new, and
+	// the Sequence deletes them when they are removed.  If an
+	// ElementPool is set, elements are instead expected to be
+	// created in slots of that pool (see ElementPool::create), and
+	// the Sequence destroys them into the pool.  The pool can only
+	// be set or changed while the sequence is empty.
+	void setElementPool(ElementPool* pPool);
+
+	// The ElementPool, or nullptr if elements are deleted.
+	ElementPool* getElementPool() const;
+
+	// If the Elements keep an aggregate over their subtrees (see
+	// Element::updateAggregate), it must be enabled, so that the
+	// Sequence calls updateAggregate() on the nodes that change.
+	// Otherwise that virtual call is not made at all.  This can only be
+	// set while the sequence is empty.  It is disabled by default.
+	void setAggregateEnabled(bool isEnabled);
+	bool isAggregateEnabled() const;
+
 	// Current length of the sequence.  This is one more than the last
 	// index.  Initial length of the sequence is zero.
-	IndexType getLength();
+	IndexType getLength() const;
 
 	// To insert an element, and provide a width.  If pBeforeElt is
 	// nullptr then pNewElt is inserted at the end (appended).  If
@@ -125,12 +359,89 @@ public:
 	// width of the new element.
 	void append(Element* pNewElt, IndexType width = 0);
 
+	// To build the sequence from a range of Element pointers in O(n).
+	// Any existing elements are destroyed first.  The elements of the
+	// range must not be in any sequence.  widthOf(pElt) provides the
+	// width of each element.  The resulting tree is perfectly balanced.
+	template <class Iterator, class WidthOf>
+	void build(Iterator first, Iterator last, WidthOf widthOf)
+	{
+		clear();
+
+		vector<Element*> elts;
+		for (; first != last; ++first) {
+			Element* pElt = *first;
+
+			// Until the tree is built, m_cumWidth holds the width of
+			// the element itself.
+			pElt->m_cumWidth = widthOf(pElt);
+			elts.push_back(pElt);
+		}
+
+		m_root = buildSubtree(elts.data(), elts.size());
+		if (m_root != nullptr) {
+			m_root->m_parent = nullptr;
+		}
+	}
+
+	// To build the sequence from a range of Element pointers in O(n),
+	// with all widths zero.
+	template <class Iterator>
+	void build(Iterator first, Iterator last)
+	{
+		build(first, last, [](const Element*)->IndexType { return 0; });
+	}
+
 	// To remove an element from the sequence.  The element is destroyed.
+	// The other elements are relinked but not copied, so pointers to
+	// them remain valid.
 	void remove(Element* pElt);
 
 	// To remove an element from the sequence.  The element is destroyed.
 	void remove(IndexType index);
 
+	// An edit of a batch (see applyEdits).
+	struct Edit
+	{
+		// The index, in the sequence as left by the earlier edits of the
+		// batch.
+		IndexType m_index;
+		bool m_isInsert;
+
+		// For an insertion, the new element and its width.
+		Element* m_pElt = nullptr;
+		IndexType m_width = 0;
+	};
+
+	// To apply a batch of edits, with the same result as applying them
+	// one by one with insertAtIndex and remove.  The index shifts are
+	// resolved first, on a small sequence of pieces rather than on the
+	// tree, which gives the original index of each removed element and
+	// of the element before which each new one goes.  The edits are
+	// resolved in blocks of EditBlock, in O(m log m) for m edits, and
+	// each block is composed with the previous ones in time linear in
+	// the number of pieces.  Then a batch that is large relative to the
+	// sequence is merged with the elements in one in-order walk, and the
+	// tree is rebuilt, in O(n + m).  A smaller one is applied in one descent of
+	// the subtrees that hold edits: each node on the paths to them is
+	// detached, its subtrees are edited, and it is joined with them
+	// again, so that it is rebalanced once, bottom-up.  This takes
+	// O(m log(n/m + 1)) on the tree.  If an index is invalid, an
+	// exception is thrown and the sequence is unchanged.
+	void applyEdits(const vector<Edit>& edits);
+
+	// To split the sequence at a particular (zero-based) index.  Valid
+	// indices are from zero to length().  This sequence keeps the
+	// elements before the index, and the elements from the index
+	// onwards are returned in a new sequence, which uses the same
+	// ElementPool.  This takes O(log n).
+	Sequence split(IndexType atIndex);
+
+	// To append all the elements of that sequence to this one, in
+	// O(log n).  That sequence is left empty.  Both sequences must use
+	// the same ElementPool.
+	void concat(Sequence&& that);
+
 	// To replace an element at a particular (zero-based) index.  Valid
 	// indices are from zero to length()-1.  Note that this method takes
 	// an Element by reference, and its contents are copied into the
@@ -143,6 +454,47 @@ public:
 	// specified by this method.
 	void setWidth(Element* pElt, IndexType width);
 
+	// To add delta to the widths of the elements at indices from,
+	// from+1, ..., to-1, or to set them all to width, in O(log n).
+	// The subtrees that are entirely in the range are tagged with the
+	// update, rather than visited, and the tags are pushed down to the
+	// children as later operations descend through them.  No width may
+	// become negative, which is not checked.  The aggregates of the
+	// Elements (see updateAggregates) are not recomputed, so these are
+	// only for sequences whose Elements keep no aggregate of the
+	// widths.  An exception is thrown unless from <= to <= length().
+	void rangeAddWidth(IndexType from, IndexType to, long delta);
+	void rangeSetWidth(IndexType from, IndexType to, IndexType width);
+
+	// Pushes all the pending range width updates and reversals down to
+	// the elements, in O(n).  Lookups push the updates on the path they
+	// descend, and traversals (begin(), visitRange() etc.) on the paths
+	// they walk, so this is needed only before lookups from concurrent
+	// readers, which otherwise would write to the tree.
+	void flushUpdates() const;
+
+	// To reverse the order of the elements at indices from, from+1, ...,
+	// to-1, in O(log n).  The range is split out of the tree, and the
+	// subtree of the range is flagged as reversed rather than rebuilt.
+	// As for the range width updates, the flags are pushed down as
+	// later operations descend through them, and the aggregates of the
+	// Elements are not recomputed.  An exception is thrown unless
+	// from <= to <= length().
+	void reverseRange(IndexType from, IndexType to);
+
+	// To move the elements at indices from, from+1, ..., to-1 to index
+	// dest, by split and concat in O(log n).  dest is an index in the
+	// sequence without the range, so that the first moved element then
+	// has index dest.  The elements are relinked but not copied, so
+	// pointers to them remain valid.  An exception is thrown unless
+	// from <= to <= length() and dest <= length() - (to - from).
+	void moveRange(IndexType from, IndexType to, IndexType dest);
+
+	// If the aggregates are enabled, this must be called after the
+	// contents of pElt have changed, to update the aggregates of pElt
+	// and its ancestors.  Otherwise it does nothing.
+	void updateAggregates(Element* pElt);
+
 	// The width of an Element can be queried.
 	IndexType getWidth(const Element* pElt) const;
 
@@ -156,13 +508,118 @@ public:
 	// its width.  This gets the element whose extent spans the given offset.
 	Element* getElementAtOffset(IndexType offset) const;
 
+	// To get the elements at many indices, or spanning many offsets, at
+	// once.  elts[i] is set to the element for targets[i], or to nullptr
+	// if there is none.  The targets must be in ascending order, or an
+	// exception is thrown.  Each lookup starts from the element found by
+	// the one before, as from the finger (see setFingerEnabled), so that
+	// k lookups that are close together take O(k + log n).
+	void getElements(const vector<IndexType>& indices, vector<Element*>& elts) const;
+	void getElementsAtOffsets(const vector<IndexType>& offsets,
+			                  vector<Element*>& elts) const;
+
+	// As getElements and getElementsAtOffsets, for targets in any order.
+	// Groups of lookups descend from the root together, a level at a
+	// time, with the nodes of the next level prefetched, so that their
+	// cache misses overlap.  This is for lookups that are far apart.
+	void getElementsInterleaved(const vector<IndexType>& indices,
+			                    vector<Element*>& elts) const;
+	void getElementsAtOffsetsInterleaved(const vector<IndexType>& offsets,
+			                             vector<Element*>& elts) const;
+
 	// To get the index of the element
 	IndexType getIndex(Element* pElt) const;
 
+	// To compare the positions of two elements of the sequence.  This is
+	// negative if pA is before pB, zero if they are the same element, and
+	// positive if pA is after pB.  Both climb only to their lowest common
+	// ancestor, which is found from the heights of the nodes, since an
+	// ancestor is always higher.  So elements that are close together
+	// are compared faster than by their indices.
+	int comparePositions(const Element* pA, const Element* pB) const;
+
+	// To sort elements of the sequence by their positions.  The index of
+	// each is found once, so this takes O(k log n + k log k) for k
+	// elements, which for many elements is faster than sorting with
+	// comparePositions.
+	void sortByPosition(vector<Element*>& elts) const;
+
+	// The finger remembers the element last found by getElement() or
+	// getElementAtOffset(), with its index and start offset.  A lookup
+	// then climbs from the finger to the lowest ancestor that spans the
+	// index or offset, and descends from there, rather than from the
+	// root.  This takes time proportional to the height of that
+	// ancestor, which is O(log n) in the worst case, e.g. for neighbours
+	// on either side of the root, but amortized O(1) for a sequential
+	// scan through the index API, so that it is nearly as fast as an
+	// iterator.  Any insertion, removal or change of width drops the
+	// finger.  It is disabled by default.  As the finger is written by
+	// each lookup, it must be disabled for concurrent readers.
+	void setFingerEnabled(bool isEnabled);
+	bool isFingerEnabled() const;
+
+	// Iterators over the elements in order.  end() is past the last
+	// element.
+	Iterator begin() const;
+	Iterator end() const;
+
+	// An iterator at a particular (zero-based) index, in O(log n).  If
+	// the index is length() or more, this is end().
+	Iterator iteratorAt(IndexType index) const;
+
+	// An iterator at the element whose extent spans the given offset,
+	// in O(log n).  If there is no such element, this is end().
+	Iterator iteratorAtOffset(IndexType offset) const;
+
+	// The first and last elements, or nullptr if the sequence is empty.
+	Element* getFirst() const;
+	Element* getLast() const;
+
+	// The elements next to pElt in the sequence, or nullptr at either
+	// end.  These are amortized O(1) over a traversal.  They push the
+	// pending updates down the subtree they descend into, so they are
+	// valid while updates are pending (see rangeAddWidth and
+	// reverseRange) as long as the path of pElt is up to date, as it is
+	// for an element handed out by a lookup or a traversal since the
+	// last update.
+	static Element* successor(const Element* pElt);
+	static Element* predecessor(const Element* pElt);
+
 	// To visit all the nodes in order.
 	void visitInOrder
 	        (std::function<void(const Element* pElt)> visitElt) const;
 
+	// To visit the elements at indices from, from+1, ..., to-1 in
+	// order.  The tree is descended once, to the element at from, and
+	// then walked in order, so this takes O(log n + k) for k elements.
+	// An exception is thrown unless from <= to <= length().
+	void visitRange
+	        (IndexType from, IndexType to,
+	         std::function<void(const Element* pElt)> visitElt) const;
+
+	// To visit, in order, the elements whose extents overlap the offsets
+	// [fromOffset, toOffset).  An element of zero width is visited if
+	// its start offset is in that range.  This takes O(log n + k) for
+	// k elements.
+	void visitOffsetRange
+	        (IndexType fromOffset, IndexType toOffset,
+	         std::function<void(const Element* pElt)> visitElt) const;
+
+	// To split the sequence into chunks of chunkLength consecutive
+	// elements (the last may be shorter), for visiting them in parallel.
+	// The first element of each chunk is found by descending on the
+	// subtree weights, and put in firsts in order, so this takes
+	// O((n / chunkLength) log n).  The finger is neither used nor moved,
+	// so the chunks may then be walked with successor() by concurrent
+	// readers.  As those readers must not write to the tree, an
+	// exception is thrown if the finger is enabled.
+	void splitIntoChunks(IndexType chunkLength, vector<Element*>& firsts) const;
+
+	// To make an immutable copy of the sequence that is laid out for
+	// lookups (see FrozenSequence), in O(n).  The copy holds pointers to
+	// the elements, which must stay in the sequence while it is used.
+	FrozenSequence<Element*> freeze() const;
+
 	// For printing the sequence
 	void print() const;
 
@@ -190,20 +647,219 @@ public:
 private:
 	Element* m_root;
 
-	// Rebalance at pElt or some ancestor of it which is unbalanced.
-	// Out value is the newly rebalanced root.
-	void rebalance(Element*& pElt);
+	// If non-null, the pool in which the elements are allocated.
+	ElementPool* m_pPool = nullptr;
+
+	// Whether updateAggregate() is called on the nodes that change.
+	bool m_hasAggregate = false;
+
+	// Recomputes the aggregate of pElt, if the aggregates are enabled.
+	void updateAggregate(Element* pElt) const
+	{
+		if (m_hasAggregate) {
+			pElt->updateAggregate();
+		}
+	}
+
+	// applyEdits rebuilds the tree if the number of edits times this
+	// is at least the length.
+	static constexpr IndexType RebuildRatio = 4;
+
+	// The number of edits that applyEdits resolves at a time.
+	static constexpr size_t EditBlock = 16384;
+
+	// A run of m_count elements of a sequence, from index m_from, or one
+	// inserted element if m_pElt is non-null.
+	struct EditRun
+	{
+		IndexType m_from;
+		IndexType m_count;
+		Element* m_pElt;
+	};
+
+	// The finger, if enabled and valid, and its index and start offset.
+	bool m_isFingerEnabled = false;
+	mutable Element* m_pFinger = nullptr;
+	mutable IndexType m_fingerIndex = 0;
+	mutable IndexType m_fingerOffset = 0;
+
+	// Drops the finger, after the sequence has changed.
+	void invalidateFinger();
+
+	// The kinds of pending range width update (see Element::m_tagKind).
+	enum WidthTag : unsigned char
+	{
+		NoTag, AddTag, SetTag
+	};
+
+	// Whether any node may have a pending range width update or
+	// reversal.  This is set by the range updates and reverseRange(),
+	// and cleared by flushUpdates().
+	mutable bool m_hasUpdates = false;
+
+	// Applies a range width update of the given kind to the indices
+	// [from, to) of the subtree at pElt, where from < to.
+	static void updateRange(Element* pElt, IndexType from, IndexType to,
+			                WidthTag kind, IndexType width);
+
+	// Applies a range width update to all the nodes of the subtree at
+	// pElt, which may be nullptr, by tagging it.
+	static void tagSubtree(Element* pElt, WidthTag kind, IndexType width);
+
+	// Reverses the subtree at pElt, which may be nullptr, by swapping
+	// its children and flagging it.
+	static void reverseSubtree(Element* pElt);
+
+	// Pushes the pending update and reversal of pElt, if any, to its
+	// children, so that the children are up to date.
+	static void pushDown(Element* pElt);
+
+	// Pushes the pending updates of the ancestors of pElt and of pElt
+	// itself down, from the root, so that the width of pElt, its
+	// children, and the widths of the subtrees on the path are up to
+	// date.
+	void pushPath(const Element* pElt) const;
+	static void pushPathFrom(Element* pElt);
+
+	static void flushSubtree(Element* pElt);
+
+	// The element at index target (or spanning offset target), starting
+	// from the finger if there is one, or from the root.
+	Element* findElement(IndexType target, bool isByOffset) const;
+
+	// Resolves the index shifts of a batch of checked edits, without
+	// changing the tree.  On return, removed has the original indices of
+	// the elements to remove, and inserted has the elements to insert,
+	// in order, each with its width in m_cumWidth.  anchors[i] is the
+	// original index of the element before which inserted[i] goes, or
+	// the length for the end.  The elements that the batch inserts and
+	// also removes are destroyed.
+	void resolveEdits(const vector<Edit>& edits, vector<IndexType>& removed,
+			          vector<IndexType>& anchors, vector<Element*>& inserted);
+
+	// Resolves the edits [pFirst, pLast) against a sequence of the given
+	// length, and appends the runs of the result to runs, in order.  The
+	// elements that the block inserts and also removes are appended to
+	// discarded.
+	static void resolveEditBlock(const Edit* pFirst, const Edit* pLast,
+			                     IndexType length, vector<EditRun>& runs,
+			                     vector<Element*>& discarded);
+
+	// Applies the resolved edits by rebuilding the tree.
+	void rebuildWithEdits(const vector<IndexType>& removed,
+			              const vector<IndexType>& anchors,
+			              const vector<Element*>& inserted);
+
+	// Applies the resolved edits [pRemovedFirst, pRemovedLast) and
+	// [pAnchorFirst, pAnchorLast), with the new elements from
+	// ppInserted, to the subtree at pElt, whose first element has index
+	// firstIndex, and returns the new root of the subtree.
+	Element* applyEditsToSubtree(Element* pElt, IndexType firstIndex,
+			                     const IndexType* pRemovedFirst,
+			                     const IndexType* pRemovedLast,
+			                     const IndexType* pAnchorFirst,
+			                     const IndexType* pAnchorLast,
+			                     Element** ppInserted);
+
+	// Sets ppElts[i] to the element at index pFirst[i] of the subtree at
+	// pElt, for the ascending indices [pFirst, pLast), or to nullptr if
+	// there is no such element.  The index of the first element of the
+	// subtree is firstIndex.  The subtree is descended once for all the
+	// indices.
+	static void collectElements(Element* pElt, IndexType firstIndex,
+			                    const IndexType* pFirst, const IndexType* pLast,
+			                    Element** ppElts);
+
+	// Finds the element at index target (or spanning offset target),
+	// from pElt and its index and start offset, by climbing to the lowest
+	// ancestor that spans the target and descending from there.  On
+	// return index and startOffset are those of the element found.
+	static Element* seek(Element* pElt, IndexType target, bool isByOffset,
+			             IndexType& index, IndexType& startOffset);
+
+	// The lookups of getElements etc.
+	void findSorted(const vector<IndexType>& targets, bool isByOffset,
+			        vector<Element*>& elts) const;
+	void findInterleaved(const vector<IndexType>& targets, bool isByOffset,
+			             vector<Element*>& elts) const;
+
+	// The number of lookups that findInterleaved does together.
+	static constexpr IndexType InterleavedLookups = 8;
+
+	// One step of descend().  Returns true if pElt is the element, and
+	// otherwise moves pElt to the child in which it is, or to nullptr.
+	static bool descendStep(Element*& pElt, IndexType target, bool isByOffset,
+			                IndexType& index, IndexType& startOffset);
+
+	// Descends from pElt to the element at index target (or spanning
+	// offset target).  On entry index and startOffset are those of the
+	// first element of the subtree at pElt, and on return those of the
+	// element found.
+	static Element* descend(Element* pElt, IndexType target, bool isByOffset,
+			                IndexType& index, IndexType& startOffset);
+
+	// Destroys an element which is no longer in the sequence.
+	void destroyElement(Element* pElt);
+
+	// The first element that ends after the offset, or starts at or
+	// after it, together with its start offset.  Returns nullptr if
+	// there is none.
+	Element* getFirstOverlapping(IndexType offset, IndexType& startOffset) const;
+
+	// Empties the sequence without destroying its elements.  This is
+	// used when the storage of the elements is released in bulk by
+	// their ElementPool.
+	void forgetElements();
+
+	template <class ElementType, class Aggregate, IndexType SmallCapacity>
+	friend class GenericSequence;
 
 	void destroySubtree(Element* pElt);
 
-	void visitInOrder
-	        (const Element* pElt,
-			 std::function<void(const Element* pElt)> visitElt) const;
+	// Height of a subtree, where an empty subtree has height -1.
+	static long subtreeHeight(const Element* pElt);
+
+	// Sets m_height, m_weight and m_cumWidth of pElt from its children,
+	// given the width of pElt itself.
+	void setAttributes(Element* pElt, IndexType width) const;
+
+	// Rebalances the subtree at pElt if its height-delta is 2 or -2,
+	// and returns the root of the subtree.  The rotation is picked from
+	// the height-deltas of pElt and its descendants.  The parent of pElt
+	// is relinked to the new subtree root, but m_root is not changed.
+	Element* rebalanceSubtree(Element* pElt) const;
+
+	// Joins the subtrees pLeft and pRight, with pMid between them, into
+	// a balanced subtree and returns its root.  pMid must have no
+	// children, so that its m_cumWidth is its own width.  Any of pLeft
+	// and pRight can be nullptr.
+	Element* join(Element* pLeft, Element* pMid, Element* pRight) const;
+
+	// Joins the subtrees pLeft and pRight, either of which can be
+	// nullptr, into a balanced subtree and returns its root.
+	Element* join(Element* pLeft, Element* pRight) const;
+
+	// Splits the subtree at pElt so that pLeft has the first 'index'
+	// elements, and pRight has the rest.
+	void splitSubtree(Element* pElt, IndexType index,
+			          Element*& pLeft, Element*& pRight) const;
+
+	// Links ppElts[0..count-1] into a balanced subtree, in order, and
+	// returns its root.  On entry, m_cumWidth of each element is its
+	// own width.
+	Element* buildSubtree(Element** ppElts, IndexType count);
 
 	void printTree(const Element* pElt, IndexType depth) const;
 
-	// Updates m_height, m_weight and m_cumWidth attributes.
-	void updateAttributes(Element* pElt, IndexType width);
+	// Sets the attributes of a newly linked leaf pElt, and retraces
+	// its ancestors.
+	void retraceInsertion(Element* pElt, IndexType width);
+
+	// Adjusts the weights, widths and heights of pElt and its ancestors
+	// upto but excluding pUpto (nullptr for all of them), for an element
+	// of the given width that was inserted or removed below them, and
+	// rebalances them in the same pass.
+	void retrace(Element* pElt, Element* pUpto, bool isInsert, IndexType width);
 
 	void verify(Element* pElt) const;
 
@@ -0,0 +1,105 @@
+/*
+ * SequenceFile.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: R. Krishnaswamy
+ *
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include "inc/Sequence.h"
+
+using namespace std;
+
+// The binary file format of a sequence, written by GenericSequence::save,
+// and read by GenericSequence::load and by MappedSequence.  It is:
+//
+//    - A SequenceFileHeader, padded to 64 bytes.
+//    - The SequenceFileRecords of the elements, in index order.  Each
+//      holds the element, and the end offset of its extent, which is
+//      the start offset of the next element.
+//
+// The records are written as they are in memory, so that the file can
+// be mapped and used in place.  So ElementType must be trivially
+// copyable, and a file can only be read with the same ElementType, on a
+// machine of the same byte order.  The header records the size of a
+// record and the byte order, so that a mismatch is detected.
+
+struct alignas(64) SequenceFileHeader
+{
+	char m_magic[8];
+	uint32_t m_version;
+	uint32_t m_byteOrder;
+	uint64_t m_recordSize;
+	uint64_t m_count;
+};
+
+template <class ElementType>
+struct SequenceFileRecord
+{
+	IndexType m_end;
+	ElementType m_data;
+};
+
+class SequenceFile
+{
+public:
+	static constexpr uint32_t Version = 1;
+
+	// Reads back as ByteOrder only on a machine of the same byte order.
+	static constexpr uint32_t ByteOrder = 0x01020304;
+
+	// The number of records that are read or written at a time when
+	// streaming.
+	static constexpr IndexType BufferRecords = 4096;
+
+	template <class ElementType>
+	static SequenceFileHeader makeHeader(IndexType count)
+	{
+		static_assert(std::is_trivially_copyable<ElementType>::value,
+				      "A sequence file holds trivially copyable elements only");
+
+		SequenceFileHeader header;
+		std::memset(&header, 0, sizeof(header));
+		std::memcpy(header.m_magic, Magic, sizeof(header.m_magic));
+		header.m_version = Version;
+		header.m_byteOrder = ByteOrder;
+		header.m_recordSize = sizeof(SequenceFileRecord<ElementType>);
+		header.m_count = count;
+		return header;
+	}
+
+	// To check that a header is of a file of ElementType records.  If
+	// fileSize is not zero, it is also checked against the number of
+	// records.  An exception is thrown if the header is not valid.
+	template <class ElementType>
+	static void checkHeader(const SequenceFileHeader& header, IndexType fileSize = 0)
+	{
+		if ((std::memcmp(header.m_magic, Magic, sizeof(header.m_magic)) != 0) ||
+			(header.m_version != Version) ||
+			(header.m_byteOrder != ByteOrder)) {
+			throw std::runtime_error("Not a sequence file!");
+		}
+
+		if (header.m_recordSize != sizeof(SequenceFileRecord<ElementType>)) {
+			throw std::runtime_error("Sequence file is of another element type!");
+		}
+
+		// The count is checked against the room for records first, so
+		// that a corrupt count cannot overflow the size of the records.
+		if ((fileSize != 0) &&
+			((fileSize < sizeof(SequenceFileHeader)) ||
+			 (header.m_count > (fileSize - sizeof(SequenceFileHeader)) / header.m_recordSize) ||
+			 (fileSize != sizeof(SequenceFileHeader) + header.m_count * header.m_recordSize))) {
+			throw std::runtime_error("Sequence file is truncated!");
+		}
+	}
+
+private:
+	static constexpr char Magic[8] = "SEQFILE";
+};
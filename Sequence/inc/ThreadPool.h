@@ -0,0 +1,101 @@
+/*
+ * ThreadPool.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: R. Krishnaswamy
+ *
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "inc/Sequence.h"
+
+using namespace std;
+
+// A ThreadPool runs batches of tasks on a fixed set of threads.
+//
+//    - The tasks of a batch are numbered 0, 1, ..., taskCount-1, and are
+//      dealt out in contiguous blocks, one block per thread.
+//    - Each thread takes tasks from the front of its own block.  A
+//      thread that runs out steals from the back of another thread's
+//      block, so uneven tasks are balanced without a shared queue.
+//    - The thread that calls run() takes part as thread 0, and returns
+//      once every task of the batch has finished.
+//
+// Batches are run one at a time.  A task must not call run() on the
+// pool that runs it; if it does, the inner batch is run serially.
+class ThreadPool
+{
+public:
+	// Constructor.  threadCount includes the calling thread, so a pool
+	// of one thread runs everything serially.
+	explicit ThreadPool(IndexType threadCount = defaultThreadCount());
+
+	// Destructor.  The threads are stopped and joined.
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	IndexType getThreadCount() const
+	{
+		return m_queues.size();
+	}
+
+	// To call task(i) for every i in [0, taskCount), and wait for all
+	// of them.  If a task throws, the remaining tasks are still run,
+	// and the first exception is rethrown here.
+	void run(IndexType taskCount, const std::function<void(IndexType task)>& task);
+
+	// The pool shared by default, with a thread per hardware thread.
+	static ThreadPool& getDefault();
+
+	// The number of hardware threads, or 1 if that is not known.
+	static IndexType defaultThreadCount();
+
+private:
+	// The tasks not yet taken from a thread's block.
+	struct Queue
+	{
+		std::mutex m_mutex;
+		std::deque<IndexType> m_tasks;
+	};
+
+	void workerLoop(IndexType worker);
+
+	// To run tasks, own or stolen, until there are none left.
+	void drain(IndexType worker);
+
+	bool popOwn(IndexType worker, IndexType& task);
+	bool steal(IndexType worker, IndexType& task);
+	void execute(IndexType task);
+
+	vector<unique_ptr<Queue>> m_queues;
+	vector<std::thread> m_threads;
+
+	// Only one batch runs at a time.
+	std::mutex m_runMutex;
+
+	// Guards m_generation, m_isStopping and m_error.  A new batch bumps
+	// the generation, which wakes the workers.
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+	uint64_t m_generation = 0;
+	bool m_isStopping = false;
+	std::exception_ptr m_error;
+
+	// The task of the current batch, and the number of its tasks that
+	// have not yet finished.
+	const std::function<void(IndexType)>* m_pTask = nullptr;
+	std::atomic<IndexType> m_pending{0};
+};
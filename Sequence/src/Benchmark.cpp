@@ -0,0 +1,934 @@
+/*
+ * Benchmark.cpp
+ *  Created on: Oct 17, 2026
+ *      Author: R. Krishnaswamy
+ */
+#include "Benchmark.h"
+#include "TestUtilities.h"
+#include "inc/GenericSequence.h"
+#include "inc/CompactSequence.h"
+#include "inc/BTreeSequence.h"
+#include "inc/ThreadPool.h"
+#include "inc/PersistentSequence.h"
+#include "inc/ConcurrentSequence.h"
+#include "inc/CombiningSequence.h"
+#include "inc/MappedSequence.h"
+#include "inc/FrozenSequence.h"
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+// Insert and remove at random indices.  Each operation descends from the
+// root to find the index, and then makes one pass back up to the root to
+// fix up the attributes and rebalance.  Only the current tree is timed,
+// so this tracks it over time rather than comparing it with another.
+void benchmarkInsertRemove(size_t count)
+{
+	Sequence seq;
+	std::vector<IndexType> indices(count);
+
+	std::cout << "benchmarkInsertRemove: " << count << std::endl;
+
+	srand(1);
+	for (size_t i = 0; i < count; i++) {
+		indices[i] = rand() % (i + 1);
+	}
+
+	{
+		BenchmarkTimer timer("append", count);
+		for (size_t i = 0; i < count; i++) {
+			seq.append(new TestElement(i), 1);
+		}
+	}
+
+	{
+		BenchmarkTimer timer("insertAtIndex", count);
+		for (size_t i = 0; i < count; i++) {
+			seq.insertAtIndex(new TestElement(i), indices[i], 1);
+		}
+	}
+
+	{
+		BenchmarkTimer timer("remove", count);
+		for (size_t i = 0; i < count; i++) {
+			seq.remove(indices[count - 1 - i]);
+		}
+	}
+}
+
+
+// A small payload, so that the benchmark measures the node layout.
+struct BenchmarkValue
+{
+	BenchmarkValue(size_t value = 0)
+	: m_value(value)
+	{}
+
+	string image() const
+	{
+		return std::to_string(m_value);
+	}
+
+	size_t m_value;
+};
+
+
+// Compares the layouts of GenericSequence, CompactSequence and
+// BTreeSequence, for the same random insertions, lookups by index and
+// in-order scan.
+template <class SequenceType>
+void benchmarkLayout(const string& name, const std::vector<IndexType>& indices)
+{
+	SequenceType seq;
+	size_t count = indices.size();
+
+	{
+		BenchmarkTimer timer(name + " insertAtIndex", count);
+		for (size_t i = 0; i < count; i++) {
+			seq.insertAtIndex(i, indices[i], 1);
+		}
+	}
+
+	size_t sum = 0;
+	{
+		BenchmarkTimer timer(name + " operator[]", count);
+		for (size_t i = 0; i < count; i++) {
+			sum += seq[indices[i]].m_value;
+		}
+	}
+
+	{
+		BenchmarkTimer timer(name + " scan", count);
+		for (auto& value : seq) {
+			sum += value.m_value;
+		}
+	}
+
+	// Keeps the lookups from being optimized away.
+	std::cout << "  checksum: " << sum << std::endl;
+}
+
+
+void benchmarkLayouts(size_t count)
+{
+	std::vector<IndexType> indices(count);
+
+	std::cout << "benchmarkLayouts: " << count << std::endl;
+	std::cout << "  GenericElement size: "
+			  << sizeof(GenericSequence<BenchmarkValue>::GenericElement) << std::endl;
+	std::cout << "  CompactSequence node size: "
+			  << sizeof(CompactSequence<BenchmarkValue>::Node) << std::endl;
+
+	srand(1);
+	for (size_t i = 0; i < count; i++) {
+		indices[i] = rand() % (i + 1);
+	}
+
+	benchmarkLayout<GenericSequence<BenchmarkValue>>("GenericSequence", indices);
+	benchmarkLayout<CompactSequence<BenchmarkValue>>("CompactSequence", indices);
+	benchmarkLayout<BTreeSequence<BenchmarkValue>>("BTreeSequence", indices);
+}
+
+
+// Builds many short sequences, each of which is filled at random indices
+// and then read by index.  This compares the tree with the flat array of
+// a small sequence.
+template <class SequenceType>
+void benchmarkShort(const string& name, size_t sequenceCount, size_t length)
+{
+	size_t sum = 0;
+	{
+		BenchmarkTimer timer(name, sequenceCount*length);
+		for (size_t s = 0; s < sequenceCount; s++) {
+			SequenceType seq(std::pmr::get_default_resource(), length);
+			for (size_t i = 0; i < length; i++) {
+				seq.insertAtIndex(i, (i*7) % (i + 1), 1);
+			}
+
+			for (size_t i = 0; i < length; i++) {
+				sum += seq[i].m_value + seq.getElementAtOffset(i).m_value;
+			}
+		}
+	}
+
+	// Keeps the lookups from being optimized away.
+	std::cout << "  checksum: " << sum << std::endl;
+}
+
+
+void benchmarkSmallSequences(size_t sequenceCount)
+{
+	std::cout << "benchmarkSmallSequences: " << sequenceCount << std::endl;
+
+	benchmarkShort<GenericSequence<BenchmarkValue>>
+	        ("tree", sequenceCount, 16);
+	benchmarkShort<GenericSequence<BenchmarkValue, NoAggregate<BenchmarkValue>, 32>>
+	        ("flat array", sequenceCount, 16);
+}
+
+
+// Reads a sequence through the index and offset API in order, with and
+// without the finger.
+void benchmarkFinger(size_t count)
+{
+	Sequence seq;
+
+	std::cout << "benchmarkFinger: " << count << std::endl;
+
+	for (size_t i = 0; i < count; i++) {
+		seq.append(new TestElement(i), 2);
+	}
+
+	for (bool isEnabled : {false, true}) {
+		seq.setFingerEnabled(isEnabled);
+		string name = isEnabled ? "with finger" : "without finger";
+
+		size_t sum = 0;
+		{
+			BenchmarkTimer timer(name + " getElement", count);
+			for (size_t i = 0; i < count; i++) {
+				sum += ((TestElement*) seq.getElement(i))->getValue();
+			}
+		}
+
+		{
+			BenchmarkTimer timer(name + " getElementAtOffset", count);
+			for (size_t i = 0; i < count; i++) {
+				sum += ((TestElement*) seq.getElementAtOffset(2*i + 1))->getValue();
+			}
+		}
+
+		// Keeps the lookups from being optimized away.
+		std::cout << "  checksum: " << sum << std::endl;
+	}
+
+	size_t sum = 0;
+	{
+		BenchmarkTimer timer("iterator", count);
+		for (Sequence::Element* pElt : seq) {
+			sum += ((TestElement*) pElt)->getValue();
+		}
+	}
+	std::cout << "  checksum: " << sum << std::endl;
+}
+
+
+// Inserts and removes bursts of elements at random places, through
+// insertAtIndex and remove, and through a Cursor.
+void benchmarkCursor(size_t count, size_t burstCount, size_t burstLength)
+{
+	std::vector<IndexType> places(burstCount);
+
+	std::cout << "benchmarkCursor: " << count << std::endl;
+
+	srand(1);
+	for (size_t i = 0; i < burstCount; i++) {
+		places[i] = rand() % count;
+	}
+
+	GenericSequence<BenchmarkValue> seq;
+	for (size_t i = 0; i < count; i++) {
+		seq.append(i, 1);
+	}
+
+	{
+		BenchmarkTimer timer("insertAtIndex/remove", 2*burstCount*burstLength);
+		for (size_t b = 0; b < burstCount; b++) {
+			for (size_t i = 0; i < burstLength; i++) {
+				seq.insertAtIndex(i, places[b] + i, 1);
+			}
+
+			for (size_t i = 0; i < burstLength; i++) {
+				seq.remove(places[b]);
+			}
+		}
+	}
+
+	{
+		BenchmarkTimer timer("Cursor", 2*burstCount*burstLength);
+		for (size_t b = 0; b < burstCount; b++) {
+			GenericSequence<BenchmarkValue>::Cursor cursor(seq, places[b]);
+			for (size_t i = 0; i < burstLength; i++) {
+				cursor.insertBefore(i, 1);
+			}
+			cursor.commit();
+
+			for (size_t i = 0; i < burstLength; i++) {
+				cursor.prev();
+				cursor.erase();
+			}
+		}
+	}
+}
+
+
+// Applies batches of random edits from an EditOpVec one by one, and as
+// one batch.
+void benchmarkBatchEdits(size_t count, size_t batchSize)
+{
+	std::cout << "benchmarkBatchEdits: " << count << ", batch of "
+			  << batchSize << std::endl;
+
+	EditOpVec editOps;
+	srand(1);
+	size_t length = count;
+	for (size_t i = 0; i < batchSize; i++) {
+		bool isInsert = (rand() % 2 == 0);
+		EditOp editOp(rand() % (length + (isInsert ? 1 : 0)), isInsert);
+		editOp.m_value = i;
+		editOp.m_width = 1;
+		editOps.push_back(editOp);
+		length += isInsert ? 1 : -1;
+	}
+
+	for (bool isBatched : {false, true}) {
+		Sequence seq;
+		for (size_t i = 0; i < count; i++) {
+			seq.append(new TestElement(i), 1);
+		}
+
+		BenchmarkTimer timer(isBatched ? "execBatch" : "execDo", batchSize);
+		if (isBatched) {
+			editOps.execBatch(seq);
+		} else {
+			editOps.execDo(seq);
+		}
+	}
+}
+
+
+// Sums the values serially, and with parallelReduce on pools of
+// 1, 2, 4, ... threads, up to the number of hardware threads.
+void benchmarkParallel(size_t count)
+{
+	std::cout << "benchmarkParallel: " << count << std::endl;
+
+	GenericSequence<BenchmarkValue> seq;
+	for (size_t i = 0; i < count; i++) {
+		seq.append(i, 1);
+	}
+
+	size_t serialSum = 0;
+	{
+		BenchmarkTimer timer("visitInOrder", count);
+		seq.visitInOrder([&serialSum](const BenchmarkValue& value) {
+			serialSum += value.m_value;
+		});
+	}
+
+	IndexType maxThreads = ThreadPool::defaultThreadCount();
+	for (IndexType threads = 1; ; threads = std::min(2 * threads, maxThreads)) {
+		ThreadPool pool(threads);
+		size_t sum;
+		{
+			BenchmarkTimer timer("parallelReduce, " + std::to_string(threads) +
+					             " threads", count);
+			sum = seq.parallelReduce((size_t) 0,
+				[](size_t& result, const BenchmarkValue& value) {
+					result += value.m_value;
+				},
+				[](size_t left, size_t right) {
+					return left + right;
+				}, pool);
+		}
+
+		if (sum != serialSum) {
+			throw logic_error("Unexpected sum from parallelReduce");
+		}
+
+		if (threads == maxThreads) {
+			break;
+		}
+	}
+}
+
+
+// Inserts at random indices into a PersistentSequence, taking a snapshot
+// every snapshotInterval insertions, against a GenericSequence.  Each
+// insertion into the PersistentSequence copies the path to the root.
+void benchmarkPersistent(size_t count, size_t snapshotInterval)
+{
+	std::vector<IndexType> indices(count);
+
+	std::cout << "benchmarkPersistent: " << count << std::endl;
+
+	srand(1);
+	for (size_t i = 0; i < count; i++) {
+		indices[i] = rand() % (i + 1);
+	}
+
+	{
+		GenericSequence<BenchmarkValue> seq;
+		BenchmarkTimer timer("GenericSequence insertAtIndex", count);
+		for (size_t i = 0; i < count; i++) {
+			seq.insertAtIndex(i, indices[i], 1);
+		}
+	}
+
+	{
+		PersistentSequence<size_t> seq;
+		std::vector<PersistentSequence<size_t>> snapshots;
+		BenchmarkTimer timer("PersistentSequence insertAtIndex", count);
+		for (size_t i = 0; i < count; i++) {
+			seq.insertAtIndex(i, indices[i], 1);
+			if (i % snapshotInterval == 0) {
+				snapshots.push_back(seq.snapshot());
+			}
+		}
+	}
+}
+
+
+// Runs readerCount readers, each doing lookupCount random lookups, while
+// one writer inserts and removes an element every 10 us.  lookup(index)
+// and edit(index) are to be safe to call concurrently.
+template <class Lookup, class Edit>
+void runReaders(const string& name, size_t count, size_t readerCount,
+		        size_t lookupCount, Lookup lookup, Edit edit)
+{
+	std::atomic<bool> isDone(false);
+	std::thread writer([&isDone, &edit, count]() {
+		for (size_t i = 0; !isDone; i++) {
+			edit((i * 7919) % count);
+			std::this_thread::sleep_for(std::chrono::microseconds(10));
+		}
+	});
+
+	{
+		BenchmarkTimer timer(name + ", " + std::to_string(readerCount) + " readers",
+				             readerCount * lookupCount);
+		vector<std::thread> readers;
+		for (size_t r = 0; r < readerCount; r++) {
+			readers.emplace_back([&lookup, count, lookupCount, r]() {
+				size_t index = r;
+				for (size_t i = 0; i < lookupCount; i++) {
+					index = (index * 2654435761u + 1) % count;
+					lookup(index);
+				}
+			});
+		}
+
+		for (std::thread& reader : readers) {
+			reader.join();
+		}
+	}
+
+	isDone = true;
+	writer.join();
+}
+
+
+// Compares lock-free readers of a ConcurrentSequence with readers of a
+// GenericSequence behind a mutex, on 1, 2, 4, ... readers up to the
+// number of hardware threads.  The times are per lookup over all the
+// readers, so they fall as the readers scale.
+void benchmarkConcurrentReaders(size_t count, size_t lookupCount)
+{
+	std::cout << "benchmarkConcurrentReaders: " << count << std::endl;
+
+	ConcurrentSequence<size_t> concurrentSeq;
+	GenericSequence<BenchmarkValue> lockedSeq;
+	std::mutex mutex;
+	for (size_t i = 0; i < count; i++) {
+		concurrentSeq.append(i, 1);
+		lockedSeq.append(i, 1);
+	}
+
+	std::atomic<size_t> checksum(0);
+	IndexType maxReaders = ThreadPool::defaultThreadCount();
+	for (IndexType readers = 1; ; readers = std::min(2 * readers, maxReaders)) {
+		runReaders("ConcurrentSequence", count, readers, lookupCount,
+			[&](size_t index) {
+				checksum += concurrentSeq.get(index);
+			},
+			[&](size_t index) {
+				concurrentSeq.insertAtIndex(index, index, 1);
+				concurrentSeq.remove(index);
+			});
+
+		runReaders("GenericSequence with mutex", count, readers, lookupCount,
+			[&](size_t index) {
+				std::lock_guard<std::mutex> lock(mutex);
+				checksum += lockedSeq[index].m_value;
+			},
+			[&](size_t index) {
+				std::lock_guard<std::mutex> lock(mutex);
+				lockedSeq.insertAtIndex(index, index, 1);
+				lockedSeq.remove(index);
+			});
+
+		if (readers == maxReaders) {
+			break;
+		}
+	}
+}
+
+
+// Runs threadCount threads, which between them do opCount random
+// inserts and removes through edit(index).
+template <class Edit>
+void runWriters(const string& name, size_t count, size_t threadCount,
+		        size_t opCount, Edit edit)
+{
+	BenchmarkTimer timer(name + ", " + std::to_string(threadCount) + " threads", opCount);
+	vector<std::thread> threads;
+	for (size_t t = 0; t < threadCount; t++) {
+		threads.emplace_back([&edit, count, threadCount, opCount, t]() {
+			size_t index = t;
+			for (size_t i = 0; i < opCount / threadCount; i += 2) {
+				index = (index * 2654435761u + 1) % count;
+				edit(index);
+			}
+		});
+	}
+
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+}
+
+
+// Compares a CombiningSequence with a Sequence behind a std::mutex, with
+// 1 to 64 threads each inserting and removing elements.
+void benchmarkCombining(size_t count, size_t opCount)
+{
+	std::cout << "benchmarkCombining: " << count << std::endl;
+
+	Sequence seq;
+	for (size_t i = 0; i < count; i++) {
+		seq.insertAtIndex(new TestElement(i), i, 1);
+	}
+
+	CombiningSequence combining(seq);
+	std::mutex mutex;
+	for (size_t threads = 1; threads <= 64; threads *= 2) {
+		runWriters("Sequence with mutex", count, threads, opCount,
+			[&seq, &mutex](size_t index) {
+				std::lock_guard<std::mutex> lock(mutex);
+				seq.insertAtIndex(new TestElement(index), index, 1);
+				seq.remove(index);
+			});
+
+		IndexType batches = combining.getBatchCount();
+		IndexType combined = combining.getCombinedCount();
+		runWriters("CombiningSequence", count, threads, opCount,
+			[&combining](size_t index) {
+				combining.insertAtIndex(new TestElement(index), index, 1);
+				combining.remove(index);
+			});
+
+		std::cout << "    operations per batch: "
+				  << (double) (combining.getCombinedCount() - combined) /
+				     (combining.getBatchCount() - batches) << std::endl;
+	}
+}
+
+
+// Saves a sequence to a file, and restarts from it by load() and by
+// mapping it, against rebuilding it with appends.
+void benchmarkSequenceFile(size_t count)
+{
+	const string path = "benchmarkSequenceFile.seq";
+
+	std::cout << "benchmarkSequenceFile: " << count << std::endl;
+
+	GenericSequence<BenchmarkValue> seq;
+	{
+		BenchmarkTimer timer("append", count);
+		for (size_t i = 0; i < count; i++) {
+			seq.append(i, 1 + i % 3);
+		}
+	}
+
+	{
+		BenchmarkTimer timer("save", count);
+		seq.save(path);
+	}
+
+	{
+		GenericSequence<BenchmarkValue> loaded;
+		BenchmarkTimer timer("load", count);
+		loaded.load(path);
+	}
+
+	size_t sum = 0;
+	{
+		BenchmarkTimer timer("map and scan", count);
+		MappedSequence<BenchmarkValue> mapped(path);
+		for (const BenchmarkValue& value : mapped) {
+			sum += value.m_value;
+		}
+	}
+
+	std::remove(path.c_str());
+	if (sum != count * (count - 1) / 2) {
+		throw logic_error("Unexpected sum of mapped sequence");
+	}
+}
+
+
+// Reflows regions of regionLength consecutive elements to a new width,
+// each followed by a lookup by offset, with setWidth() on each element
+// and with one rangeSetWidth().
+void benchmarkRangeWidth(size_t count, size_t regionLength, size_t reflowCount)
+{
+	std::cout << "benchmarkRangeWidth: " << count << ", regions of "
+			  << regionLength << std::endl;
+
+	for (bool isRange : {false, true}) {
+		Sequence seq;
+		for (size_t i = 0; i < count; i++) {
+			seq.append(new TestElement(i), 1);
+		}
+
+		srand(1);
+		size_t found = 0;
+		BenchmarkTimer timer(isRange ? "rangeSetWidth" : "setWidth", reflowCount);
+		for (size_t i = 0; i < reflowCount; i++) {
+			size_t from = rand() % (count - regionLength);
+			size_t width = 1 + i % 4;
+			if (isRange) {
+				seq.rangeSetWidth(from, from + regionLength, width);
+			} else {
+				Sequence::Element* pElt = seq.getElement(from);
+				for (size_t k = 0; k < regionLength; k++) {
+					seq.setWidth(pElt, width);
+					pElt = Sequence::successor(pElt);
+				}
+			}
+
+			found += ((TestElement*) seq.getElementAtOffset(rand() % count))->getValue();
+		}
+
+		if (found == 0) {
+			std::cout << "  (no elements found)" << std::endl;
+		}
+	}
+}
+
+
+// Moves and reverses blocks of blockLength elements, by removing and
+// reinserting them one by one, and with moveRange() and reverseRange().
+void benchmarkReverseMove(size_t count, size_t blockLength, size_t blockCount)
+{
+	std::cout << "benchmarkReverseMove: " << count << ", blocks of "
+			  << blockLength << std::endl;
+
+	for (bool isRange : {false, true}) {
+		GenericSequence<BenchmarkValue> seq;
+		for (size_t i = 0; i < count; i++) {
+			seq.append(i, 1);
+		}
+
+		srand(1);
+		{
+			BenchmarkTimer timer(isRange ? "moveRange" : "move by element", blockCount);
+			for (size_t i = 0; i < blockCount; i++) {
+				size_t from = rand() % (count - blockLength);
+				size_t dest = rand() % (count - blockLength);
+				if (isRange) {
+					seq.moveRange(from, from + blockLength, dest);
+				} else {
+					vector<BenchmarkValue> block;
+					for (size_t k = 0; k < blockLength; k++) {
+						block.push_back(seq[from]);
+						seq.remove(from);
+					}
+					for (size_t k = 0; k < blockLength; k++) {
+						seq.insertAtIndex(block[k], dest + k, 1);
+					}
+				}
+			}
+		}
+
+		{
+			BenchmarkTimer timer(isRange ? "reverseRange" : "reverse by element", blockCount);
+			for (size_t i = 0; i < blockCount; i++) {
+				size_t from = rand() % (count - blockLength);
+				if (isRange) {
+					seq.reverseRange(from, from + blockLength);
+				} else {
+					for (size_t k = 0; k + 1 < blockLength; k++) {
+						BenchmarkValue value = seq[from + blockLength - 1];
+						seq.remove(from + blockLength - 1);
+						seq.insertAtIndex(value, from + k, 1);
+					}
+				}
+			}
+		}
+
+		// A short walk after each reversal pushes the pending reversals
+		// down the paths it walks only.
+		{
+			BenchmarkTimer timer(isRange ? "reverseRange and walk" : "walk", blockCount);
+			size_t walked = 0;
+			for (size_t i = 0; i < blockCount; i++) {
+				size_t from = rand() % (count - blockLength);
+				if (isRange) {
+					seq.reverseRange(from, from + blockLength);
+				}
+
+				auto it = seq.iteratorAt(from);
+				for (size_t k = 0; k < blockLength; k++, ++it) {
+					walked += it->m_value;
+				}
+			}
+
+			if (walked == 0) {
+				std::cout << "  (no elements walked)" << std::endl;
+			}
+		}
+
+		// The pending reversals are pushed down by the scan.
+		BenchmarkTimer timer(isRange ? "scan after reverseRange" : "scan", count);
+		size_t sum = 0;
+		for (const BenchmarkValue& value : seq) {
+			sum += value.m_value;
+		}
+
+		if (sum != count * (count - 1) / 2) {
+			throw logic_error("Unexpected sum after moves and reversals");
+		}
+	}
+}
+
+
+// Compares the positions of pairs of elements, by their indices and
+// with comparePositions(), for pairs at random and pairs of neighbours,
+// and sorts anchors at random positions.
+void benchmarkComparePositions(size_t count, size_t anchorCount)
+{
+	std::cout << "benchmarkComparePositions: " << count << std::endl;
+
+	Sequence seq;
+	vector<Sequence::Element*> elts;
+	for (size_t i = 0; i < count; i++) {
+		elts.push_back(new TestElement(i));
+		seq.append(elts.back(), 1);
+	}
+
+	srand(1);
+	vector<std::pair<Sequence::Element*, Sequence::Element*>> randomPairs;
+	vector<std::pair<Sequence::Element*, Sequence::Element*>> nearPairs;
+	for (size_t i = 0; i < count; i++) {
+		size_t k = rand() % (count - 1);
+		randomPairs.emplace_back(elts[k], elts[rand() % count]);
+		nearPairs.emplace_back(elts[k], elts[k + 1]);
+	}
+
+	for (auto* pPairs : {&randomPairs, &nearPairs}) {
+		const char* pKind = (pPairs == &randomPairs) ? "random" : "neighbours";
+		size_t before = 0;
+		{
+			BenchmarkTimer timer(string("getIndex, ") + pKind, count);
+			for (auto& pair : *pPairs) {
+				before += (seq.getIndex(pair.first) < seq.getIndex(pair.second));
+			}
+		}
+
+		{
+			BenchmarkTimer timer(string("comparePositions, ") + pKind, count);
+			for (auto& pair : *pPairs) {
+				before -= (seq.comparePositions(pair.first, pair.second) < 0);
+			}
+		}
+
+		if (before != 0) {
+			throw logic_error("Unexpected comparisons of positions");
+		}
+	}
+
+	vector<Sequence::Element*> anchors;
+	for (size_t i = 0; i < anchorCount; i++) {
+		anchors.push_back(elts[rand() % count]);
+	}
+
+	vector<Sequence::Element*> sorted = anchors;
+	{
+		BenchmarkTimer timer("sort with comparePositions", anchorCount);
+		std::sort(sorted.begin(), sorted.end(),
+			[&seq](const Sequence::Element* pA, const Sequence::Element* pB) {
+				return seq.comparePositions(pA, pB) < 0;
+			});
+	}
+
+	{
+		BenchmarkTimer timer("sortByPosition", anchorCount);
+		seq.sortByPosition(anchors);
+	}
+
+	if (anchors != sorted) {
+		throw logic_error("Unexpected order of sorted anchors");
+	}
+}
+
+
+// Looks up lookupCount elements by index, one by one and batched, for
+// dense sorted indices (every stride-th element from a random start),
+// and for random indices.
+void benchmarkBatchLookups(size_t count, size_t lookupCount, size_t stride)
+{
+	std::cout << "benchmarkBatchLookups: " << count << ", "
+			  << lookupCount << " lookups" << std::endl;
+
+	Sequence seq;
+	for (size_t i = 0; i < count; i++) {
+		seq.append(new TestElement(i), 1);
+	}
+
+	srand(1);
+	vector<IndexType> dense;
+	vector<IndexType> random;
+	size_t start = rand() % (count - lookupCount * stride);
+	for (size_t i = 0; i < lookupCount; i++) {
+		dense.push_back(start + i * stride);
+		random.push_back(rand() % count);
+	}
+
+	vector<IndexType> sortedRandom = random;
+	std::sort(sortedRandom.begin(), sortedRandom.end());
+
+	for (auto* pIndices : {&dense, &sortedRandom, &random}) {
+		string kind = (pIndices == &dense) ? "dense" :
+				      ((pIndices == &random) ? "random" : "sorted random");
+		vector<Sequence::Element*> elts(lookupCount);
+		size_t sum = 0;
+		{
+			BenchmarkTimer timer("getElement, " + kind, lookupCount);
+			for (size_t i = 0; i < lookupCount; i++) {
+				elts[i] = seq.getElement((*pIndices)[i]);
+			}
+		}
+		for (Sequence::Element* pElt : elts) {
+			sum += ((TestElement*) pElt)->getValue();
+		}
+
+		if (pIndices != &random) {
+			BenchmarkTimer timer("getElements, " + kind, lookupCount);
+			seq.getElements(*pIndices, elts);
+		}
+		for (Sequence::Element* pElt : elts) {
+			sum -= ((TestElement*) pElt)->getValue();
+		}
+
+		{
+			BenchmarkTimer timer("getElementsInterleaved, " + kind, lookupCount);
+			seq.getElementsInterleaved(*pIndices, elts);
+		}
+		for (Sequence::Element* pElt : elts) {
+			sum += ((TestElement*) pElt)->getValue();
+		}
+
+		if (sum != std::accumulate(pIndices->begin(), pIndices->end(), (size_t) 0)) {
+			throw logic_error("Unexpected elements from batched lookups");
+		}
+	}
+}
+
+
+// Random lookups by index and by offset in a GenericSequence, and in
+// its frozen copy.  The Eytzinger descent of the frozen copy is also
+// compared with a binary search of the ends in index order.
+void benchmarkFrozen(size_t count, size_t lookupCount)
+{
+	std::cout << "benchmarkFrozen: " << count << std::endl;
+
+	GenericSequence<BenchmarkValue> seq;
+	vector<IndexType> ends;
+	IndexType width = 0;
+	for (size_t i = 0; i < count; i++) {
+		seq.append(i, 1 + i % 3);
+		width += 1 + i % 3;
+		ends.push_back(width);
+	}
+
+	srand(1);
+	vector<IndexType> indices;
+	vector<IndexType> offsets;
+	for (size_t i = 0; i < lookupCount; i++) {
+		indices.push_back(((size_t) rand() * RAND_MAX + rand()) % count);
+		offsets.push_back(((size_t) rand() * RAND_MAX + rand()) % width);
+	}
+
+	FrozenSequence<BenchmarkValue> frozen;
+	{
+		BenchmarkTimer timer("freeze", count);
+		frozen = seq.freeze();
+	}
+
+	size_t sum = 0;
+	{
+		BenchmarkTimer timer("getElement", lookupCount);
+		for (IndexType index : indices) {
+			sum += seq[index].m_value;
+		}
+	}
+
+	{
+		BenchmarkTimer timer("frozen getElement", lookupCount);
+		for (IndexType index : indices) {
+			sum -= frozen[index].m_value;
+		}
+	}
+
+	{
+		BenchmarkTimer timer("getElementAtOffset", lookupCount);
+		for (IndexType offset : offsets) {
+			sum += seq.getElementAtOffset(offset).m_value;
+		}
+	}
+
+	{
+		BenchmarkTimer timer("frozen getElementAtOffset", lookupCount);
+		for (IndexType offset : offsets) {
+			sum -= frozen.getElementAtOffset(offset).m_value;
+		}
+	}
+
+	{
+		BenchmarkTimer timer("binary search of ends", lookupCount);
+		for (IndexType offset : offsets) {
+			sum += std::upper_bound(ends.begin(), ends.end(), offset) - ends.begin();
+		}
+	}
+
+	for (IndexType offset : offsets) {
+		sum -= frozen.getIndexAtOffset(offset);
+	}
+
+	if (sum != 0) {
+		throw logic_error("Unexpected elements of frozen sequence");
+	}
+}
+
+
+void runBenchmarks()
+{
+	benchmarkInsertRemove(1000000);
+	benchmarkLayouts(1000000);
+	benchmarkSmallSequences(100000);
+	benchmarkFinger(1000000);
+	benchmarkCursor(1000000, 1000, 1000);
+
+	for (size_t batchSize : {1000, 10000, 100000, 1000000}) {
+		benchmarkBatchEdits(1000000, batchSize);
+	}
+
+	benchmarkParallel(10000000);
+	benchmarkPersistent(1000000, 1000);
+	benchmarkConcurrentReaders(1000000, 1000000);
+	benchmarkCombining(100000, 1000000);
+	benchmarkSequenceFile(10000000);
+
+	for (size_t regionLength : {100, 10000}) {
+		benchmarkRangeWidth(1000000, regionLength, 10000);
+	}
+
+	benchmarkReverseMove(1000000, 1000, 1000);
+	benchmarkComparePositions(1000000, 100000);
+	benchmarkBatchLookups(4000000, 100000, 4);
+	benchmarkFrozen(10000000, 1000000);
+}
@@ -0,0 +1,39 @@
+/*
+ * Benchmark.h
+ *  Created on: Oct 17, 2026
+ *      Author: R. Krishnaswamy
+ */
+#include "inc/Sequence.h"
+#include <chrono>
+#include <iostream>
+
+#pragma once
+
+// Measures the time taken by a piece of code, and reports it per
+// operation.
+class BenchmarkTimer
+{
+public:
+	BenchmarkTimer(const string& name, size_t opCount)
+	: m_name(name), m_opCount(opCount),
+	  m_start(std::chrono::steady_clock::now())
+	{}
+
+	~BenchmarkTimer()
+	{
+		auto elapsed = std::chrono::steady_clock::now() - m_start;
+		double ns = std::chrono::duration<double, std::nano>(elapsed).count();
+		std::cout << "  " << m_name << ": "
+				  << ns / 1.0e6 << " ms, "
+				  << ns / m_opCount << " ns/op" << std::endl;
+	}
+
+private:
+	string m_name;
+	size_t m_opCount;
+	std::chrono::steady_clock::time_point m_start;
+};
+
+
+// Runs all the benchmarks.
+void runBenchmarks();
@@ -0,0 +1,140 @@
+/*
+ * CombiningSequence.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: R. Krishnaswamy
+ */
+#include "inc/CombiningSequence.h"
+#include <thread>
+
+// Constructor
+CombiningSequence::CombiningSequence(Sequence& seq)
+: m_seq(seq)
+{}
+
+
+void CombiningSequence::insertAtIndex(Sequence::Element* pNewElt,
+		                              IndexType atIndex, IndexType width)
+{
+	auto op = [pNewElt, atIndex, width](Sequence& seq) {
+		seq.insertAtIndex(pNewElt, atIndex, width);
+	};
+	execute(op);
+}
+
+
+void CombiningSequence::remove(IndexType index)
+{
+	auto op = [index](Sequence& seq) {
+		seq.remove(index);
+	};
+	execute(op);
+}
+
+
+Sequence::Element* CombiningSequence::getElement(IndexType index)
+{
+	Sequence::Element* pElt = nullptr;
+	auto op = [&pElt, index](Sequence& seq) {
+		pElt = seq.getElement(index);
+	};
+	execute(op);
+	return pElt;
+}
+
+
+IndexType CombiningSequence::getLength()
+{
+	IndexType length = 0;
+	auto op = [&length](Sequence& seq) {
+		length = seq.getLength();
+	};
+	execute(op);
+	return length;
+}
+
+
+void CombiningSequence::execute(void (*pInvoke)(void* pOp, Sequence& seq), void* pOp)
+{
+	// Each thread starts from its own slot, so that a slot is normally
+	// free, and stays in the cache of its thread.  The threads are
+	// numbered densely, so that the combiner scans few slots.
+	static std::atomic<IndexType> threadCount(0);
+	static thread_local IndexType hint = threadCount++ % SlotCount;
+
+	Slot* pSlot = nullptr;
+	for (IndexType i = hint; pSlot == nullptr; i++) {
+		Slot& slot = m_slots[i % SlotCount];
+		int expected = Free;
+		if (slot.m_state.compare_exchange_weak(expected, Claimed,
+				                               std::memory_order_acquire)) {
+			pSlot = &slot;
+
+			IndexType used = m_usedSlots.load(std::memory_order_relaxed);
+			IndexType needed = i % SlotCount + 1;
+			while ((used < needed) &&
+				   !m_usedSlots.compare_exchange_weak(used, needed)) {
+			}
+		} else if ((i - hint + 1) % SlotCount == 0) {
+			// All the slots are taken.
+			std::this_thread::yield();
+		}
+	}
+
+	pSlot->m_pInvoke = pInvoke;
+	pSlot->m_pOp = pOp;
+	pSlot->m_state.store(Pending, std::memory_order_release);
+
+	// Wait for a combiner to do the operation, or become the combiner.
+	while (pSlot->m_state.load(std::memory_order_acquire) != Done) {
+		if (m_mutex.try_lock()) {
+			combine();
+			m_mutex.unlock();
+		} else {
+			std::this_thread::yield();
+		}
+	}
+
+	std::exception_ptr error = pSlot->m_error;
+	pSlot->m_error = nullptr;
+	pSlot->m_state.store(Free, std::memory_order_release);
+
+	if (error) {
+		std::rethrow_exception(error);
+	}
+}
+
+
+void CombiningSequence::combine()
+{
+	IndexType combined = 0;
+	for (IndexType pass = 0; pass < CombinePasses; pass++) {
+		IndexType found = 0;
+		IndexType used = m_usedSlots.load(std::memory_order_acquire);
+		for (IndexType i = 0; i < used; i++) {
+			Slot& slot = m_slots[i];
+			if (slot.m_state.load(std::memory_order_acquire) != Pending) {
+				continue;
+			}
+
+			try {
+				slot.m_pInvoke(slot.m_pOp, m_seq);
+			} catch (...) {
+				slot.m_error = std::current_exception();
+			}
+
+			slot.m_state.store(Done, std::memory_order_release);
+			found++;
+		}
+
+		combined += found;
+		if (found == 0) {
+			break;
+		}
+	}
+
+	if (combined > 0) {
+		m_batchCount++;
+		m_combinedCount += combined;
+	}
+}
@@ -0,0 +1,131 @@
+/*
+ * ElementPool.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: R. Krishnaswamy
+ */
+#include "inc/ElementPool.h"
+#include <cstddef>
+#include <algorithm>
+
+// Constructor
+ElementPool::ElementPool(IndexType slotSize,
+		                 IndexType slotsPerSlab,
+		                 std::pmr::memory_resource* pUpstream)
+: m_slotSize(slotSize),
+  m_slotsPerSlab(slotsPerSlab),
+  m_pUpstream(pUpstream)
+{
+	// A slot must be able to hold a FreeSlot, and every slot must be
+	// suitably aligned for any Element.
+	const IndexType alignment = alignof(std::max_align_t);
+	m_slotSize = std::max(m_slotSize, (IndexType) sizeof(FreeSlot));
+	m_slotSize = (m_slotSize + alignment - 1) / alignment * alignment;
+
+	if (m_slotsPerSlab == 0) {
+		m_slotsPerSlab = 1;
+	}
+}
+
+
+// Virtual destructor
+ElementPool::~ElementPool()
+{
+	release();
+}
+
+
+void* ElementPool::allocateSlot()
+{
+	void* pSlot;
+
+	if (m_pFreeList != nullptr) {
+		// Reuse the most recently freed slot.
+		pSlot = m_pFreeList;
+		m_pFreeList = m_pFreeList->m_pNext;
+	} else {
+		if (m_pNextSlot == m_pSlabEnd) {
+			addSlab();
+		}
+
+		pSlot = m_pNextSlot;
+		m_pNextSlot += m_slotSize;
+	}
+
+	m_slotsInUse++;
+	return pSlot;
+}
+
+
+void ElementPool::deallocateSlot(void* pSlot)
+{
+	if (pSlot == nullptr) {
+		return;
+	}
+
+	FreeSlot* pFree = (FreeSlot*) pSlot;
+	pFree->m_pNext = m_pFreeList;
+	m_pFreeList = pFree;
+	m_slotsInUse--;
+}
+
+
+void ElementPool::release()
+{
+	IndexType slabSize = m_slotSize * m_slotsPerSlab;
+	for (char* pSlab : m_slabs) {
+		m_pUpstream->deallocate(pSlab, slabSize, alignof(std::max_align_t));
+	}
+
+	m_slabs.clear();
+	m_pFreeList = nullptr;
+	m_pNextSlot = nullptr;
+	m_pSlabEnd = nullptr;
+	m_slotsInUse = 0;
+}
+
+
+IndexType ElementPool::getSlotSize() const
+{
+	return m_slotSize;
+}
+
+
+IndexType ElementPool::getSlotsInUse() const
+{
+	return m_slotsInUse;
+}
+
+
+void ElementPool::addSlab()
+{
+	IndexType slabSize = m_slotSize * m_slotsPerSlab;
+	char* pSlab = (char*) m_pUpstream->allocate(slabSize,
+			                                    alignof(std::max_align_t));
+	m_slabs.push_back(pSlab);
+	m_pNextSlot = pSlab;
+	m_pSlabEnd = pSlab + slabSize;
+}
+
+
+void* ElementPool::do_allocate(size_t bytes, size_t alignment)
+{
+	if ((bytes > m_slotSize) || (alignment > alignof(std::max_align_t))) {
+		throw std::bad_alloc();
+	}
+
+	return allocateSlot();
+}
+
+
+void ElementPool::do_deallocate(void* p, size_t /* bytes */, size_t /* alignment */)
+{
+	deallocateSlot(p);
+}
+
+
+bool ElementPool::do_is_equal(const std::pmr::memory_resource& that)
+		const noexcept
+{
+	return this == &that;
+}
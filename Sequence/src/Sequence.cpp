@@ -7,6 +7,8 @@
 #include <cctype>
 #include "inc/Sequence.h"
 #include "inc/Rotation.h"
+#include "inc/ElementPool.h"
+#include "inc/FrozenSequence.h"
 #include <sstream>
 #include <iostream>
 #include <algorithm>
@@ -14,9 +16,108 @@
 // Initialization of UndefinedIndex
 IndexType Sequence::UndefinedIndex = std::numeric_limits<IndexType>::max();
 
-// The set of Rotations.
+// The AVL rotations.  Each rotation is applied at a node $0 whose
+// height-delta (left-subtree-height minus right-subtree-height) is 2
+// or -2.  The comment above each pattern gives the height-deltas of
+// the nodes that select it (see Sequence::rebalanceSubtree).  Rotations
+// that share the same shape share the same patterns.
+
+// LL-a: $0 is 2, $1 is 1 and $0 has no right child.
+// Note that in pattern LL-a, non-leaf node $0 of the input pattern
+// becomes a leaf-node in the output pattern.
+struct LLaPatterns
+{
+	static constexpr const char* input = "$0($1($2,0),0)";
+	static constexpr const char* output = "$1($2,$0)";
+};
+
+// LL-b: $0 is 2 and $1 is 1.
+// LR-d: $0 is 2 and $1 is 0 (this was not in text by Horowitz & Sahni).
+struct LLbPatterns
+{
+	static constexpr const char* input = "$0($1($2,$3),$4)";
+	static constexpr const char* output = "$1($2,$0($3,$4))";
+};
+
+// RR-a: $0 is -2, $1 is -1 and $0 has no left child.
+// Note that in pattern RR-a, non-leaf node $0 of the input pattern
+// becomes a leaf-node in the output pattern.
+struct RRaPatterns
+{
+	static constexpr const char* input = "$0(0,$1(0,$2))";
+	static constexpr const char* output = "$1($0,$2)";
+};
+
+// RR-b: $0 is -2 and $2 is -1.
+// RL-d: $0 is -2 and $2 is 0 (this was not in text by Horowitz & Sahni).
+struct RRbPatterns
+{
+	static constexpr const char* input = "$0($1,$2($3,$4))";
+	static constexpr const char* output = "$2($0($1,$3),$4)";
+};
+
+// LR-a: $0 is 2, $1 is -1 and $0 has no right child.
+// Note that in pattern LR-a, non-leaf node $0 of the input pattern
+// becomes a leaf-node in the output pattern.
+struct LRaPatterns
+{
+	static constexpr const char* input = "$0($1(0,$2),0)";
+	static constexpr const char* output = "$2($1,$0)";
+};
+
+// LR-b: $0 is 2, $1 is -1 and $3 is 1.
+// LR-c: $0 is 2, $1 is -1 and $3 is -1.
+// LR-e: $0 is 2, $1 is -1 and $3 is 0 (this was not in text by Horowitz
+// & Sahni).  It occurs after a removal or a join.
+struct LRbPatterns
+{
+	static constexpr const char* input = "$0($1($2,$3($4,$5)),$6)";
+	static constexpr const char* output = "$3($1($2,$4),$0($5,$6))";
+};
+
+// RL-a: $0 is -2, $1 is 1 and $0 has no left child.
+// Note that in pattern RL-a, non-leaf node $0 of the input pattern
+// becomes a leaf-node in the output pattern.
+struct RLaPatterns
+{
+	static constexpr const char* input = "$0(0,$1($2,0))";
+	static constexpr const char* output = "$2($0,$1)";
+};
+
+// RL-b: $0 is -2, $2 is 1 and $3 is 1.
+// RL-c: $0 is -2, $2 is 1 and $3 is -1.
+// RL-e: $0 is -2, $2 is 1 and $3 is 0 (this was not in text by Horowitz
+// & Sahni).  It occurs after a removal or a join.
+struct RLbPatterns
+{
+	static constexpr const char* input = "$0($1,$2($3($4,$5),$6))";
+	static constexpr const char* output = "$3($0($1,$4),$2($5,$6))";
+};
+
+// Hints that the node at pElt is about to be read.
+static inline void prefetch(const void* pElt)
+{
+#if defined(__GNUC__)
+	__builtin_prefetch(pElt);
+#endif
+}
+
+// The set of Rotations, which record their usage.
+enum RotationId
+{
+	LL_a, LL_b, RR_a, RR_b,
+	LR_a, LR_b, LR_c, LR_d,
+	RL_a, RL_b, RL_c, RL_d,
+	LR_e, RL_e
+};
+
 static
-vector<Rotation> s_avlRotations;
+Rotation s_avlRotations[] = {
+	Rotation("LL-a"), Rotation("LL-b"), Rotation("RR-a"), Rotation("RR-b"),
+	Rotation("LR-a"), Rotation("LR-b"), Rotation("LR-c"), Rotation("LR-d"),
+	Rotation("RL-a"), Rotation("RL-b"), Rotation("RL-c"), Rotation("RL-d"),
+	Rotation("LR-e"), Rotation("RL-e")
+};
 
 
 // This is to get an image of this Element, usually
@@ -35,86 +136,18 @@ string Sequence::Element::image() const
 Sequence::Sequence()
 : m_root(nullptr)
 {
-	if (!s_avlRotations.empty()) {
-		// The avl rotations array is already initialized
-		return;
-	}
+}
 
-	// Need to initialize the avl rotations array.
-
-	// Note that we will give the height deltas that are to match
-	// for internal nodes of the inputPattern.  Since the deltas
-	// vector is for all nodes (including leaf-nodes), we will
-	// simply give a bogus value.
-	int X = Rotation::IGNORE_DELTA;
-
-	// LL-a Rotation
-	// Note that in pattern LL-a, non-leaf node $0 of inPattern becomes
-	// a leaf-node in outPattern.
-	s_avlRotations.push_back(Rotation());
-	Rotation* pRot = &s_avlRotations.back();
-	pRot->init("LL-a","$0($1($2,0),0)", {2,1,X}, "$1($2,$0))");
-
-	// LL-b Rotation
-	s_avlRotations.push_back(Rotation());
-	pRot = &s_avlRotations.back();
-	pRot->init("LL-b", "$0($1($2,$3),$4)", {2,1,X,X,X}, "$1($2,$0($3,$4))");
-
-	// RR-a Rotation
-	// Note that in pattern RR-a, non-leaf node $0 of inPattern becomes
-	// a leaf-node in outPattern.
-	s_avlRotations.push_back(Rotation());
-	pRot = &s_avlRotations.back();
-	pRot->init("RR-a", "$0(0,$1(0,$2))", {-2,-1,X}, "$1($0,$2))");
-
-	// RR-b Rotation
-	s_avlRotations.push_back(Rotation());
-	pRot = &s_avlRotations.back();
-	pRot->init("RR-b", "$0($1,$2($3,$4))", {-2,X,-1,X,X}, "$2($0($1,$3),$4)");
-
-	// LR-a Rotation
-	// Note that in pattern LR-a, non-leaf node $0 of inPattern becomes
-	// a leaf-node in outPattern.
-	s_avlRotations.push_back(Rotation());
-	pRot = &s_avlRotations.back();
-	pRot->init("LR-a", "$0($1(0,$2),0)", {2,-1,0}, "$2($1,$0)");
-
-	// LR-b Rotation
-	s_avlRotations.push_back(Rotation());
-	pRot = &s_avlRotations.back();
-	pRot->init("LR-b", "$0($1($2,$3($4,$5)),$6)", {2,-1,X,1,X,X,X}, "$3($1($2,$4),$0($5,$6))");
-
-	// LR-c Rotation
-	s_avlRotations.push_back(Rotation());
-	pRot = &s_avlRotations.back();
-	pRot->init("LR-c", "$0($1($2,$3($4,$5)),$6)", {2,-1,X,-1,X,X,X}, "$3($1($2,$4),$0($5,$6))");
-
-	// LR-d Rotation (this was not in text by Horowitz & Sahni)
-	s_avlRotations.push_back(Rotation());
-	pRot = &s_avlRotations.back();
-	pRot->init("LR-d", "$0($1($2,$3),$4)", {2,0,X,X,0}, "$1($2,$0($3,$4)");
-
-	// RL-a Rotation
-	// Note that in pattern RL-a, non-leaf node $0 of inPattern becomes
-	// a leaf-node in outPattern.
-	s_avlRotations.push_back(Rotation());
-	pRot = &s_avlRotations.back();
-	pRot->init("RL-a", "$0(0,$1($2,0))", {-2,1,0}, "$2($0,$1)");
-
-	// RL-b Rotation
-	s_avlRotations.push_back(Rotation());
-	pRot = &s_avlRotations.back();
-	pRot->init("RL-b", "$0($1,$2($3($4,$5),$6))", {-2,X,1,1,X,X,X}, "$3($0($1,$4),$2($5,$6))");
-
-	// RL-c Rotation
-	s_avlRotations.push_back(Rotation());
-	pRot = &s_avlRotations.back();
-	pRot->init("RL-c", "$0($1,$2($3($4,$5),$6))", {-2,X,1,-1,X,X,X}, "$3($0($1,$4),$2($5,$6))");
-
-	// RL-d Rotation (this was not in text by Horowitz & Sahni)
-	s_avlRotations.push_back(Rotation());
-	pRot = &s_avlRotations.back();
-	pRot->init("RL-d", "$0($1,$2($3,$4))", {-2,0,0,X,X}, "$2($0($1,$3),$4)");
+
+// Move constructor
+Sequence::Sequence(Sequence&& that)
+: m_root(that.m_root), m_pPool(that.m_pPool), m_hasAggregate(that.m_hasAggregate),
+  m_isFingerEnabled(that.m_isFingerEnabled),
+  m_hasUpdates(that.m_hasUpdates)
+{
+	that.m_root = nullptr;
+	that.m_hasUpdates = false;
+	that.invalidateFinger();
 }
 
 
@@ -127,11 +160,13 @@ Sequence::~Sequence()
 
 void Sequence::clear()
 {
+	invalidateFinger();
 	if (m_root != nullptr) {
 		destroySubtree(m_root);
 	}
 
 	m_root = nullptr;
+	m_hasUpdates = false;
 }
 
 
@@ -145,13 +180,106 @@ void Sequence::destroySubtree(Element* pElt)
 		destroySubtree(pElt->m_right);
 	}
 
-	delete pElt;
+	destroyElement(pElt);
+}
+
+
+void Sequence::setElementPool(ElementPool* pPool)
+{
+	if (m_root != nullptr) {
+		throw std::logic_error("Cannot change the ElementPool of a non-empty sequence!");
+	}
+
+	m_pPool = pPool;
+}
+
+
+ElementPool* Sequence::getElementPool() const
+{
+	return m_pPool;
+}
+
+
+void Sequence::setAggregateEnabled(bool isEnabled)
+{
+	if (m_root != nullptr) {
+		throw std::logic_error("Cannot change the aggregates of a non-empty sequence!");
+	}
+
+	m_hasAggregate = isEnabled;
+}
+
+
+bool Sequence::isAggregateEnabled() const
+{
+	return m_hasAggregate;
+}
+
+
+void Sequence::destroyElement(Element* pElt)
+{
+	if (m_pPool == nullptr) {
+		delete pElt;
+	} else {
+		pElt->~Element();
+		m_pPool->deallocateSlot(pElt);
+	}
+}
+
+
+void Sequence::forgetElements()
+{
+	invalidateFinger();
+	m_root = nullptr;
+	m_hasUpdates = false;
+}
+
+
+Sequence::Element* Sequence::buildSubtree(Element** ppElts, IndexType count)
+{
+	if (count == 0) {
+		return nullptr;
+	}
+
+	// The middle element is the root.  The left subtree has either
+	// the same number of elements as the right one, or one more, and
+	// so their heights differ by at most one.
+	IndexType mid = count/2;
+	Element* pElt = ppElts[mid];
+	Element* pLeft = buildSubtree(ppElts, mid);
+	Element* pRight = buildSubtree(ppElts + mid + 1, count - mid - 1);
+
+	pElt->m_left = pLeft;
+	pElt->m_right = pRight;
+	pElt->m_height = 0;
+	pElt->m_weight = 1;
+	pElt->m_tagKind = NoTag;
+	pElt->m_tagWidth = 0;
+	pElt->m_isReversed = false;
+
+	// m_cumWidth is still the width of pElt itself.
+	if (pLeft != nullptr) {
+		pLeft->m_parent = pElt;
+		pElt->m_height = pLeft->m_height + 1;
+		pElt->m_weight += pLeft->m_weight;
+		pElt->m_cumWidth += pLeft->m_cumWidth;
+	}
+
+	if (pRight != nullptr) {
+		pRight->m_parent = pElt;
+		pElt->m_height = std::max(pElt->m_height, pRight->m_height + 1);
+		pElt->m_weight += pRight->m_weight;
+		pElt->m_cumWidth += pRight->m_cumWidth;
+	}
+
+	updateAggregate(pElt);
+	return pElt;
 }
 
 
 // Current length of the sequence.  This is one more than the last
 // index.  Initial length of the sequence is zero.
-IndexType Sequence::getLength()
+IndexType Sequence::getLength() const
 {
 	if (m_root == nullptr) {
 		return 0;
@@ -168,6 +296,7 @@ IndexType Sequence::getLength()
 // of the new element.
 void Sequence::insert(Element* pNewElt, Element* pBeforeElt, IndexType width)
 {
+	invalidateFinger();
 	Element* pRover = nullptr;
 
 	// If pBeforeElt is null, then pNewElt is appended to the sequence.
@@ -181,8 +310,10 @@ void Sequence::insert(Element* pNewElt, Element* pBeforeElt, IndexType width)
 		} else {
 			// Search for the last element.
 			pRover = m_root;
+			pushDown(pRover);
 			while (pRover->m_right != nullptr) {
 				pRover = pRover->m_right;
+				pushDown(pRover);
 			}
 
 			// Now append it to this last element.
@@ -190,14 +321,15 @@ void Sequence::insert(Element* pNewElt, Element* pBeforeElt, IndexType width)
 			pRover->m_right = pNewElt;
 		}
 
-		updateAttributes(pNewElt, width);
-		rebalance(pNewElt);
+		retraceInsertion(pNewElt, width);
 
 		// Done with appending.
 		return;
 	}
 
-	// It is a true insertion.
+	// It is a true insertion.  The pending updates on the way down to
+	// the new leaf are pushed first.
+	pushPath(pBeforeElt);
 	if (pBeforeElt->m_left == nullptr) {
 		pNewElt->m_parent = pBeforeElt;
 		pBeforeElt->m_left = pNewElt;
@@ -205,8 +337,10 @@ void Sequence::insert(Element* pNewElt, Element* pBeforeElt, IndexType width)
 		// Need to go to the rightmost descendant of
 		// the left subtree of pBeforeElt.
 		pRover = pBeforeElt->m_left;
+		pushDown(pRover);
 		while (pRover->m_right != nullptr) {
 			pRover = pRover->m_right;
+			pushDown(pRover);
 		}
 
 		// Now add it as a right descendant of pRover
@@ -214,8 +348,7 @@ void Sequence::insert(Element* pNewElt, Element* pBeforeElt, IndexType width)
 		pRover->m_right = pNewElt;
 	}
 
-	updateAttributes(pNewElt, width);
-	rebalance(pNewElt);
+	retraceInsertion(pNewElt, width);
 }
 
 
@@ -278,79 +411,93 @@ void Sequence::assignInPlace(const Element* pSrcElt, Element* pDstElt)
 }
 
 
-// To remove an element from the sequence.
+// To remove an element from the sequence.  No other element is moved
+// or copied, so pointers to the other elements remain valid.
 void Sequence::remove(Element* pElt)
 {
-	Element* pRover;
-
 	if (pElt == nullptr) {
 		return;
 	}
 
-	if (pElt->m_right != nullptr) {
-		// Has right child.  Find the successor, the
-		// leftmost node of right child.  This includes
-		// the case of having both children.
-		pRover = pElt->m_right;
-		while (pRover->m_left != nullptr) {
-			pRover = pRover->m_left;
+	invalidateFinger();
+	pushPath(pElt);
+
+	IndexType width = pElt->getWidth();
+	Element* pParent = pElt->m_parent;
+	Element* pReplacement;
+
+	// The lowest node whose subtree has changed, where the upward pass
+	// starts, and the node that takes the position of pElt.
+	Element* pFixupFrom;
+	Element* pMoved = nullptr;
+	IndexType movedWidth = 0;
+
+	if ((pElt->m_left != nullptr) && (pElt->m_right != nullptr)) {
+		// Has both children.  The successor, the leftmost node of the
+		// right child, is unlinked from its position and relinked in
+		// the position of pElt.
+		pMoved = pElt->m_right;
+		pushDown(pMoved);
+		while (pMoved->m_left != nullptr) {
+			pMoved = pMoved->m_left;
+			pushDown(pMoved);
 		}
 
-		// At this point pRover is the successor of pElt.
-		// Copy it into *pElt.
-		assignInPlace(pRover, pElt);
+		movedWidth = pMoved->getWidth();
 
-		// Note: no need to update heights and weights
-		// or rebalance as no nodes have been removed yet!
+		if (pMoved == pElt->m_right) {
+			// The successor keeps its right subtree.
+			pFixupFrom = pMoved;
+		} else {
+			// The right subtree of the successor takes its position.
+			pFixupFrom = pMoved->m_parent;
+			pFixupFrom->m_left = pMoved->m_right;
+			if (pMoved->m_right != nullptr) {
+				pMoved->m_right->m_parent = pFixupFrom;
+			}
 
-		remove(pRover);
-	} else if (pElt->m_left != nullptr) {
-		// Has left child.  Since pElt->m_right==nullptr, this
-		// case has only the left child.  Find the predecessor,
-		// the rightmost node of left child.
-		pRover = pElt->m_left;
-		while (pRover->m_right != nullptr) {
-			pRover = pRover->m_right;
+			pMoved->m_right = pElt->m_right;
+			pMoved->m_right->m_parent = pMoved;
 		}
 
-		// At this point pRover is the predecessor of pElt.
-		// Copy it into *pElt.
-		assignInPlace(pRover, pElt);
+		pMoved->m_left = pElt->m_left;
+		pMoved->m_left->m_parent = pMoved;
+		pReplacement = pMoved;
+	} else {
+		// Has at most one child, which takes the position of pElt.
+		pReplacement = (pElt->m_left != nullptr) ? pElt->m_left : pElt->m_right;
+		pFixupFrom = pParent;
+	}
 
-		// Note: no need to update heights and weights
-		// or rebalance as no nodes have been removed yet!
+	if (pReplacement != nullptr) {
+		pReplacement->m_parent = pParent;
+	}
 
-		remove(pRover);
+	if (pParent == nullptr) {
+		m_root = pReplacement;
+	} else if (pParent->m_left == pElt) {
+		pParent->m_left = pReplacement;
 	} else {
-		// pElt is a leaf node with no child.
-		IndexType parentWidth;
-		Element* pParent = pElt->m_parent;
-		if (pParent == nullptr) {
-			m_root = nullptr;
-		} else if (pParent->m_left == pElt) {
-			// Save the parent width before changing its child
-			parentWidth = pParent->getWidth();
-			pParent->m_left = nullptr;
-		} else {
-			// Save the parent width before changing its child
-			parentWidth = pParent->getWidth();
-			pParent->m_right = nullptr;
-		}
-
-		delete pElt;
+		pParent->m_right = pReplacement;
+	}
 
-		if (pParent == nullptr) {
-			return;
-		}
+	destroyElement(pElt);
 
-		updateAttributes(pParent, parentWidth);
+	// A single upward pass fixes the heights, weights and widths, and
+	// rebalances.  The nodes below pMoved lost pMoved, and the nodes
+	// from pMoved upwards lost pElt.
+	if (pMoved == nullptr) {
+		retrace(pFixupFrom, nullptr, false, width);
+	} else {
+		retrace(pFixupFrom, pMoved, false, movedWidth);
 
-		// Now rebalance pParent, its parent, and so on all the
-		// way to the root.
-		while (pParent != nullptr) {
-			rebalance(pParent);
-			pParent = pParent->m_parent;
+		setAttributes(pMoved, movedWidth);
+		pMoved = rebalanceSubtree(pMoved);
+		if (pMoved->m_parent == nullptr) {
+			m_root = pMoved;
 		}
+
+		retrace(pMoved->m_parent, nullptr, false, width);
 	}
 }
 
@@ -363,276 +510,1609 @@ void Sequence::remove(IndexType index)
 }
 
 
-// To replace an element at a particular (zero-based) index.  Valid
-// indices are from zero to length()-1.  Note that this method takes
-// an Element by reference, and its contents are copied into the
-// Element at this index.  The last defaulted parameter provides the
-// width of the new element.
-void Sequence::replace(const Element& elt, IndexType atIndex, IndexType width)
+// A piece of the sequence being edited by applyEdits.  It is either a
+// run of the elements of the sequence before the block of edits, whose
+// width is the number of elements of the run, or one inserted element,
+// of width 1.
+class EditPiece : public Sequence::Element
 {
+public:
+	EditPiece(IndexType from)
+	: m_isOriginal(true), m_from(from)
+	{}
+
+	EditPiece(const Sequence::Edit& edit)
+	: m_isOriginal(false), m_pElt(edit.m_pElt)
+	{}
+
+	bool m_isOriginal;
+
+	// The index of the first element of a run.
+	IndexType m_from = 0;
+
+	// The inserted element.
+	Sequence::Element* m_pElt = nullptr;
+};
+
+
+void Sequence::applyEdits(const vector<Edit>& edits)
+{
+	// The indices are checked before anything is changed.
 	IndexType length = getLength();
+	for (const Edit& edit : edits) {
+		if (edit.m_isInsert ? (edit.m_index > length) : (edit.m_index >= length)) {
+			// Error
+			throw std::length_error("Invalid index!");
+		}
 
-	if (atIndex >= length) {
-		// Error
-		throw std::length_error("Invalid index!");
+		length += edit.m_isInsert ? 1 : -1;
 	}
 
-	Element* pElt = getElement(atIndex);
+	if (edits.empty()) {
+		return;
+	}
 
-	assignInPlace(&elt, pElt);
+	vector<IndexType> removed;
+	vector<IndexType> anchors;
+	vector<Element*> inserted;
+	resolveEdits(edits, removed, anchors, inserted);
 
-	setWidth(pElt, width);
+	invalidateFinger();
+	if (edits.size() * RebuildRatio >= getLength()) {
+		rebuildWithEdits(removed, anchors, inserted);
+	} else {
+		m_root = applyEditsToSubtree(m_root, 0,
+				                     removed.data(), removed.data() + removed.size(),
+				                     anchors.data(), anchors.data() + anchors.size(),
+				                     inserted.data());
+		if (m_root != nullptr) {
+			m_root->m_parent = nullptr;
+		}
+	}
 }
 
 
-// To get an element at a particular index
-Sequence::Element* Sequence::getElement(IndexType index) const
+// The edits are resolved in blocks of EditBlock, so that the sequence
+// of pieces stays small.  The runs of each block, which are relative to
+// the sequence before it, are then composed with the runs so far, which
+// are relative to the original sequence.
+void Sequence::resolveEdits(const vector<Edit>& edits, vector<IndexType>& removed,
+		                    vector<IndexType>& anchors, vector<Element*>& inserted)
 {
-	Element* pElt = m_root;
-
-	if ((pElt == nullptr) || index >= pElt->m_weight) {
-		return nullptr;
+	IndexType originalLength = getLength();
+	IndexType length = originalLength;
+	vector<EditRun> runs;
+	if (length > 0) {
+		runs.push_back({0, length, nullptr});
 	}
 
-	IndexType leftWeight;
-	IndexType indexInElt = index;
-	while (pElt != nullptr) {
-		if (pElt->m_left == nullptr) {
-			if (indexInElt == 0) {
-				return pElt;
-			} else {
-				// The element cannot be pElt.  It must
-				// be in the right subtree of pElt.
-				indexInElt--;
-				pElt = pElt->m_right;
+	// The inserted elements that are also removed by the batch
+	vector<Element*> discarded;
+	vector<EditRun> blockRuns;
+	vector<EditRun> composed;
+
+	for (size_t first = 0; first < edits.size(); first += EditBlock) {
+		size_t last = std::min(first + EditBlock, edits.size());
+		blockRuns.clear();
+		resolveEditBlock(&edits[first], &edits[0] + last, length, blockRuns, discarded);
+
+		// The kept elements are taken from the runs so far, in order,
+		// and the others are dropped.
+		composed.clear();
+		size_t next = 0;
+		IndexType inRun = 0;
+		IndexType position = 0;
+		auto take = [&](IndexType count, bool isKept) {
+			while (count > 0) {
+				const EditRun& run = runs[next];
+				IndexType taken = std::min(count, run.m_count - inRun);
+				if (!isKept) {
+					if (run.m_pElt != nullptr) {
+						discarded.push_back(run.m_pElt);
+					}
+				} else if (run.m_pElt == nullptr && !composed.empty() &&
+						   composed.back().m_pElt == nullptr &&
+						   composed.back().m_from + composed.back().m_count == run.m_from + inRun) {
+					composed.back().m_count += taken;
+				} else {
+					composed.push_back({run.m_from + inRun, taken, run.m_pElt});
+				}
+
+				count -= taken;
+				inRun += taken;
+				if (inRun == run.m_count) {
+					next++;
+					inRun = 0;
+				}
 			}
-		} else {
-			leftWeight = pElt->m_left->m_weight;
-			if (indexInElt < leftWeight) {
-				// The element is in the left subtree of
-				// pElt.  indexInElt is unchanged.
-				pElt = pElt->m_left;
-			} else if (indexInElt == leftWeight) {
-				// pElt is the required element.
-				return pElt;
-			} else {
-				// The required element is in the right subtree.
-				indexInElt -= leftWeight + 1;
-				pElt = pElt->m_right;
+		};
+
+		for (const EditRun& piece : blockRuns) {
+			if (piece.m_pElt != nullptr) {
+				composed.push_back(piece);
+				continue;
 			}
+
+			take(piece.m_from - position, false);
+			take(piece.m_count, true);
+			position = piece.m_from + piece.m_count;
+		}
+		take(length - position, false);
+
+		runs.swap(composed);
+		for (size_t i = first; i < last; i++) {
+			length += edits[i].m_isInsert ? 1 : -1;
+		}
+	}
+
+	// Each inserted element goes before the first element of the next
+	// run, or at the end.  The original elements that are not in any
+	// run are removed.
+	IndexType pendingFrom = 0;
+	IndexType next = 0;
+
+	for (const EditRun& run : runs) {
+		if (run.m_pElt != nullptr) {
+			inserted.push_back(run.m_pElt);
+			continue;
+		}
+
+		for (; pendingFrom < inserted.size(); pendingFrom++) {
+			anchors.push_back(run.m_from);
+		}
+
+		for (; next < run.m_from; next++) {
+			removed.push_back(next);
 		}
+		next = run.m_from + run.m_count;
+	}
+
+	for (; pendingFrom < inserted.size(); pendingFrom++) {
+		anchors.push_back(originalLength);
+	}
+
+	for (; next < originalLength; next++) {
+		removed.push_back(next);
 	}
 
-	// Could not find the element.
-	return nullptr;
+	for (Element* pElt : discarded) {
+		destroyElement(pElt);
+	}
 }
 
 
-// To get an element at a particular index
-Sequence::Element* Sequence::getElementAtOffset(IndexType offset) const
+// The index shifts of the block are resolved on a small sequence of
+// pieces, where a piece is found by its offset.
+void Sequence::resolveEditBlock(const Edit* pFirst, const Edit* pLast,
+		                        IndexType length, vector<EditRun>& runs,
+		                        vector<Element*>& discarded)
 {
-	Element* pElt = m_root;
-
-	if ((pElt == nullptr) || offset >= pElt->m_cumWidth) {
-		return nullptr;
+	ElementPool pool(sizeof(EditPiece), std::min<IndexType>(2 * (pLast - pFirst) + 1, 1024));
+	Sequence pieces;
+	pieces.setElementPool(&pool);
+	if (length > 0) {
+		pieces.append(pool.create<EditPiece>(0), length);
 	}
 
-	IndexType temp;
-	IndexType width;
-	IndexType leftWidth;
-	IndexType offsetInElt = offset;
-	while (pElt != nullptr) {
-		width = pElt->getWidth();
-		if (pElt->m_left == nullptr) {
-			if (offsetInElt < width) {
-				return pElt;
+	for (const Edit* pEdit = pFirst; pEdit != pLast; pEdit++) {
+		const Edit& edit = *pEdit;
+		if (edit.m_isInsert) {
+			// Until the element is linked, m_cumWidth holds its width.
+			edit.m_pElt->m_cumWidth = edit.m_width;
+			EditPiece* pNew = pool.create<EditPiece>(edit);
+			if (edit.m_index == length) {
+				pieces.append(pNew, 1);
 			} else {
-				// The element cannot be pElt.  It must
-				// be in the right subtree of pElt.
-				offsetInElt -= width;
-				pElt = pElt->m_right;
-
-				// Control now re-iterates through the loop for
-				// the right subtree.
-			}
-		} else {
-			leftWidth = pElt->m_left->m_cumWidth;
-			if (offsetInElt < leftWidth) {
-				// The element is in the left subtree of
-				// pElt.  indexInElt is unchanged.
-				pElt = pElt->m_left;
-
-				// Need to re-iterate through the loop for
-				// the left subtree.
-				continue;
+				EditPiece* pPiece = (EditPiece*) pieces.getElementAtOffset(edit.m_index);
+				IndexType offsetInPiece = edit.m_index - pieces.getStartOffset(pPiece);
+				if (offsetInPiece > 0) {
+					// The run is split, and the new piece goes between.
+					IndexType count = pPiece->getWidth();
+					EditPiece* pRest = pool.create<EditPiece>(pPiece->m_from + offsetInPiece);
+					pieces.setWidth(pPiece, offsetInPiece);
+					pieces.insert(pRest, successor(pPiece), count - offsetInPiece);
+					pPiece = pRest;
+				}
+
+				pieces.insert(pNew, pPiece, 1);
 			}
 
-			temp = leftWidth + width;
-			if (offsetInElt < temp) {
-				// pElt is the required element.
-				return pElt;
+			length++;
+		} else {
+			EditPiece* pPiece = (EditPiece*) pieces.getElementAtOffset(edit.m_index);
+			IndexType offsetInPiece = edit.m_index - pieces.getStartOffset(pPiece);
+			IndexType count = pPiece->getWidth();
+
+			if (!pPiece->m_isOriginal) {
+				discarded.push_back(pPiece->m_pElt);
+				pieces.remove(pPiece);
+			} else if (count == 1) {
+				pieces.remove(pPiece);
+			} else if (offsetInPiece == 0) {
+				pPiece->m_from++;
+				pieces.setWidth(pPiece, count - 1);
+			} else if (offsetInPiece == count - 1) {
+				pieces.setWidth(pPiece, count - 1);
 			} else {
-				// The required element is in the right subtree.
-				offsetInElt -= temp;
-				pElt = pElt->m_right;
-
-				// Control now re-iterates through the loop for
-				// the right subtree.
+				// The run is split around the removed element.
+				EditPiece* pRest = pool.create<EditPiece>(pPiece->m_from + offsetInPiece + 1);
+				pieces.setWidth(pPiece, offsetInPiece);
+				pieces.insert(pRest, successor(pPiece), count - offsetInPiece - 1);
 			}
+
+			length--;
 		}
 	}
 
-	// Could not find the element.
-	return nullptr;
+	for (Element* pElt : pieces) {
+		EditPiece* pPiece = (EditPiece*) pElt;
+		if (pPiece->m_isOriginal) {
+			runs.push_back({pPiece->m_from, pPiece->getWidth(), nullptr});
+		} else {
+			runs.push_back({0, 1, pPiece->m_pElt});
+		}
+	}
 }
 
 
-// Each Element has a "width" attribute that indicates how much space
-// it occupies.  This is by default 1 if not specified.  It can be
-// specified by this method.
-void Sequence::setWidth(Element* pElt, IndexType width)
+// The elements are merged with the edits in one in-order walk, and the
+// tree is rebuilt from them.
+void Sequence::rebuildWithEdits(const vector<IndexType>& removed,
+		                        const vector<IndexType>& anchors,
+		                        const vector<Element*>& inserted)
 {
-	bool isIncrease;
-	IndexType delta;
-	IndexType oldWidth = pElt->getWidth();
-
-	if (oldWidth > width) {
-		delta = oldWidth - width;
-		isIncrease = false;
-	} else if (oldWidth == width) {
-		return;
-	} else {
-		delta = width - oldWidth;
-		isIncrease = true;
-	}
+	IndexType length = getLength() - removed.size() + inserted.size();
+	vector<Element*> elts;
+	vector<IndexType> widths;
+	vector<Element*> destroyed;
+	elts.reserve(length);
+	widths.reserve(length);
+	destroyed.reserve(removed.size());
+
+	// The widths are taken before any element is destroyed, as they
+	// depend on the children.
+	IndexType index = 0;
+	IndexType nextRemoved = 0;
+	IndexType nextInserted = 0;
+	for (Element* pElt : *this) {
+		for (; (nextInserted < anchors.size()) && (anchors[nextInserted] == index);
+			 nextInserted++) {
+			elts.push_back(inserted[nextInserted]);
+			widths.push_back(inserted[nextInserted]->m_cumWidth);
+		}
 
-	Element* pRover = pElt;
-	while (pRover != nullptr) {
-		if (isIncrease) {
-			pRover->m_cumWidth += delta;
+		if ((nextRemoved < removed.size()) && (removed[nextRemoved] == index)) {
+			destroyed.push_back(pElt);
+			nextRemoved++;
 		} else {
-			if (pRover->m_cumWidth < delta) {
-				string msg = "Node " + pElt->image() + " invalid width!";
-				throw logic_error(msg);
-			}
-			pRover->m_cumWidth -= delta;
+			elts.push_back(pElt);
+			widths.push_back(pElt->getWidth());
 		}
+		index++;
+	}
 
-		pRover = pRover->m_parent;
+	for (; nextInserted < anchors.size(); nextInserted++) {
+		elts.push_back(inserted[nextInserted]);
+		widths.push_back(inserted[nextInserted]->m_cumWidth);
+	}
+
+	for (Element* pElt : destroyed) {
+		destroyElement(pElt);
 	}
+
+	forgetElements();
+	index = 0;
+	build(elts.begin(), elts.end(),
+		[&widths, &index](const Element*)->IndexType {
+			return widths[index++];
+		});
 }
 
 
-// The width can also be queried.
-IndexType Sequence::Element::getWidth() const
+// Only the subtrees that hold edits are descended.  Each of their roots
+// is detached from its children, which are edited, and then joined with
+// them again, or dropped, so that each node on the paths to the edits is
+// rebalanced once, bottom-up, by join().
+Sequence::Element* Sequence::applyEditsToSubtree
+                        (Element* pElt, IndexType firstIndex,
+                         const IndexType* pRemovedFirst, const IndexType* pRemovedLast,
+                         const IndexType* pAnchorFirst, const IndexType* pAnchorLast,
+                         Element** ppInserted)
 {
-	IndexType width = m_cumWidth;
+	if ((pRemovedFirst == pRemovedLast) && (pAnchorFirst == pAnchorLast)) {
+		return pElt;
+	}
 
-	if (m_left != nullptr) {
-		width -= m_left->m_cumWidth;
+	if (pElt == nullptr) {
+		// The edits left are insertions at this position.
+		Element* pRoot = buildSubtree(ppInserted, pAnchorLast - pAnchorFirst);
+		pRoot->m_parent = nullptr;
+		return pRoot;
 	}
 
-	if (m_right != nullptr) {
-		width -= m_right->m_cumWidth;
+	pushDown(pElt);
+	Element* pLeft = pElt->m_left;
+	Element* pRight = pElt->m_right;
+	IndexType width = pElt->getWidth();
+	IndexType eltIndex = firstIndex;
+	if (pLeft != nullptr) {
+		pLeft->m_parent = nullptr;
+		eltIndex += pLeft->m_weight;
 	}
 
-	return width;
-}
+	if (pRight != nullptr) {
+		pRight->m_parent = nullptr;
+	}
 
+	pElt->m_left = nullptr;
+	pElt->m_right = nullptr;
+	pElt->m_parent = nullptr;
+	setAttributes(pElt, width);
+
+	// The insertions before pElt go at the end of the left subtree.
+	const IndexType* pRemovedMid = std::lower_bound(pRemovedFirst, pRemovedLast, eltIndex);
+	const IndexType* pAnchorMid = std::upper_bound(pAnchorFirst, pAnchorLast, eltIndex);
+	bool isRemoved = (pRemovedMid != pRemovedLast) && (*pRemovedMid == eltIndex);
+
+	pLeft = applyEditsToSubtree(pLeft, firstIndex, pRemovedFirst, pRemovedMid,
+			                    pAnchorFirst, pAnchorMid, ppInserted);
+	pRight = applyEditsToSubtree(pRight, eltIndex + 1,
+			                     pRemovedMid + (isRemoved ? 1 : 0), pRemovedLast,
+			                     pAnchorMid, pAnchorLast,
+			                     ppInserted + (pAnchorMid - pAnchorFirst));
+
+	if (isRemoved) {
+		destroyElement(pElt);
+		return join(pLeft, pRight);
+	}
 
-// The width can also be queried.
-IndexType Sequence::getWidth(const Element* pElt) const
-{
-	return pElt->getWidth();
+	return join(pLeft, pElt, pRight);
 }
 
 
-// The start offset of an element can be queried.
-IndexType Sequence::getStartOffset(const Element* pElt) const
+void Sequence::collectElements(Element* pElt, IndexType firstIndex,
+		                       const IndexType* pFirst, const IndexType* pLast,
+		                       Element** ppElts)
 {
-	// The code is essentially the same as Sequence::getIndex
-	const Element* pRover = pElt;
+	while ((pFirst != pLast) && (pElt != nullptr)) {
+		pushDown(pElt);
+		IndexType eltIndex = firstIndex;
+		if (pElt->m_left != nullptr) {
+			eltIndex += pElt->m_left->m_weight;
+		}
 
-	IndexType startOffsetInRover;
+		// The indices before pElt are in the left subtree.
+		const IndexType* pMid = std::lower_bound(pFirst, pLast, eltIndex);
+		collectElements(pElt->m_left, firstIndex, pFirst, pMid, ppElts);
+		ppElts += pMid - pFirst;
+		pFirst = pMid;
 
-	if (pRover->m_left == nullptr) {
-		startOffsetInRover = 0;
-	} else {
-		startOffsetInRover = pRover->m_left->m_cumWidth;
+		while ((pFirst != pLast) && (*pFirst == eltIndex)) {
+			*ppElts++ = pElt;
+			pFirst++;
+		}
+
+		// The rest are in the right subtree.
+		firstIndex = eltIndex + 1;
+		pElt = pElt->m_right;
 	}
 
-	const Element* pLeft;
-	const Element* pParent = pRover->m_parent;
+	// The indices past the end
+	for (; pFirst != pLast; pFirst++) {
+		*ppElts++ = nullptr;
+	}
+}
 
-	while (pParent != nullptr) {
-		pLeft = pParent->m_left;
-		if (pLeft == pRover) {
-			// startOffsetInRover is unchanged.
-		} else if (pLeft == nullptr) {
-			// startOffsetInRover has to be changed by the width of
-			// pParent to account for the parent node.
-			startOffsetInRover += pParent->getWidth();
-		} else {
-			// indexInCurrent has to be increased by the weight of
-			// pLeft, plus width of the parent node.
-			startOffsetInRover += pLeft->m_cumWidth + pParent->getWidth();
-		}
 
-		pRover = pParent;
-		pParent = pRover->m_parent;
+// To split the sequence at a particular (zero-based) index.
+Sequence Sequence::split(IndexType atIndex)
+{
+	if (atIndex > getLength()) {
+		// Error
+		throw std::length_error("Invalid index!");
 	}
 
-	// Parent of pRover is nullptr, and so pRover must be the root.
-	return startOffsetInRover;
+	invalidateFinger();
+
+	Sequence tail;
+	tail.m_pPool = m_pPool;
+	tail.m_hasAggregate = m_hasAggregate;
+	tail.m_hasUpdates = m_hasUpdates;
+
+	splitSubtree(m_root, atIndex, m_root, tail.m_root);
+	return tail;
 }
 
 
-// To get the index of the element
-IndexType Sequence::getIndex(Element* pElt) const
+// To append all the elements of that sequence to this one.
+void Sequence::concat(Sequence&& that)
 {
-	const Element* pRover = pElt;
+	if (m_pPool != that.m_pPool) {
+		throw std::logic_error("Cannot concatenate sequences with different ElementPools!");
+	}
 
-	// indexInRover is the index of 'this' in the
-	// subtree rooted by pRover.
-	IndexType indexInRover;
+	if (m_hasAggregate != that.m_hasAggregate) {
+		throw std::logic_error("Cannot concatenate sequences with and without aggregates!");
+	}
 
-	if (pRover->m_left == nullptr) {
+	if (that.m_root == nullptr) {
+		return;
+	}
+
+	invalidateFinger();
+	that.invalidateFinger();
+
+	// The first element of that sequence is split off, to be the
+	// middle element of the join.
+	Element* pMid;
+	Element* pRest;
+	splitSubtree(that.m_root, 1, pMid, pRest);
+	that.m_root = nullptr;
+	m_hasUpdates = m_hasUpdates || that.m_hasUpdates;
+	that.m_hasUpdates = false;
+
+	m_root = join(m_root, pMid, pRest);
+}
+
+
+// To replace an element at a particular (zero-based) index.  Valid
+// indices are from zero to length()-1.  Note that this method takes
+// an Element by reference, and its contents are copied into the
+// Element at this index.  The last defaulted parameter provides the
+// width of the new element.
+void Sequence::replace(const Element& elt, IndexType atIndex, IndexType width)
+{
+	IndexType length = getLength();
+
+	if (atIndex >= length) {
+		// Error
+		throw std::length_error("Invalid index!");
+	}
+
+	Element* pElt = getElement(atIndex);
+
+	assignInPlace(&elt, pElt);
+
+	setWidth(pElt, width);
+	updateAggregates(pElt);
+}
+
+
+// The contents of pElt have changed.
+void Sequence::updateAggregates(Element* pElt)
+{
+	if (!m_hasAggregate) {
+		return;
+	}
+
+	for (Element* pRover = pElt; pRover != nullptr; pRover = pRover->m_parent) {
+		pRover->updateAggregate();
+	}
+}
+
+
+// To get an element at a particular index
+Sequence::Element* Sequence::getElement(IndexType index) const
+{
+	return findElement(index, false);
+}
+
+
+// To get an element at a particular index
+Sequence::Element* Sequence::getElementAtOffset(IndexType offset) const
+{
+	return findElement(offset, true);
+}
+
+
+void Sequence::setFingerEnabled(bool isEnabled)
+{
+	m_isFingerEnabled = isEnabled;
+	invalidateFinger();
+}
+
+
+bool Sequence::isFingerEnabled() const
+{
+	return m_isFingerEnabled;
+}
+
+
+void Sequence::invalidateFinger()
+{
+	m_pFinger = nullptr;
+}
+
+
+Sequence::Element* Sequence::findElement(IndexType target, bool isByOffset) const
+{
+	Element* pElt = m_root;
+	if ((pElt == nullptr) ||
+		(target >= (isByOffset ? pElt->m_cumWidth : pElt->m_weight))) {
+		return nullptr;
+	}
+
+	// The index and start offset of the element found.
+	IndexType index = 0;
+	IndexType startOffset = 0;
+
+	if (m_pFinger != nullptr) {
+		index = m_fingerIndex;
+		startOffset = m_fingerOffset;
+		pElt = seek(m_pFinger, target, isByOffset, index, startOffset);
+	} else {
+		pElt = descend(pElt, target, isByOffset, index, startOffset);
+	}
+
+	if (m_isFingerEnabled) {
+		m_pFinger = pElt;
+		m_fingerIndex = index;
+		m_fingerOffset = startOffset;
+	}
+
+	return pElt;
+}
+
+
+Sequence::Element* Sequence::seek(Element* pElt, IndexType target, bool isByOffset,
+		                          IndexType& index, IndexType& startOffset)
+{
+	// From here on, index and startOffset are those of the first element
+	// of the subtree at pElt.
+	if (pElt->m_left != nullptr) {
+		index -= pElt->m_left->m_weight;
+		startOffset -= pElt->m_left->m_cumWidth;
+	}
+
+	// Climb to the lowest ancestor whose subtree spans the target.
+	// The root spans it, so this stops.
+	while (true) {
+		IndexType first = isByOffset ? startOffset : index;
+		IndexType span = isByOffset ? pElt->m_cumWidth : pElt->m_weight;
+		if ((first <= target) && (target - first < span)) {
+			break;
+		}
+
+		Element* pParent = pElt->m_parent;
+		if (pParent->m_right == pElt) {
+			// The subtree of pParent starts with its left subtree
+			// and pParent itself.
+			index--;
+			startOffset -= pParent->getWidth();
+			if (pParent->m_left != nullptr) {
+				index -= pParent->m_left->m_weight;
+				startOffset -= pParent->m_left->m_cumWidth;
+			}
+		}
+
+		pElt = pParent;
+	}
+
+	return descend(pElt, target, isByOffset, index, startOffset);
+}
+
+
+Sequence::Element* Sequence::descend(Element* pElt, IndexType target, bool isByOffset,
+		                             IndexType& index, IndexType& startOffset)
+{
+	while ((pElt != nullptr) &&
+		   !descendStep(pElt, target, isByOffset, index, startOffset)) {
+	}
+
+	return pElt;
+}
+
+
+bool Sequence::descendStep(Element*& pElt, IndexType target, bool isByOffset,
+		                   IndexType& index, IndexType& startOffset)
+{
+	// The children, and so the width of pElt, must be up to date.
+	pushDown(pElt);
+
+	IndexType leftWeight = 0;
+	IndexType leftWidth = 0;
+	if (pElt->m_left != nullptr) {
+		leftWeight = pElt->m_left->m_weight;
+		leftWidth = pElt->m_left->m_cumWidth;
+	}
+
+	// The span of the left subtree, and of pElt, from the first
+	// element of the subtree.
+	IndexType width = pElt->getWidth();
+	IndexType first = isByOffset ? startOffset : index;
+	IndexType leftSpan = isByOffset ? leftWidth : leftWeight;
+	IndexType eltSpan = isByOffset ? width : 1;
+
+	if (target - first < leftSpan) {
+		// The element is in the left subtree of pElt.
+		pElt = pElt->m_left;
+		return false;
+	}
+
+	index += leftWeight;
+	startOffset += leftWidth;
+	if (target - first < leftSpan + eltSpan) {
+		// pElt is the required element.
+		return true;
+	}
+
+	// The required element is in the right subtree, or there is none,
+	// in which case pElt is nullptr.
+	index++;
+	startOffset += width;
+	pElt = pElt->m_right;
+	return false;
+}
+
+
+void Sequence::getElements(const vector<IndexType>& indices, vector<Element*>& elts) const
+{
+	findSorted(indices, false, elts);
+}
+
+
+void Sequence::getElementsAtOffsets(const vector<IndexType>& offsets,
+		                            vector<Element*>& elts) const
+{
+	findSorted(offsets, true, elts);
+}
+
+
+void Sequence::getElementsInterleaved(const vector<IndexType>& indices,
+		                              vector<Element*>& elts) const
+{
+	findInterleaved(indices, false, elts);
+}
+
+
+void Sequence::getElementsAtOffsetsInterleaved(const vector<IndexType>& offsets,
+		                                       vector<Element*>& elts) const
+{
+	findInterleaved(offsets, true, elts);
+}
+
+
+// Each lookup starts from the element found by the previous one, as
+// from the finger, so the paths that they share are not descended
+// again.
+void Sequence::findSorted(const vector<IndexType>& targets, bool isByOffset,
+		                  vector<Element*>& elts) const
+{
+	if (!std::is_sorted(targets.begin(), targets.end())) {
+		throw std::logic_error("Lookups are not sorted!");
+	}
+
+	elts.assign(targets.size(), nullptr);
+
+	IndexType span = 0;
+	if (m_root != nullptr) {
+		span = isByOffset ? m_root->m_cumWidth : m_root->m_weight;
+	}
+
+	Element* pElt = nullptr;
+	IndexType index = 0;
+	IndexType startOffset = 0;
+
+	for (IndexType i = 0; (i < targets.size()) && (targets[i] < span); i++) {
+		if (pElt == nullptr) {
+			pElt = descend(m_root, targets[i], isByOffset, index, startOffset);
+		} else {
+			pElt = seek(pElt, targets[i], isByOffset, index, startOffset);
+		}
+		elts[i] = pElt;
+	}
+}
+
+
+// A group of lookups is done together, a level at a time, and the
+// nodes of the next level are prefetched, so that the cache misses of
+// one lookup are overlapped with the steps of the others.
+void Sequence::findInterleaved(const vector<IndexType>& targets, bool isByOffset,
+		                       vector<Element*>& elts) const
+{
+	struct Lookup
+	{
+		Element* m_pElt;
+		IndexType m_index;
+		IndexType m_startOffset;
+	};
+
+	elts.assign(targets.size(), nullptr);
+	if (m_root == nullptr) {
+		return;
+	}
+
+	Lookup lookups[InterleavedLookups];
+	IndexType span = isByOffset ? m_root->m_cumWidth : m_root->m_weight;
+
+	for (IndexType base = 0; base < targets.size(); base += InterleavedLookups) {
+		IndexType count = std::min(InterleavedLookups, targets.size() - base);
+		IndexType active = 0;
+		for (IndexType i = 0; i < count; i++) {
+			bool isValid = (targets[base + i] < span);
+			lookups[i] = Lookup{isValid ? m_root : nullptr, 0, 0};
+			active += isValid ? 1 : 0;
+		}
+
+		while (active > 0) {
+			for (IndexType i = 0; i < count; i++) {
+				Lookup& lookup = lookups[i];
+				if (lookup.m_pElt == nullptr) {
+					continue;
+				}
+
+				if (descendStep(lookup.m_pElt, targets[base + i], isByOffset,
+						        lookup.m_index, lookup.m_startOffset)) {
+					elts[base + i] = lookup.m_pElt;
+					lookup.m_pElt = nullptr;
+					active--;
+				} else if (lookup.m_pElt == nullptr) {
+					active--;
+				} else {
+					prefetch(lookup.m_pElt);
+				}
+			}
+		}
+	}
+}
+
+
+// Each Element has a "width" attribute that indicates how much space
+// it occupies.  This is by default 1 if not specified.  It can be
+// specified by this method.
+void Sequence::setWidth(Element* pElt, IndexType width)
+{
+	bool isIncrease;
+	IndexType delta;
+	pushPath(pElt);
+	IndexType oldWidth = pElt->getWidth();
+
+	if (oldWidth > width) {
+		delta = oldWidth - width;
+		isIncrease = false;
+	} else if (oldWidth == width) {
+		return;
+	} else {
+		delta = width - oldWidth;
+		isIncrease = true;
+	}
+
+	invalidateFinger();
+
+	Element* pRover = pElt;
+	while (pRover != nullptr) {
+		if (isIncrease) {
+			pRover->m_cumWidth += delta;
+		} else {
+			if (pRover->m_cumWidth < delta) {
+				string msg = "Node " + pElt->image() + " invalid width!";
+				throw logic_error(msg);
+			}
+			pRover->m_cumWidth -= delta;
+		}
+
+		updateAggregate(pRover);
+		pRover = pRover->m_parent;
+	}
+}
+
+
+void Sequence::rangeAddWidth(IndexType from, IndexType to, long delta)
+{
+	if ((from > to) || (to > getLength())) {
+		// Error
+		throw std::length_error("Invalid index!");
+	}
+
+	if ((from == to) || (delta == 0)) {
+		return;
+	}
+
+	// A negative delta is added in unsigned arithmetic, which wraps
+	// around to the correct widths.
+	invalidateFinger();
+	m_hasUpdates = true;
+	updateRange(m_root, from, to, AddTag, (IndexType) delta);
+}
+
+
+void Sequence::rangeSetWidth(IndexType from, IndexType to, IndexType width)
+{
+	if ((from > to) || (to > getLength())) {
+		// Error
+		throw std::length_error("Invalid index!");
+	}
+
+	if (from == to) {
+		return;
+	}
+
+	invalidateFinger();
+	m_hasUpdates = true;
+	updateRange(m_root, from, to, SetTag, width);
+}
+
+
+void Sequence::reverseRange(IndexType from, IndexType to)
+{
+	if ((from > to) || (to > getLength())) {
+		// Error
+		throw std::length_error("Invalid index!");
+	}
+
+	if (to - from < 2) {
+		return;
+	}
+
+	Sequence tail = split(to);
+	Sequence range = split(from);
+	reverseSubtree(range.m_root);
+	range.m_hasUpdates = true;
+
+	concat(std::move(range));
+	concat(std::move(tail));
+}
+
+
+void Sequence::moveRange(IndexType from, IndexType to, IndexType dest)
+{
+	IndexType length = getLength();
+	if ((from > to) || (to > length) || (dest > length - (to - from))) {
+		// Error
+		throw std::length_error("Invalid index!");
+	}
+
+	if ((from == to) || (from == dest)) {
+		return;
+	}
+
+	// The range is taken out, and put back at dest.
+	Sequence tail = split(to);
+	Sequence range = split(from);
+	concat(std::move(tail));
+
+	Sequence rest = split(dest);
+	concat(std::move(range));
+	concat(std::move(rest));
+}
+
+
+// As for a segment tree, at most two nodes at each depth are partly in
+// the range, and are visited; the others are either tagged or skipped.
+void Sequence::updateRange(Element* pElt, IndexType from, IndexType to,
+		                   WidthTag kind, IndexType width)
+{
+	if ((from == 0) && (to == pElt->m_weight)) {
+		tagSubtree(pElt, kind, width);
+		return;
+	}
+
+	// The width of pElt is taken before its children change.
+	pushDown(pElt);
+	IndexType eltWidth = pElt->getWidth();
+	IndexType leftWeight = (pElt->m_left == nullptr) ? 0 : pElt->m_left->m_weight;
+
+	if (from < leftWeight) {
+		updateRange(pElt->m_left, from, std::min(to, leftWeight), kind, width);
+	}
+
+	if ((from <= leftWeight) && (leftWeight < to)) {
+		eltWidth = (kind == SetTag) ? width : eltWidth + width;
+	}
+
+	if (to > leftWeight + 1) {
+		IndexType rightFrom = (from > leftWeight + 1) ? from - leftWeight - 1 : 0;
+		updateRange(pElt->m_right, rightFrom, to - leftWeight - 1, kind, width);
+	}
+
+	pElt->m_cumWidth = eltWidth;
+	if (pElt->m_left != nullptr) {
+		pElt->m_cumWidth += pElt->m_left->m_cumWidth;
+	}
+
+	if (pElt->m_right != nullptr) {
+		pElt->m_cumWidth += pElt->m_right->m_cumWidth;
+	}
+}
+
+
+void Sequence::tagSubtree(Element* pElt, WidthTag kind, IndexType width)
+{
+	if (pElt == nullptr) {
+		return;
+	}
+
+	if (kind == SetTag) {
+		pElt->m_cumWidth = width * pElt->m_weight;
+	} else {
+		pElt->m_cumWidth += width * pElt->m_weight;
+	}
+
+	// A leaf has no children to push the update to.
+	if (pElt->m_weight == 1) {
+		return;
+	}
+
+	// An assignment replaces any earlier update, and an addition after
+	// an assignment is an assignment of the sum.
+	if (kind == SetTag) {
+		pElt->m_tagKind = SetTag;
+		pElt->m_tagWidth = width;
+	} else {
+		if (pElt->m_tagKind == NoTag) {
+			pElt->m_tagKind = AddTag;
+		}
+		pElt->m_tagWidth += width;
+	}
+}
+
+
+void Sequence::reverseSubtree(Element* pElt)
+{
+	// A leaf has no children to reverse.
+	if ((pElt == nullptr) || (pElt->m_weight == 1)) {
+		return;
+	}
+
+	std::swap(pElt->m_left, pElt->m_right);
+	pElt->m_isReversed = !pElt->m_isReversed;
+}
+
+
+// The width updates and the reversals commute, since a width update
+// is the same for all the nodes of a subtree.
+void Sequence::pushDown(Element* pElt)
+{
+	if (pElt == nullptr) {
+		return;
+	}
+
+	if (pElt->m_isReversed) {
+		pElt->m_isReversed = false;
+		reverseSubtree(pElt->m_left);
+		reverseSubtree(pElt->m_right);
+	}
+
+	if (pElt->m_tagKind == NoTag) {
+		return;
+	}
+
+	WidthTag kind = (WidthTag) pElt->m_tagKind;
+	pElt->m_tagKind = NoTag;
+	tagSubtree(pElt->m_left, kind, pElt->m_tagWidth);
+	tagSubtree(pElt->m_right, kind, pElt->m_tagWidth);
+	pElt->m_tagWidth = 0;
+}
+
+
+void Sequence::pushPath(const Element* pElt) const
+{
+	if (m_hasUpdates) {
+		pushPathFrom(const_cast<Element*>(pElt));
+	}
+}
+
+
+void Sequence::pushPathFrom(Element* pElt)
+{
+	if (pElt->m_parent != nullptr) {
+		pushPathFrom(pElt->m_parent);
+	}
+
+	pushDown(pElt);
+}
+
+
+void Sequence::flushUpdates() const
+{
+	if (m_hasUpdates) {
+		flushSubtree(m_root);
+		m_hasUpdates = false;
+	}
+}
+
+
+void Sequence::flushSubtree(Element* pElt)
+{
+	while (pElt != nullptr) {
+		pushDown(pElt);
+		flushSubtree(pElt->m_left);
+		pElt = pElt->m_right;
+	}
+}
+
+
+// The width can also be queried.
+IndexType Sequence::Element::getWidth() const
+{
+	IndexType width = m_cumWidth;
+
+	if (m_left != nullptr) {
+		width -= m_left->m_cumWidth;
+	}
+
+	if (m_right != nullptr) {
+		width -= m_right->m_cumWidth;
+	}
+
+	return width;
+}
+
+
+// The width can also be queried.
+IndexType Sequence::getWidth(const Element* pElt) const
+{
+	pushPath(pElt);
+	return pElt->getWidth();
+}
+
+
+// The start offset of an element can be queried.
+IndexType Sequence::getStartOffset(const Element* pElt) const
+{
+	if ((m_pFinger != nullptr) && (pElt == m_pFinger)) {
+		return m_fingerOffset;
+	}
+
+	pushPath(pElt);
+
+	// The code is essentially the same as Sequence::getIndex
+	const Element* pRover = pElt;
+
+	IndexType startOffsetInRover;
+
+	if (pRover->m_left == nullptr) {
+		startOffsetInRover = 0;
+	} else {
+		startOffsetInRover = pRover->m_left->m_cumWidth;
+	}
+
+	const Element* pLeft;
+	const Element* pParent = pRover->m_parent;
+
+	while (pParent != nullptr) {
+		pLeft = pParent->m_left;
+		if (pLeft == pRover) {
+			// startOffsetInRover is unchanged.
+		} else if (pLeft == nullptr) {
+			// startOffsetInRover has to be changed by the width of
+			// pParent to account for the parent node.
+			startOffsetInRover += pParent->getWidth();
+		} else {
+			// indexInCurrent has to be increased by the weight of
+			// pLeft, plus width of the parent node.
+			startOffsetInRover += pLeft->m_cumWidth + pParent->getWidth();
+		}
+
+		pRover = pParent;
+		pParent = pRover->m_parent;
+	}
+
+	// Parent of pRover is nullptr, and so pRover must be the root.
+	return startOffsetInRover;
+}
+
+
+// To get the index of the element
+IndexType Sequence::getIndex(Element* pElt) const
+{
+	if ((m_pFinger != nullptr) && (pElt == m_pFinger)) {
+		return m_fingerIndex;
+	}
+
+	// The ancestors must have their children in order.
+	pushPath(pElt);
+	const Element* pRover = pElt;
+
+	// indexInRover is the index of 'this' in the
+	// subtree rooted by pRover.
+	IndexType indexInRover;
+
+	if (pRover->m_left == nullptr) {
 		indexInRover = 0;
 	} else {
 		indexInRover = pRover->m_left->m_weight;
 	}
 
-	const Element* pLeft;
-	const Element* pParent = pRover->m_parent;
+	const Element* pLeft;
+	const Element* pParent = pRover->m_parent;
+
+	while (pParent != nullptr) {
+		pLeft = pParent->m_left;
+		if (pLeft == pRover) {
+			// indexInRover is unchanged.
+		} else if (pLeft == nullptr) {
+			// indexInRover has to be changed by 1 to account
+			// for the parent node.
+			indexInRover++;
+		} else {
+			// indexInRover has to be increased by the weight of
+			// pLeft, plus 1 for the parent node.
+			indexInRover += pLeft->m_weight + 1;
+		}
+
+		pRover = pParent;
+		pParent = pRover->m_parent;
+	}
+
+	// When pRover is the root, i.e. pParent == nullptr we are done.
+	return indexInRover;
+}
+
+
+int Sequence::comparePositions(const Element* pA, const Element* pB) const
+{
+	// The ancestors of pA, including the lowest common one, must have
+	// their children in order.
+	pushPath(pA);
+
+	// The children of the common ancestor from which each side came, or
+	// nullptr if the element is the common ancestor itself.
+	const Element* pFromA = nullptr;
+	const Element* pFromB = nullptr;
+
+	while (pA != pB) {
+		// The lower of the two is not the common ancestor.  If they are
+		// equally high, neither of them is.
+		IndexType heightA = pA->m_height;
+		IndexType heightB = pB->m_height;
+		if (heightA <= heightB) {
+			pFromA = pA;
+			pA = pA->m_parent;
+		}
+
+		if (heightB <= heightA) {
+			pFromB = pB;
+			pB = pB->m_parent;
+		}
+	}
+
+	if (pFromA == pFromB) {
+		// The same element.
+		return 0;
+	}
+
+	// One side is the common ancestor itself, or they came from its two
+	// subtrees.
+	if (pFromA == nullptr) {
+		return (pFromB == pA->m_left) ? 1 : -1;
+	}
+
+	if (pFromB == nullptr) {
+		return (pFromA == pA->m_left) ? -1 : 1;
+	}
+
+	return (pFromA == pA->m_left) ? -1 : 1;
+}
+
+
+void Sequence::sortByPosition(vector<Element*>& elts) const
+{
+	vector<std::pair<IndexType, Element*>> indexed;
+	indexed.reserve(elts.size());
+	for (Element* pElt : elts) {
+		indexed.emplace_back(getIndex(pElt), pElt);
+	}
+
+	std::sort(indexed.begin(), indexed.end());
+	for (IndexType i = 0; i < indexed.size(); i++) {
+		elts[i] = indexed[i].second;
+	}
+}
+
+
+Sequence::Iterator Sequence::begin() const
+{
+	return Iterator(this, getFirst());
+}
+
+
+Sequence::Iterator Sequence::end() const
+{
+	return Iterator(this, nullptr);
+}
+
+
+Sequence::Iterator Sequence::iteratorAt(IndexType index) const
+{
+	return Iterator(this, getElement(index));
+}
+
+
+Sequence::Iterator Sequence::iteratorAtOffset(IndexType offset) const
+{
+	return Iterator(this, getElementAtOffset(offset));
+}
+
+
+// The pending updates are pushed down the path, so that the walk that
+// follows starts from an element whose path is up to date.
+Sequence::Element* Sequence::getFirst() const
+{
+	Element* pElt = m_root;
+	if (pElt != nullptr) {
+		pushDown(pElt);
+		while (pElt->m_left != nullptr) {
+			pElt = pElt->m_left;
+			pushDown(pElt);
+		}
+	}
+
+	return pElt;
+}
+
+
+Sequence::Element* Sequence::getLast() const
+{
+	Element* pElt = m_root;
+	if (pElt != nullptr) {
+		pushDown(pElt);
+		while (pElt->m_right != nullptr) {
+			pElt = pElt->m_right;
+			pushDown(pElt);
+		}
+	}
+
+	return pElt;
+}
+
+
+// If the path of pElt is up to date, so is that of the successor: the
+// ancestors are on the path already, and the nodes descended to are
+// pushed on the way.
+Sequence::Element* Sequence::successor(const Element* pElt)
+{
+	Element* pRover;
+
+	if (pElt->m_right != nullptr) {
+		// The successor is the leftmost node of the right subtree.
+		pRover = pElt->m_right;
+		pushDown(pRover);
+		while (pRover->m_left != nullptr) {
+			pRover = pRover->m_left;
+			pushDown(pRover);
+		}
+		return pRover;
+	}
+
+	// The successor is the first ancestor of which pElt is in the
+	// left subtree.
+	pRover = pElt->m_parent;
+	while ((pRover != nullptr) && (pRover->m_right == pElt)) {
+		pElt = pRover;
+		pRover = pRover->m_parent;
+	}
+
+	return pRover;
+}
+
+
+Sequence::Element* Sequence::predecessor(const Element* pElt)
+{
+	Element* pRover;
+
+	if (pElt->m_left != nullptr) {
+		// The predecessor is the rightmost node of the left subtree.
+		pRover = pElt->m_left;
+		pushDown(pRover);
+		while (pRover->m_right != nullptr) {
+			pRover = pRover->m_right;
+			pushDown(pRover);
+		}
+		return pRover;
+	}
+
+	// The predecessor is the first ancestor of which pElt is in the
+	// right subtree.
+	pRover = pElt->m_parent;
+	while ((pRover != nullptr) && (pRover->m_left == pElt)) {
+		pElt = pRover;
+		pRover = pRover->m_parent;
+	}
+
+	return pRover;
+}
 
-	while (pParent != nullptr) {
-		pLeft = pParent->m_left;
-		if (pLeft == pRover) {
-			// indexInRover is unchanged.
-		} else if (pLeft == nullptr) {
-			// indexInRover has to be changed by 1 to account
-			// for the parent node.
-			indexInRover++;
+
+void Sequence::visitInOrder
+             (std::function<void(const Element* pElt)> doVisit) const
+{
+	// Visit in order, from the first element, without recursion.
+	for (Element* pElt = getFirst(); pElt != nullptr; pElt = successor(pElt)) {
+		doVisit(pElt);
+	}
+}
+
+
+void Sequence::visitRange
+             (IndexType from, IndexType to,
+              std::function<void(const Element* pElt)> visitElt) const
+{
+	if ((from > to) || (to > getLength())) {
+		// Error
+		throw std::length_error("Invalid index!");
+	}
+
+	Element* pElt = getElement(from);
+	for (IndexType index = from; index < to; index++) {
+		visitElt(pElt);
+		pElt = successor(pElt);
+	}
+}
+
+
+void Sequence::visitOffsetRange
+             (IndexType fromOffset, IndexType toOffset,
+              std::function<void(const Element* pElt)> visitElt) const
+{
+	IndexType startOffset;
+	Element* pElt = getFirstOverlapping(fromOffset, startOffset);
+
+	while ((pElt != nullptr) && (startOffset < toOffset)) {
+		visitElt(pElt);
+		startOffset += pElt->getWidth();
+		pElt = successor(pElt);
+	}
+}
+
+
+void Sequence::splitIntoChunks(IndexType chunkLength, vector<Element*>& firsts) const
+{
+	if (chunkLength == 0) {
+		throw std::length_error("Invalid chunk length!");
+	}
+
+	if (m_isFingerEnabled) {
+		throw std::logic_error("Cannot split into chunks with the finger enabled!");
+	}
+
+	// The chunks are walked by other threads, which must not write.
+	flushUpdates();
+
+	IndexType length = getLength();
+	for (IndexType from = 0; from < length; from += chunkLength) {
+		IndexType index = 0;
+		IndexType startOffset = 0;
+		firsts.push_back(descend(m_root, from, false, index, startOffset));
+	}
+}
+
+
+Sequence::Element* Sequence::getFirstOverlapping
+                        (IndexType offset, IndexType& startOffset) const
+{
+	Element* pFound = nullptr;
+	Element* pElt = m_root;
+
+	// The start offset of the subtree at pElt.
+	IndexType subtreeOffset = 0;
+
+	while (pElt != nullptr) {
+		pushDown(pElt);
+		IndexType eltOffset = subtreeOffset;
+		if (pElt->m_left != nullptr) {
+			eltOffset += pElt->m_left->m_cumWidth;
+		}
+
+		IndexType endOffset = eltOffset + pElt->getWidth();
+		if ((endOffset > offset) || (eltOffset >= offset)) {
+			// pElt qualifies, but an earlier element may also.
+			pFound = pElt;
+			startOffset = eltOffset;
+			pElt = pElt->m_left;
 		} else {
-			// indexInRover has to be increased by the weight of
-			// pLeft, plus 1 for the parent node.
-			indexInRover += pLeft->m_weight + 1;
+			subtreeOffset = endOffset;
+			pElt = pElt->m_right;
 		}
+	}
 
-		pRover = pParent;
-		pParent = pRover->m_parent;
+	return pFound;
+}
+
+
+Sequence::Cursor::Cursor(Sequence& seq, IndexType index)
+: m_seq(seq), m_start(index)
+{
+	if (index > seq.getLength()) {
+		// Error
+		throw std::length_error("Invalid index!");
 	}
 
-	// When pRover is the root, i.e. pParent == nullptr we are done.
-	return indexInRover;
+	// The widths of the elements are taken as they are walked, which
+	// pushes the pending updates on the paths from the cursor.
+	reset();
 }
 
 
-void Sequence::visitInOrder
-             (std::function<void(const Element* pElt)> doVisit) const
+// A destructor must not throw, so a failure to commit is dropped.  The
+// sequence is then unchanged (see commit).
+Sequence::Cursor::~Cursor()
+{
+	try {
+		commit();
+	} catch (...) {
+	}
+}
+
+
+void Sequence::Cursor::reset()
+{
+	m_isEdited = false;
+	m_takenBefore = 0;
+	m_takenAfter = 0;
+	m_before.clear();
+	m_after.clear();
+	m_erased.clear();
+
+	m_pRight = m_seq.getElement(m_start);
+	m_pLeft = (m_pRight == nullptr) ? m_seq.getLast() : predecessor(m_pRight);
+}
+
+
+bool Sequence::Cursor::takeAfter()
+{
+	if (m_pRight == nullptr) {
+		return false;
+	}
+
+	// This is only done when m_after is empty, so that the element
+	// taken is the one after the cursor.
+	m_after.emplace_back(m_pRight, m_pRight->getWidth());
+	m_pRight = successor(m_pRight);
+	m_takenAfter++;
+	return true;
+}
+
+
+Sequence::Element* Sequence::Cursor::get()
+{
+	if (m_after.empty() && !takeAfter()) {
+		return nullptr;
+	}
+
+	return m_after.back().first;
+}
+
+
+IndexType Sequence::Cursor::getIndex() const
+{
+	return m_start - m_takenBefore + m_before.size();
+}
+
+
+bool Sequence::Cursor::next()
+{
+	if (m_after.empty() && !takeAfter()) {
+		return false;
+	}
+
+	m_before.push_back(m_after.back());
+	m_after.pop_back();
+	return true;
+}
+
+
+bool Sequence::Cursor::prev()
+{
+	if (!m_before.empty()) {
+		m_after.push_back(m_before.back());
+		m_before.pop_back();
+		return true;
+	}
+
+	// The element before the gap buffer is taken into it.
+	if (m_pLeft == nullptr) {
+		return false;
+	}
+
+	m_after.emplace_back(m_pLeft, m_pLeft->getWidth());
+	m_pLeft = predecessor(m_pLeft);
+	m_takenBefore++;
+	return true;
+}
+
+
+void Sequence::Cursor::insertBefore(Element* pNewElt, IndexType width)
+{
+	m_isEdited = true;
+	m_before.emplace_back(pNewElt, width);
+}
+
+
+void Sequence::Cursor::erase()
+{
+	if (m_after.empty() && !takeAfter()) {
+		throw std::range_error("Invalid index!");
+	}
+
+	m_isEdited = true;
+	m_erased.push_back(m_after.back().first);
+	m_after.pop_back();
+}
+
+
+void Sequence::Cursor::setWidth(IndexType width)
+{
+	if (m_after.empty() && !takeAfter()) {
+		throw std::range_error("Invalid index!");
+	}
+
+	m_isEdited = true;
+	m_after.back().second = width;
+}
+
+
+void Sequence::Cursor::commit()
+{
+	if (!m_isEdited) {
+		// The cursor has only moved.
+		m_start = getIndex();
+		reset();
+		return;
+	}
+
+	// The gap buffer is listed in order first.  This is the only
+	// allocation, so if it fails the sequence is unchanged.
+	vector<Element*> elts;
+	elts.reserve(m_before.size() + m_after.size());
+	for (auto& entry : m_before) {
+		elts.push_back(entry.first);
+	}
+
+	for (auto it = m_after.rbegin(); it != m_after.rend(); ++it) {
+		elts.push_back(it->first);
+	}
+
+	// The elements that were taken into the gap buffer are split out of
+	// the tree.  Each of them is now either in the gap buffer or erased.
+	IndexType first = m_start - m_takenBefore;
+	Sequence taken = m_seq.split(first);
+	Sequence rest = taken.split(m_takenBefore + m_takenAfter);
+	taken.forgetElements();
+
+	for (Element* pElt : m_erased) {
+		m_seq.destroyElement(pElt);
+	}
+
+	// The gap buffer is built into a balanced subtree, and joined with
+	// the rest.  Until then, m_cumWidth of each element is its width.
+	for (IndexType i = 0; i < m_before.size(); i++) {
+		elts[i]->m_cumWidth = m_before[i].second;
+	}
+
+	for (IndexType i = 0; i < m_after.size(); i++) {
+		elts[m_before.size() + i]->m_cumWidth = m_after[m_after.size() - 1 - i].second;
+	}
+
+	Sequence middle;
+	middle.m_pPool = m_seq.m_pPool;
+	middle.m_hasAggregate = m_seq.m_hasAggregate;
+	middle.m_root = middle.buildSubtree(elts.data(), elts.size());
+	if (middle.m_root != nullptr) {
+		middle.m_root->m_parent = nullptr;
+	}
+
+	m_seq.concat(std::move(middle));
+	m_seq.concat(std::move(rest));
+
+	m_start = first + m_before.size();
+	reset();
+}
+
+
+FrozenSequence<Sequence::Element*> Sequence::freeze() const
 {
-	// Visit in order from the root at depth 0
-	visitInOrder (m_root, doVisit);
+	vector<Element*> elts;
+	vector<IndexType> widths;
+	elts.reserve(getLength());
+	widths.reserve(getLength());
+
+	for (Element* pElt : *this) {
+		elts.push_back(pElt);
+		widths.push_back(pElt->getWidth());
+	}
+
+	return FrozenSequence<Element*>(std::move(elts), widths);
 }
 
 
@@ -649,22 +2129,6 @@ void Sequence::print() const
 }
 
 
-void Sequence::visitInOrder
-             (const Element* pElt,
-		      std::function<void(const Element* pElt)> visitElt) const
-{
-	if (pElt->m_left != nullptr) {
-		visitInOrder (pElt->m_left, visitElt);
-	}
-
-	visitElt(pElt);
-
-	if (pElt->m_right != nullptr) {
-		visitInOrder(pElt->m_right, visitElt);
-	}
-}
-
-
 void Sequence::printTree(const Element* pElt, IndexType depth) const
 {
 	IndexType blanksCount = depth*4;
@@ -701,68 +2165,61 @@ void Sequence::printTree(const Element* pElt, IndexType depth) const
 // For printing the sequence.
 void Sequence::printTree() const
 {
+	flushUpdates();
 	printTree(m_root, 0);
 }
 
 
-// Updates m_height, m_weight and m_cumWidth attributes.
-void Sequence::updateAttributes(Element* pElt, IndexType width)
+// The new element pElt has just been linked in as a leaf.
+void Sequence::retraceInsertion(Element* pElt, IndexType width)
 {
-	Element* pRover;
-	Element* pLeft;
-	Element* pRight;
-	Element* pParent;
-	IndexType newHeight;
-	IndexType newWeight;
-	IndexType newCumWidth;
-	IndexType parentWidth = 0;
-
-	pRover = pElt;
-	newCumWidth = width;
-	while (pRover != nullptr) {
-		pLeft = pRover->m_left;
-		pRight = pRover->m_right;
-		newHeight = 0;
-		newWeight = 1;
+	pElt->m_left = nullptr;
+	pElt->m_right = nullptr;
+	pElt->m_tagKind = NoTag;
+	pElt->m_tagWidth = 0;
+	pElt->m_isReversed = false;
+	setAttributes(pElt, width);
+
+	retrace(pElt->m_parent, nullptr, true, width);
+}
 
-		if (pLeft != nullptr) {
-			newHeight = pLeft->m_height + 1;
-			newWeight += pLeft->m_weight;
-			newCumWidth += pLeft->m_cumWidth;
-		}
 
-		if (pRight != nullptr) {
-			newHeight = std::max(newHeight, pRight->m_height + 1);
-			newWeight += pRight->m_weight;
-			newCumWidth += pRight->m_cumWidth;
+// The subtrees of pElt and its ancestors gained or lost one element of
+// the given width.  In a single pass to the root, this adjusts their
+// weights and widths, recomputes their heights, and rotates any that
+// has become unbalanced.  Since the weights and widths of all the
+// ancestors change, the pass cannot stop early, but no node on the
+// path is visited twice.
+void Sequence::retrace(Element* pElt, Element* pUpto, bool isInsert, IndexType width)
+{
+	Element* pRover = pElt;
+	while ((pRover != nullptr) && (pRover != pUpto)) {
+		if (isInsert) {
+			pRover->m_weight++;
+			pRover->m_cumWidth += width;
+		} else {
+			pRover->m_weight--;
+			pRover->m_cumWidth -= width;
 		}
 
-		// Before we change the m_cumWidth of pRover, save the parent's
-		// width.  This will be used to compute the m_cumWidth of the
-		// parent in the next iteration.
-		pParent = pRover->m_parent;
-		if (pParent != nullptr) {
-			parentWidth = pParent->getWidth();
-		}
+		pRover->m_height = std::max(subtreeHeight(pRover->m_left),
+				                    subtreeHeight(pRover->m_right)) + 1;
+		updateAggregate(pRover);
 
-		// Now update attributes of pRover.
-		pRover->m_height = newHeight;
-		pRover->m_weight = newWeight;
-		pRover->m_cumWidth = newCumWidth;
+		pRover = rebalanceSubtree(pRover);
+		if (pRover->m_parent == nullptr) {
+			// Need to change the root.
+			m_root = pRover;
+		}
 
-		// If we were only maintaining heights, we could quit when
-		// pRover->m_height is unchanged.  However, with maintaining
-		// the weight and width we need to go all the way to the root.
-		// So update pRover to be pParent, and reinitialize newCumWidth
-		// to be the width that was saved for pParent (parentWidth).
-		pRover = pParent;
-		newCumWidth = parentWidth;
+		pRover = pRover->m_parent;
 	}
 }
 
 
 void Sequence::verify() const
 {
+	flushUpdates();
 	verify(m_root);
 }
 
@@ -786,7 +2243,7 @@ void Sequence::verify(Sequence::Element* pElt) const
 	if (pElt->m_right != nullptr) {
 		delta -= pElt->m_right->m_height;
 		weight += pElt->m_right->m_weight;
-		height = std::max(height, pElt->m_right->m_height + 1);
+		height = std::max<IndexType>(height, pElt->m_right->m_height + 1);
 	}
 
 	if ((delta < -1) || (delta > 1)) {
@@ -841,61 +2298,252 @@ int Sequence::heightDelta(Sequence::Element* pElt)
 }
 
 
-void Sequence::rebalance(Element*& pElt)
+// Prints out which rotations were matched, and which were not.
+void Sequence::printRotationUsage()
 {
-	bool didRotate;
+	std::cout << std::endl << "Rotation usage:" << std::endl;
+	for (const Rotation& rot : s_avlRotations) {
 
-	// First find unbalanced ancestor.
-	int delta;
-	Element* pRover = pElt;
-	while (pRover != nullptr) {
-		delta = heightDelta(pRover);
-		if ((delta == 2) || (delta == -2)) {
-			break;
+		if (rot.isUsed()) {
+			std::cout << rot.getName() << ": used" << std::endl;
+		} else {
+			std::cout << rot.getName() << ": unused" << std::endl;
 		}
-		pRover = pRover->m_parent;
 	}
+}
 
-	if (pRover == nullptr) {
-		// Nothing was rebalanced.  So pElt is unchanged.
-		return;
+
+long Sequence::subtreeHeight(const Element* pElt)
+{
+	return (pElt == nullptr) ? -1 : (long) pElt->m_height;
+}
+
+
+void Sequence::setAttributes(Element* pElt, IndexType width) const
+{
+	Element* pLeft = pElt->m_left;
+	Element* pRight = pElt->m_right;
+
+	pElt->m_height = std::max(subtreeHeight(pLeft), subtreeHeight(pRight)) + 1;
+	pElt->m_weight = 1;
+	pElt->m_cumWidth = width;
+
+	if (pLeft != nullptr) {
+		pElt->m_weight += pLeft->m_weight;
+		pElt->m_cumWidth += pLeft->m_cumWidth;
+	}
+
+	if (pRight != nullptr) {
+		pElt->m_weight += pRight->m_weight;
+		pElt->m_cumWidth += pRight->m_cumWidth;
 	}
 
-	// Go through the vector of rotations, to see if any
-	// match and rebalance
-	size_t count = s_avlRotations.size();
-	for (size_t i = 0; i < count; i++) {
-		Rotation& rot = s_avlRotations[i];
-		didRotate = rot.rotate(*this, pRover);
-		if (didRotate) {
-			if (pRover->m_parent == nullptr) {
-				// Need to change the root.
-				m_root = pRover;
+	updateAggregate(pElt);
+}
+
+
+Sequence::Element* Sequence::rebalanceSubtree(Element* pElt) const
+{
+	int delta = heightDelta(pElt);
+
+	if (delta == 2) {
+		// The widths of the nodes that are relinked must be up to date.
+		Element* pChild = pElt->m_left;
+		pushDown(pElt);
+		pushDown(pChild);
+		pushDown(pChild->m_right);
+		switch (heightDelta(pChild)) {
+		case 1:
+			if (pElt->m_right == nullptr) {
+				return s_avlRotations[LL_a].rotate<LLaPatterns>(pElt, m_hasAggregate);
 			}
+			return s_avlRotations[LL_b].rotate<LLbPatterns>(pElt, m_hasAggregate);
 
-			// pElt is changed to the root of newly balanced subtree
-			pElt = pRover;
-			break;
+		case 0:
+			return s_avlRotations[LR_d].rotate<LLbPatterns>(pElt, m_hasAggregate);
+
+		default:
+			if (pElt->m_right == nullptr) {
+				return s_avlRotations[LR_a].rotate<LRaPatterns>(pElt, m_hasAggregate);
+			}
+
+			switch (heightDelta(pChild->m_right)) {
+			case 1:
+				return s_avlRotations[LR_b].rotate<LRbPatterns>(pElt, m_hasAggregate);
+			case -1:
+				return s_avlRotations[LR_c].rotate<LRbPatterns>(pElt, m_hasAggregate);
+			default:
+				return s_avlRotations[LR_e].rotate<LRbPatterns>(pElt, m_hasAggregate);
+			}
+		}
+	} else if (delta == -2) {
+		Element* pChild = pElt->m_right;
+		pushDown(pElt);
+		pushDown(pChild);
+		pushDown(pChild->m_left);
+		switch (heightDelta(pChild)) {
+		case -1:
+			if (pElt->m_left == nullptr) {
+				return s_avlRotations[RR_a].rotate<RRaPatterns>(pElt, m_hasAggregate);
+			}
+			return s_avlRotations[RR_b].rotate<RRbPatterns>(pElt, m_hasAggregate);
+
+		case 0:
+			return s_avlRotations[RL_d].rotate<RRbPatterns>(pElt, m_hasAggregate);
+
+		default:
+			if (pElt->m_left == nullptr) {
+				return s_avlRotations[RL_a].rotate<RLaPatterns>(pElt, m_hasAggregate);
+			}
+
+			switch (heightDelta(pChild->m_left)) {
+			case 1:
+				return s_avlRotations[RL_b].rotate<RLbPatterns>(pElt, m_hasAggregate);
+			case -1:
+				return s_avlRotations[RL_c].rotate<RLbPatterns>(pElt, m_hasAggregate);
+			default:
+				return s_avlRotations[RL_e].rotate<RLbPatterns>(pElt, m_hasAggregate);
+			}
 		}
 	}
+
+	return pElt;
 }
 
 
-// Prints out which rotations were matched, and which were not.
-void Sequence::printRotationUsage()
+Sequence::Element* Sequence::join(Element* pLeft, Element* pMid, Element* pRight) const
 {
-	std::cout << std::endl << "Rotation usage:" << std::endl;
- 	size_t count = s_avlRotations.size();
-	for (size_t i = 0; i < count; i++) {
-		Rotation& rot = s_avlRotations[i];
-
-		if (rot.isUsed()) {
-			std::cout << rot.getName() << ": used" << std::endl;
-		} else {
-			std::cout << rot.getName() << ": unused" << std::endl;
+	long leftHeight = subtreeHeight(pLeft);
+	long rightHeight = subtreeHeight(pRight);
+
+	if ((leftHeight <= rightHeight + 1) && (rightHeight <= leftHeight + 1)) {
+		// The heights are close enough for pMid to be the root.
+		pMid->m_left = pLeft;
+		pMid->m_right = pRight;
+		pMid->m_parent = nullptr;
+		if (pLeft != nullptr) {
+			pLeft->m_parent = pMid;
+		}
+		if (pRight != nullptr) {
+			pRight->m_parent = pMid;
 		}
+		setAttributes(pMid, pMid->m_cumWidth);
+		return pMid;
+	}
+
+	// The taller subtree is descended along its spine nearest to the
+	// shorter one, to a subtree pSub of about the height of the
+	// shorter one.  pSub is then replaced by pMid(pSub, pShorter), or
+	// pMid(pShorter, pSub).
+	bool leftIsTaller = (leftHeight > rightHeight);
+	Element* pTaller = leftIsTaller ? pLeft : pRight;
+	Element* pShorter = leftIsTaller ? pRight : pLeft;
+	long shorterHeight = leftIsTaller ? rightHeight : leftHeight;
+
+	Element* pParent = nullptr;
+	Element* pSub = pTaller;
+	while (subtreeHeight(pSub) > shorterHeight + 1) {
+		// The children of pSub are relinked or retraced.
+		pushDown(pSub);
+		pParent = pSub;
+		pSub = leftIsTaller ? pSub->m_right : pSub->m_left;
+	}
+
+	IndexType midWidth = pMid->m_cumWidth;
+	pMid->m_left = leftIsTaller ? pSub : pShorter;
+	pMid->m_right = leftIsTaller ? pShorter : pSub;
+	if (pMid->m_left != nullptr) {
+		pMid->m_left->m_parent = pMid;
+	}
+	if (pMid->m_right != nullptr) {
+		pMid->m_right->m_parent = pMid;
+	}
+	setAttributes(pMid, midWidth);
+
+	pMid->m_parent = pParent;
+	if (leftIsTaller) {
+		pParent->m_right = pMid;
+	} else {
+		pParent->m_left = pMid;
+	}
+
+	// Every ancestor of pMid gained pMid and the shorter subtree.
+	IndexType addedWeight = 1;
+	IndexType addedWidth = midWidth;
+	if (pShorter != nullptr) {
+		addedWeight += pShorter->m_weight;
+		addedWidth += pShorter->m_cumWidth;
+	}
+
+	Element* pRover = pParent;
+	Element* pRoot = pTaller;
+	while (pRover != nullptr) {
+		pRover->m_weight += addedWeight;
+		pRover->m_cumWidth += addedWidth;
+		pRover->m_height = std::max(subtreeHeight(pRover->m_left),
+				                    subtreeHeight(pRover->m_right)) + 1;
+		updateAggregate(pRover);
+
+		pRover = rebalanceSubtree(pRover);
+		pRoot = pRover;
+		pRover = pRover->m_parent;
+	}
+
+	return pRoot;
+}
+
+
+// The first element of pRight is split off, to be the middle element.
+Sequence::Element* Sequence::join(Element* pLeft, Element* pRight) const
+{
+	if ((pLeft == nullptr) || (pRight == nullptr)) {
+		return (pLeft == nullptr) ? pRight : pLeft;
 	}
+
+	Element* pMid;
+	Element* pRest;
+	splitSubtree(pRight, 1, pMid, pRest);
+	return join(pLeft, pMid, pRest);
 }
 
 
+void Sequence::splitSubtree(Element* pElt, IndexType index,
+		                    Element*& pLeft, Element*& pRight) const
+{
+	if (pElt == nullptr) {
+		pLeft = nullptr;
+		pRight = nullptr;
+		return;
+	}
+
+	// Detach pElt from its children, so that it can be the middle
+	// element of a join.  Its pending update goes to the children.
+	pushDown(pElt);
+	Element* pEltLeft = pElt->m_left;
+	Element* pEltRight = pElt->m_right;
+	IndexType width = pElt->getWidth();
+	IndexType leftWeight = 0;
+
+	if (pEltLeft != nullptr) {
+		pEltLeft->m_parent = nullptr;
+		leftWeight = pEltLeft->m_weight;
+	}
+
+	if (pEltRight != nullptr) {
+		pEltRight->m_parent = nullptr;
+	}
+
+	pElt->m_left = nullptr;
+	pElt->m_right = nullptr;
+	pElt->m_parent = nullptr;
+	setAttributes(pElt, width);
 
+	Element* pTemp;
+	if (index <= leftWeight) {
+		splitSubtree(pEltLeft, index, pLeft, pTemp);
+		pRight = join(pTemp, pElt, pEltRight);
+	} else {
+		splitSubtree(pEltRight, index - leftWeight - 1, pTemp, pRight);
+		pLeft = join(pEltLeft, pElt, pTemp);
+	}
+}
@@ -7,10 +7,27 @@
 
 #include "inc/Sequence.h"
 #include "inc/GenericSequence.h"
+#include "inc/ElementPool.h"
+#include "inc/Aggregate.h"
+#include "inc/CompactSequence.h"
+#include "inc/BTreeSequence.h"
+#include "inc/ThreadPool.h"
+#include "inc/PersistentSequence.h"
+#include "inc/ConcurrentSequence.h"
+#include "inc/CombiningSequence.h"
+#include "inc/MappedSequence.h"
+#include "inc/FrozenSequence.h"
 #include "TestUtilities.h"
+#include "Benchmark.h"
 
 #include <iostream>
 #include <exception>
+#include <algorithm>
+#include <numeric>
+#include <sstream>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
 
 void testBasic(size_t count)
 {
@@ -177,6 +194,10 @@ void testBasicGeneric(size_t count)
 		Element1()
 		{}
 
+		Element1(const Element1& that)
+		: m_value(that.m_value)
+		{}
+
 		virtual ~Element1() {}
 
 		void setValue(size_t data)
@@ -535,17 +556,2265 @@ void testLRc()
 }
 
 
-int main()
+void testElementPool(size_t count)
 {
-	// The minimum sequence length for an unbalanced tree
-	// is 3 (e.g. $0($1($2,0),0)).  Doing the above tests
-	// from 3 to 40 covers all Rotations except for LR-b
-	// and LR-c.
-	for (size_t count = 3; count <= 40; count++) {
-		testBasic(count);
-		testBasicGeneric(count);
-		testRandom(count);
+	Sequence seq;
+	ElementPool pool(sizeof(TestElement), 16);
+	TestElement* pElt;
+
+	std::cout << "Started testElementPool: " << count << std::endl;
+
+	seq.setElementPool(&pool);
+	for (size_t i = 0; i < count; i++) {
+		pElt = pool.create<TestElement>(i);
+		seq.append(pElt, i + 1);
+	}
+
+	checkSequenceforTestRandom(seq);
+
+	// Remove every other element.  Their slots go back to the pool.
+	for (size_t i = 0; i < count; i += 2) {
+		seq.remove(count - 1 - i);
+	}
+
+	seq.verify();
+	if (pool.getSlotsInUse() != seq.getLength()) {
+		throw logic_error("Pool slots in use differ from sequence length!");
+	}
+
+	// A new element reuses the most recently freed slot.
+	void* pFreed = pool.allocateSlot();
+	pool.deallocateSlot(pFreed);
+	pElt = pool.create<TestElement>(count);
+	if (pElt != pFreed) {
+		throw logic_error("Pool did not reuse a freed slot!");
+	}
+	seq.append(pElt, 1);
+	seq.verify();
+
+	seq.clear();
+	if (pool.getSlotsInUse() != 0) {
+		throw logic_error("Pool slots still in use after clear!");
+	}
+
+	// A GenericSequence of a payload that needs no destruction is
+	// cleared without visiting its elements.
+	struct Point {
+		size_t x = 0;
+		string image() const { return std::to_string(x); }
+	};
+
+	std::pmr::monotonic_buffer_resource upstream;
+	GenericSequence<Point> genSeq(&upstream, 8);
+	Point point;
+	for (size_t i = 0; i < count; i++) {
+		point.x = i;
+		genSeq.insertAtIndex(point, i / 2, 1);
+	}
+
+	genSeq.verify();
+	genSeq.clear();
+	if (genSeq.getLength() != 0) {
+		throw logic_error("GenericSequence is not empty after clear!");
+	}
+
+	std::cout << "Completed testElementPool" << std::endl << std::endl;
+}
+
+
+void testBuild(size_t count)
+{
+	Sequence seq;
+	vector<TestElement*> elts;
+
+	std::cout << "Started testBuild: " << count << std::endl;
+
+	for (size_t i = 0; i < count; i++) {
+		elts.push_back(new TestElement(i));
+	}
+
+	// The width of each element is one more than its value.
+	seq.build(elts.begin(), elts.end(),
+		[](const Sequence::Element* pElt)->IndexType {
+			return ((TestElement*) pElt)->getValue() + 1;
+		});
+
+	checkSequenceforTestRandom(seq);
+
+	// The built tree can be edited as usual.
+	EditOpVec editOps;
+	for (size_t i = 0; i < count; i++) {
+		editOps.push_back(EditOp(rand() % (count - i), false));
+	}
+	editOps.execDo(seq);
+	editOps.execUndo(seq);
+	checkSequenceforTestRandom(seq);
+
+	vector<size_t> values;
+	for (size_t i = 0; i < count; i++) {
+		values.push_back(i);
+	}
+
+	GenericSequence<TestElement> genSeq;
+	genSeq.build(values.begin(), values.end(),
+		[](const TestElement& elt)->IndexType {
+			return ((TestElement&) elt).getValue() + 1;
+		});
+
+	genSeq.verify();
+	IndexType startOffset = 0;
+	for (size_t i = 0; i < count; i++) {
+		if ((genSeq[i].getValue() != i) ||
+			(genSeq.getStartOffset(i) != startOffset)) {
+			string msg = "Unexpected built element at index " +
+					     std::to_string(i);
+			throw logic_error(msg);
+		}
+		startOffset += i + 1;
+	}
+
+	std::cout << "Completed testBuild" << std::endl << std::endl;
+}
+
+
+void testSplitConcat(size_t count)
+{
+	std::cout << "Started testSplitConcat: " << count << std::endl;
+
+	for (size_t index = 0; index <= count; index++) {
+		Sequence seq;
+		for (size_t i = 0; i < count; i++) {
+			seq.append(new TestElement(i), i + 1);
+		}
+
+		Sequence tail = seq.split(index);
+		seq.verify();
+		tail.verify();
+
+		if ((seq.getLength() != index) ||
+			(tail.getLength() != count - index)) {
+			string msg = "Unexpected lengths after split at index " +
+					     std::to_string(index);
+			throw logic_error(msg);
+		}
+
+		if ((tail.getLength() > 0) &&
+			((((TestElement*) tail.getElement(0))->getValue() != index) ||
+			 (tail.getStartOffset(tail.getElement(0)) != 0))) {
+			string msg = "Unexpected tail after split at index " +
+					     std::to_string(index);
+			throw logic_error(msg);
+		}
+
+		// Concatenating a tall sequence with a short one, and the other
+		// way round, joins subtrees of different heights.
+		Sequence middle = seq.split(index / 2);
+		seq.concat(std::move(middle));
+		seq.concat(std::move(tail));
+		checkSequenceforTestRandom(seq);
+		if ((middle.getLength() != 0) || (tail.getLength() != 0)) {
+			throw logic_error("Concatenated sequence is not empty!");
+		}
+	}
+
+	std::cout << "Completed testSplitConcat" << std::endl << std::endl;
+}
+
+
+void testStableRemove(size_t count)
+{
+	Sequence seq;
+	vector<TestElement*> elts;
+
+	std::cout << "Started testStableRemove: " << count << std::endl;
+
+	for (size_t i = 0; i < count; i++) {
+		elts.push_back(new TestElement(i));
+		seq.append(elts.back(), i + 1);
+	}
+
+	// Remove random elements.  The pointers to the remaining elements
+	// must still refer to the same values and widths.
+	while (!elts.empty()) {
+		size_t index = rand() % elts.size();
+		seq.remove(elts[index]);
+		elts.erase(elts.begin() + index);
+		seq.verify();
+
+		IndexType startOffset = 0;
+		for (size_t i = 0; i < elts.size(); i++) {
+			if ((seq.getElement(i) != elts[i]) ||
+				(seq.getIndex(elts[i]) != i) ||
+				(elts[i]->getWidth() != elts[i]->getValue() + 1) ||
+				(seq.getStartOffset(elts[i]) != startOffset)) {
+				string msg = "Element moved by removal at index " +
+						     std::to_string(i);
+				throw logic_error(msg);
+			}
+			startOffset += elts[i]->getWidth();
+		}
+	}
+
+	std::cout << "Completed testStableRemove" << std::endl << std::endl;
+}
+
+
+void testIterators(size_t count)
+{
+	Sequence seq;
+
+	std::cout << "Started testIterators: " << count << std::endl;
+
+	if ((seq.begin() != seq.end()) || (seq.getFirst() != nullptr)) {
+		throw logic_error("Empty sequence has elements!");
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		seq.append(new TestElement(i), i + 1);
+	}
+
+	size_t value = 0;
+	for (Sequence::Element* pElt : seq) {
+		if (((TestElement*) pElt)->getValue() != value) {
+			string msg = "Unexpected element in forward iteration: " +
+					     pElt->image();
+			throw logic_error(msg);
+		}
+		value++;
+	}
+
+	if (value != count) {
+		throw logic_error("Forward iteration missed elements!");
+	}
+
+	// Iterate backwards from the end.
+	Sequence::Iterator it = seq.end();
+	while (it != seq.begin()) {
+		--it;
+		value--;
+		if (((TestElement*) *it)->getValue() != value) {
+			string msg = "Unexpected element in backward iteration: " +
+					     (*it)->image();
+			throw logic_error(msg);
+		}
+	}
+
+	// Iterate from each index.
+	for (size_t i = 0; i < count; i++) {
+		it = seq.iteratorAt(i);
+		if ((IndexType) std::distance(it, seq.end()) != count - i) {
+			string msg = "Unexpected distance to end from index " +
+					     std::to_string(i);
+			throw logic_error(msg);
+		}
+	}
+
+	if (seq.iteratorAt(count) != seq.end()) {
+		throw logic_error("Iterator past the last index is not end!");
+	}
+
+	GenericSequence<TestElement> genSeq;
+	for (size_t i = 0; i < count; i++) {
+		genSeq.append(TestElement(i), 1);
+	}
+
+	size_t sum = std::accumulate(genSeq.begin(), genSeq.end(), (size_t) 0,
+		[](size_t total, TestElement& elt)->size_t {
+			return total + elt.getValue();
+		});
+
+	if (sum != count*(count - 1)/2) {
+		throw logic_error("Unexpected sum over GenericSequence iterators!");
+	}
+
+	auto itFound = std::find_if(genSeq.begin(), genSeq.end(),
+		[count](TestElement& elt)->bool {
+			return elt.getValue() == count/2;
+		});
+
+	if (itFound != genSeq.iteratorAt(count/2)) {
+		throw logic_error("Unexpected result of find_if on GenericSequence!");
+	}
+
+	// The iterators of a const sequence give const values, and the
+	// references of all of them are true references.
+	static_assert(std::is_reference<
+			std::iterator_traits<Sequence::Iterator>::reference>::value,
+			"Sequence::Iterator reference is not a reference");
+	static_assert(std::is_same<
+			std::iterator_traits<GenericSequence<TestElement>::ConstIterator>::reference,
+			const TestElement&>::value,
+			"GenericSequence::ConstIterator reference is not const");
+
+	const GenericSequence<TestElement>& constSeq = genSeq;
+	GenericSequence<TestElement>::ConstIterator itConst = constSeq.end();
+	value = count;
+	for (auto itReverse = std::make_reverse_iterator(itConst);
+		 itReverse != std::make_reverse_iterator(constSeq.begin()); ++itReverse) {
+		value--;
+		if (itReverse->getValue() != value) {
+			throw logic_error("Unexpected element in const reverse iteration!");
+		}
+	}
+
+	if ((value != 0) || (itFound != constSeq.iteratorAt(count/2))) {
+		throw logic_error("Unexpected const iteration over GenericSequence!");
+	}
+
+	std::cout << "Completed testIterators" << std::endl << std::endl;
+}
+
+
+void testVisitRange(size_t count)
+{
+	Sequence seq;
+	vector<IndexType> starts;
+	vector<IndexType> widths;
+	IndexType totalWidth = 0;
+
+	std::cout << "Started testVisitRange: " << count << std::endl;
+
+	// Some of the elements have zero width.
+	for (size_t i = 0; i < count; i++) {
+		starts.push_back(totalWidth);
+		widths.push_back(i % 3);
+		seq.append(new TestElement(i), i % 3);
+		totalWidth += i % 3;
+	}
+
+	vector<size_t> visited;
+	auto collect = [&visited](const Sequence::Element* pElt) {
+		visited.push_back(((TestElement*) pElt)->getValue());
+	};
+
+	for (size_t from = 0; from <= count; from++) {
+		for (size_t to = from; to <= count; to++) {
+			visited.clear();
+			seq.visitRange(from, to, collect);
+
+			bool isValid = (visited.size() == to - from);
+			for (size_t i = 0; isValid && (i < visited.size()); i++) {
+				isValid = (visited[i] == from + i);
+			}
+
+			if (!isValid) {
+				string msg = "Unexpected visit of index range " +
+						     std::to_string(from) + ", " + std::to_string(to);
+				throw logic_error(msg);
+			}
+		}
+	}
+
+	for (IndexType from = 0; from <= totalWidth + 1; from++) {
+		for (IndexType to = from; to <= totalWidth + 1; to++) {
+			visited.clear();
+			seq.visitOffsetRange(from, to, collect);
+
+			vector<size_t> expected;
+			for (size_t i = 0; i < count; i++) {
+				IndexType end = starts[i] + widths[i];
+				if ((starts[i] < to) && ((end > from) || (starts[i] >= from))) {
+					expected.push_back(i);
+				}
+			}
+
+			if (visited != expected) {
+				string msg = "Unexpected visit of offset range " +
+						     std::to_string(from) + ", " + std::to_string(to);
+				throw logic_error(msg);
+			}
+		}
+	}
+
+	std::cout << "Completed testVisitRange" << std::endl << std::endl;
+}
+
+
+// The value of a TestElement, as the Key of an Aggregate.
+struct TestElementValue
+{
+	size_t operator()(const TestElement& elt) const
+	{
+		return elt.getValue();
+	}
+};
+
+
+template <class Aggregate, IndexType SmallCapacity>
+void checkAggregates(GenericSequence<TestElement, Aggregate, SmallCapacity>& seq,
+		             const vector<size_t>& values)
+{
+	seq.verify();
+	for (size_t from = 0; from <= values.size(); from++) {
+		typename Aggregate::ValueType expected = Aggregate::identity();
+		for (size_t to = from; to <= values.size(); to++) {
+			if (seq.aggregate(from, to) != expected) {
+				string msg = "Unexpected aggregate of range " +
+						     std::to_string(from) + ", " + std::to_string(to);
+				throw logic_error(msg);
+			}
+
+			if (to < values.size()) {
+				expected = Aggregate::combine(expected,
+						Aggregate::of(TestElement(values[to]), 1));
+			}
+		}
+	}
+}
+
+
+void testAggregate(size_t count)
+{
+	typedef SumAggregate<TestElement, TestElementValue> Sum;
+	typedef MinAggregate<TestElement, TestElementValue> Min;
+	typedef MaxAggregate<TestElement, TestElementValue> Max;
+
+	GenericSequence<TestElement, Sum> sumSeq;
+	GenericSequence<TestElement, Min> minSeq;
+	GenericSequence<TestElement, Max> maxSeq;
+	vector<size_t> values;
+
+	std::cout << "Started testAggregate: " << count << std::endl;
+
+	// Insert at random indices, so that rotations are done.
+	for (size_t i = 0; i < count; i++) {
+		size_t index = rand() % (values.size() + 1);
+		size_t value = rand() % 100;
+		values.insert(values.begin() + index, value);
+		sumSeq.insertAtIndex(TestElement(value), index, 1);
+		minSeq.insertAtIndex(TestElement(value), index, 1);
+		maxSeq.insertAtIndex(TestElement(value), index, 1);
+	}
+
+	checkAggregates(sumSeq, values);
+	checkAggregates(minSeq, values);
+	checkAggregates(maxSeq, values);
+
+	// Change some values, and remove some elements.
+	for (size_t i = 0; i < count/2; i++) {
+		size_t index = rand() % values.size();
+		values[index] = rand() % 100;
+		sumSeq.set(index, TestElement(values[index]));
+
+		index = rand() % values.size();
+		values.erase(values.begin() + index);
+		sumSeq.remove(index);
+	}
+
+	checkAggregates(sumSeq, values);
+
+	// Find the first index at which the prefix sum exceeds a limit.
+	size_t total = sumSeq.aggregate(0, values.size());
+	for (size_t limit = 0; limit <= total; limit += 7) {
+		IndexType index = sumSeq.findFirst([limit](size_t sum)->bool {
+			return sum > limit;
+		});
+
+		IndexType expected = Sequence::UndefinedIndex;
+		size_t sum = 0;
+		for (size_t i = 0; i < values.size(); i++) {
+			sum += values[i];
+			if (sum > limit) {
+				expected = i;
+				break;
+			}
+		}
+
+		if (index != expected) {
+			string msg = "Unexpected index for prefix sum over " +
+					     std::to_string(limit);
+			throw logic_error(msg);
+		}
+	}
+
+	// The aggregates of a plain Sequence are off, and can only be
+	// switched on while it is empty.
+	Sequence seq;
+	seq.append(new TestElement(0), 1);
+	bool isThrown = false;
+	try {
+		seq.setAggregateEnabled(true);
+	} catch (logic_error&) {
+		isThrown = true;
+	}
+
+	if (!isThrown || seq.isAggregateEnabled()) {
+		throw logic_error("Aggregates enabled on a non-empty sequence!");
+	}
+
+	std::cout << "Completed testAggregate" << std::endl << std::endl;
+}
+
+
+// The tests are run by default.  The benchmarks are run instead if the
+// first argument is "bench".
+void testCompactSequence(size_t count)
+{
+	CompactSequence<size_t> seq;
+	vector<size_t> values;
+	vector<size_t> widths;
+
+	std::cout << "Started testCompactSequence: " << count << std::endl;
+
+	// Insert at random indices, so that rotations are done.
+	for (size_t i = 0; i < count; i++) {
+		size_t index = rand() % (values.size() + 1);
+		size_t width = 1 + rand() % 3;
+		values.insert(values.begin() + index, i);
+		widths.insert(widths.begin() + index, width);
+		seq.insertAtIndex(i, index, width);
+		seq.verify();
+	}
+
+	// Remove and re-width some elements.  The removed nodes are reused.
+	for (size_t i = 0; i < count/2; i++) {
+		size_t index = rand() % values.size();
+		values.erase(values.begin() + index);
+		widths.erase(widths.begin() + index);
+		seq.remove(index);
+		seq.verify();
+
+		index = rand() % values.size();
+		widths[index] = rand() % 3;
+		seq.setWidth(index, widths[index]);
+
+		index = rand() % (values.size() + 1);
+		values.insert(values.begin() + index, count + i);
+		widths.insert(widths.begin() + index, 1);
+		seq.insertAtIndex(count + i, index, 1);
+		seq.verify();
+	}
+
+	if (seq.getLength() != values.size()) {
+		throw logic_error("Unexpected length of CompactSequence");
+	}
+
+	size_t offset = 0;
+	for (size_t i = 0; i < values.size(); i++) {
+		if ((seq[i] != values[i]) || (seq.getWidth(i) != widths[i]) ||
+			(seq.getStartOffset(i) != offset)) {
+			string msg = "Unexpected element of CompactSequence at " +
+					     std::to_string(i);
+			throw logic_error(msg);
+		}
+
+		for (size_t w = 0; w < widths[i]; w++) {
+			if (seq.getElementAtOffset(offset + w) != values[i]) {
+				string msg = "Unexpected element at offset " +
+						     std::to_string(offset + w);
+				throw logic_error(msg);
+			}
+		}
+
+		offset += widths[i];
+	}
+
+	if (!std::equal(seq.begin(), seq.end(), values.begin(), values.end()) ||
+		!std::equal(std::make_reverse_iterator(seq.end()),
+				    std::make_reverse_iterator(seq.begin()),
+				    values.rbegin(), values.rend())) {
+		throw logic_error("Unexpected iteration of CompactSequence");
+	}
+
+	// Build in O(n).
+	seq.build(values.begin(), values.end(), [](size_t)->IndexType { return 2; });
+	seq.verify();
+	if (!std::equal(seq.begin(), seq.end(), values.begin(), values.end()) ||
+		(seq.getStartOffset(values.size() - 1) != 2*(values.size() - 1))) {
+		throw logic_error("Unexpected CompactSequence after build");
+	}
+
+	std::cout << "Completed testCompactSequence" << std::endl << std::endl;
+}
+
+
+// A value whose copy throws when a given number of copies have been
+// made, to test that a failed edit leaves the sequence unchanged.
+struct ThrowingValue
+{
+	ThrowingValue(size_t value = 0)
+	: m_value(value)
+	{}
+
+	ThrowingValue(const ThrowingValue& that)
+	: m_value(that.m_value)
+	{
+		countCopy();
+	}
+
+	ThrowingValue& operator=(const ThrowingValue& that)
+	{
+		countCopy();
+		m_value = that.m_value;
+		return *this;
+	}
+
+	// Moves do not throw, as for most types.
+	ThrowingValue(ThrowingValue&& that) noexcept = default;
+	ThrowingValue& operator=(ThrowingValue&& that) noexcept = default;
+
+	size_t m_value;
+
+	// The copies and assignments until one throws, or 0 for copies that
+	// never throw.
+	static size_t s_copiesLeft;
+
+	static void countCopy()
+	{
+		if ((s_copiesLeft > 0) && (--s_copiesLeft == 0)) {
+			throw std::runtime_error("Copy failed");
+		}
+	}
+};
+
+size_t ThrowingValue::s_copiesLeft = 0;
+
+
+template <class BTree>
+void testBTreeSequence(size_t count)
+{
+	BTree seq;
+	vector<size_t> values;
+	vector<size_t> widths;
+
+	std::cout << "Started testBTreeSequence: " << count << std::endl;
+
+	// Insert at random indices, so that nodes are split at all positions.
+	for (size_t i = 0; i < count; i++) {
+		size_t index = rand() % (values.size() + 1);
+		size_t width = rand() % 3;
+		values.insert(values.begin() + index, i);
+		widths.insert(widths.begin() + index, width);
+		seq.insertAtIndex(i, index, width);
+	}
+	seq.verify();
+
+	// Remove and re-width some elements, so that nodes are merged.
+	for (size_t i = 0; i < count/2; i++) {
+		size_t index = rand() % values.size();
+		values.erase(values.begin() + index);
+		widths.erase(widths.begin() + index);
+		seq.remove(index);
+
+		index = rand() % values.size();
+		widths[index] = 1 + rand() % 3;
+		seq.setWidth(index, widths[index]);
 	}
+	seq.verify();
+
+	if (seq.getLength() != values.size()) {
+		throw logic_error("Unexpected length of BTreeSequence");
+	}
+
+	size_t offset = 0;
+	for (size_t i = 0; i < values.size(); i++) {
+		if ((seq[i] != values[i]) || (seq.getWidth(i) != widths[i]) ||
+			(seq.getStartOffset(i) != offset) || (*seq.iteratorAt(i) != values[i])) {
+			string msg = "Unexpected element of BTreeSequence at " +
+					     std::to_string(i);
+			throw logic_error(msg);
+		}
+
+		for (size_t w = 0; w < widths[i]; w++) {
+			if (seq.getElementAtOffset(offset + w) != values[i]) {
+				string msg = "Unexpected element at offset " +
+						     std::to_string(offset + w);
+				throw logic_error(msg);
+			}
+		}
+
+		offset += widths[i];
+	}
+
+	if (!std::equal(seq.begin(), seq.end(), values.begin(), values.end()) ||
+		!std::equal(std::make_reverse_iterator(seq.end()),
+				    std::make_reverse_iterator(seq.begin()),
+				    values.rbegin(), values.rend())) {
+		throw logic_error("Unexpected iteration of BTreeSequence");
+	}
+
+	// Remove all the rest.
+	while (!values.empty()) {
+		size_t index = rand() % values.size();
+		values.erase(values.begin() + index);
+		seq.remove(index);
+	}
+	seq.verify();
+
+	if ((seq.getLength() != 0) || (seq.begin() != seq.end())) {
+		throw logic_error("BTreeSequence is not empty");
+	}
+
+	// An insertion whose copy of the element throws leaves the leaf
+	// unchanged.
+	BTreeSequence<ThrowingValue> throwing;
+	for (size_t i = 0; i < count; i++) {
+		throwing.append(i, 1);
+		values.push_back(i);
+	}
+
+	for (size_t copies = 1; copies < 40; copies++) {
+		size_t index = rand() % (values.size() + 1);
+		ThrowingValue::s_copiesLeft = copies;
+		try {
+			throwing.insertAtIndex(count + copies, index, 1);
+			values.insert(values.begin() + index, count + copies);
+		} catch (std::runtime_error&) {
+		}
+		ThrowingValue::s_copiesLeft = 0;
+	}
+
+	throwing.verify();
+	if (throwing.getLength() != values.size()) {
+		throw logic_error("Unexpected length of BTreeSequence after a failed insertion");
+	}
+
+	for (size_t i = 0; i < values.size(); i++) {
+		if (throwing[i].m_value != values[i]) {
+			throw logic_error("Unexpected element of BTreeSequence after a failed insertion");
+		}
+	}
+
+	std::cout << "Completed testBTreeSequence" << std::endl << std::endl;
+}
+
+
+void testSmallSequence(size_t count)
+{
+	typedef SumAggregate<TestElement, TestElementValue> Sum;
+	GenericSequence<TestElement, Sum, 8> seq;
+	vector<size_t> values;
+	vector<size_t> widths;
+
+	std::cout << "Started testSmallSequence: " << count << std::endl;
+
+	// Grow past the flat array, shrink back into it, and grow again.
+	for (size_t round = 0; round < 2; round++) {
+		for (size_t i = 0; i < count; i++) {
+			size_t index = rand() % (values.size() + 1);
+			size_t width = rand() % 3;
+			values.insert(values.begin() + index, i);
+			widths.insert(widths.begin() + index, width);
+			seq.insertAtIndex(TestElement(i), index, width);
+
+			if (seq.isSmall() != (values.size() <= 8)) {
+				throw logic_error("Unexpected representation of small sequence");
+			}
+		}
+
+		while (values.size() > 2) {
+			size_t index = rand() % values.size();
+			values.erase(values.begin() + index);
+			widths.erase(widths.begin() + index);
+			seq.remove(index);
+
+			index = rand() % values.size();
+			widths[index] = rand() % 3;
+			seq.setWidth(index, widths[index]);
+
+			size_t offset = 0;
+			for (size_t i = 0; i < values.size(); i++) {
+				if ((seq[i].getValue() != values[i]) ||
+					(seq.getWidth(i) != widths[i]) ||
+					(seq.getStartOffset(i) != offset) ||
+					(seq.iteratorAt(i)->getValue() != values[i])) {
+					string msg = "Unexpected element of small sequence at " +
+							     std::to_string(i);
+					throw logic_error(msg);
+				}
+
+				for (size_t w = 0; w < widths[i]; w++) {
+					if (seq.getElementAtOffset(offset + w).getValue() != values[i]) {
+						string msg = "Unexpected element at offset " +
+								     std::to_string(offset + w);
+						throw logic_error(msg);
+					}
+				}
+
+				offset += widths[i];
+			}
+
+			size_t i = 0;
+			for (const TestElement& elt : seq) {
+				if (elt.getValue() != values[i++]) {
+					throw logic_error("Unexpected iteration of small sequence");
+				}
+			}
+
+			if ((values.size() <= 4) && !seq.isSmall()) {
+				throw logic_error("Small sequence was not moved to the flat array");
+			}
+
+			// An invalid index throws in either representation.
+			bool isThrown = false;
+			try {
+				seq.remove(values.size());
+			} catch (std::range_error&) {
+				isThrown = true;
+			}
+
+			if (!isThrown) {
+				throw logic_error("Invalid index of small sequence was removed");
+			}
+		}
+
+		checkAggregates(seq, values);
+	}
+
+	std::cout << "Completed testSmallSequence" << std::endl << std::endl;
+}
+
+
+void testFinger(size_t count)
+{
+	Sequence seq;
+	vector<size_t> values;
+	vector<size_t> widths;
+
+	std::cout << "Started testFinger: " << count << std::endl;
+
+	seq.setFingerEnabled(true);
+	for (size_t i = 0; i < count; i++) {
+		size_t width = rand() % 3;
+		values.push_back(i);
+		widths.push_back(width);
+		seq.append(new TestElement(i), width);
+	}
+
+	// Each round makes lookups by index and by offset, in order, in
+	// reverse, and at random, and then an edit that drops the finger.
+	for (size_t round = 0; round < 6; round++) {
+		vector<size_t> starts;
+		size_t offset = 0;
+		for (size_t i = 0; i < values.size(); i++) {
+			starts.push_back(offset);
+			offset += widths[i];
+		}
+
+		for (size_t k = 0; k < 3*values.size(); k++) {
+			size_t i = (k < values.size()) ? k :
+					   (k < 2*values.size()) ? 2*values.size() - 1 - k :
+					   rand() % values.size();
+
+			TestElement* pElt = (TestElement*) seq.getElement(i);
+			if ((pElt->getValue() != values[i]) || (seq.getIndex(pElt) != i) ||
+				(seq.getStartOffset(pElt) != starts[i])) {
+				string msg = "Unexpected element from the finger at " +
+						     std::to_string(i);
+				throw logic_error(msg);
+			}
+
+			if (offset > 0) {
+				size_t at = rand() % offset;
+				size_t j = std::upper_bound(starts.begin(), starts.end(), at) -
+						   starts.begin() - 1;
+				while (widths[j] == 0) {
+					j++;
+				}
+
+				pElt = (TestElement*) seq.getElementAtOffset(at);
+				if (pElt->getValue() != values[j]) {
+					string msg = "Unexpected element from the finger at offset " +
+							     std::to_string(at);
+					throw logic_error(msg);
+				}
+			}
+		}
+
+		if (seq.getElement(values.size()) != nullptr) {
+			throw logic_error("Unexpected element past the end");
+		}
+
+		size_t index = rand() % values.size();
+		switch (round % 3) {
+		case 0:
+			values.insert(values.begin() + index, count + round);
+			widths.insert(widths.begin() + index, 2);
+			seq.insertAtIndex(new TestElement(count + round), index, 2);
+			break;
+
+		case 1:
+			values.erase(values.begin() + index);
+			widths.erase(widths.begin() + index);
+			seq.remove(index);
+			break;
+
+		default:
+			widths[index] = 3;
+			seq.setWidth(seq.getElement(index), 3);
+			break;
+		}
+	}
+
+	seq.verify();
+	std::cout << "Completed testFinger" << std::endl << std::endl;
+}
+
+
+void checkCursorSequence(GenericSequence<TestElement>& seq,
+		                 const vector<size_t>& values, const vector<size_t>& widths)
+{
+	seq.verify();
+	if (seq.getLength() != values.size()) {
+		throw logic_error("Unexpected length after cursor edits");
+	}
+
+	size_t offset = 0;
+	for (size_t i = 0; i < values.size(); i++) {
+		if ((seq[i].getValue() != values[i]) || (seq.getWidth(i) != widths[i]) ||
+			(seq.getStartOffset(i) != offset)) {
+			string msg = "Unexpected element after cursor edits at " +
+					     std::to_string(i);
+			throw logic_error(msg);
+		}
+		offset += widths[i];
+	}
+}
+
+
+void testCursor(size_t count)
+{
+	GenericSequence<TestElement> seq;
+	vector<size_t> values;
+	vector<size_t> widths;
+
+	std::cout << "Started testCursor: " << count << std::endl;
+
+	for (size_t i = 0; i < count; i++) {
+		values.push_back(i);
+		widths.push_back(1);
+		seq.append(TestElement(i), 1);
+	}
+
+	size_t newValue = count;
+	for (size_t burst = 0; burst < 8; burst++) {
+		size_t pos = rand() % (values.size() + 1);
+		GenericSequence<TestElement>::Cursor cursor(seq, pos);
+
+		for (size_t op = 0; op < 2*count; op++) {
+			bool isAtEnd = (pos == values.size());
+			switch (rand() % 6) {
+			case 0:
+				if (cursor.next() == isAtEnd) {
+					throw logic_error("Unexpected next of cursor");
+				}
+				pos += isAtEnd ? 0 : 1;
+				break;
+
+			case 1:
+				if (cursor.prev() == (pos == 0)) {
+					throw logic_error("Unexpected prev of cursor");
+				}
+				pos -= (pos == 0) ? 0 : 1;
+				break;
+
+			case 2:
+				values.insert(values.begin() + pos, newValue);
+				widths.insert(widths.begin() + pos, 2);
+				cursor.insertBefore(TestElement(newValue++), 2);
+				pos++;
+				break;
+
+			case 3:
+				if (isAtEnd) {
+					bool isThrown = false;
+					try {
+						cursor.erase();
+					} catch (std::range_error&) {
+						isThrown = true;
+					}
+
+					if (!isThrown) {
+						throw logic_error("Cursor erased past the end");
+					}
+				} else {
+					values.erase(values.begin() + pos);
+					widths.erase(widths.begin() + pos);
+					cursor.erase();
+				}
+				break;
+
+			case 4:
+				if (!isAtEnd) {
+					widths[pos] = rand() % 4;
+					cursor.setWidth(widths[pos]);
+				}
+				break;
+
+			default:
+				// Commits in the middle of a burst.
+				cursor.commit();
+				checkCursorSequence(seq, values, widths);
+				break;
+			}
+
+			TestElement* pElt = cursor.get();
+			if ((cursor.getIndex() != pos) ||
+				((pElt == nullptr) != (pos == values.size())) ||
+				((pElt != nullptr) && (pElt->getValue() != values[pos]))) {
+				string msg = "Unexpected cursor position " + std::to_string(pos);
+				throw logic_error(msg);
+			}
+		}
+
+		cursor.commit();
+		checkCursorSequence(seq, values, widths);
+	}
+
+	std::cout << "Completed testCursor" << std::endl << std::endl;
+}
+
+
+// A random EditOpVec of count edits, for a sequence of the given length.
+EditOpVec randomEditOps(size_t length, size_t count)
+{
+	EditOpVec editOps;
+	for (size_t i = 0; i < count; i++) {
+		bool isInsert = (length == 0) || (rand() % 2 == 0);
+		EditOp editOp(rand() % (length + (isInsert ? 1 : 0)), isInsert);
+		editOp.m_value = 1000 + i;
+		editOp.m_width = rand() % 3;
+		editOps.push_back(editOp);
+		length += isInsert ? 1 : -1;
+	}
+
+	return editOps;
+}
+
+
+void testBatchEdits(size_t count)
+{
+	std::cout << "Started testBatchEdits: " << count << std::endl;
+
+	// Batches from a single edit, which is applied in place, up to
+	// several times the length, for which the tree is rebuilt.  Some
+	// widths have a pending range update, which the edits push down.
+	for (size_t batchSize = 1; batchSize <= 3*count; batchSize += 1 + batchSize/2) {
+		Sequence oneByOne;
+		Sequence batched;
+		for (size_t i = 0; i < count; i++) {
+			oneByOne.append(new TestElement(i), i % 3);
+			batched.append(new TestElement(i), i % 3);
+		}
+		oneByOne.rangeAddWidth(count/3, count/2, 2);
+		batched.rangeAddWidth(count/3, count/2, 2);
+
+		EditOpVec editOps = randomEditOps(count, batchSize);
+		editOps.execBatch(batched);
+		editOps.execDo(oneByOne);
+		batched.verify();
+
+		if (batched.getLength() != oneByOne.getLength()) {
+			throw logic_error("Unexpected length after batch edits");
+		}
+
+		for (size_t i = 0; i < batched.getLength(); i++) {
+			TestElement* pExpected = (TestElement*) oneByOne.getElement(i);
+			TestElement* pElt = (TestElement*) batched.getElement(i);
+			if ((pElt->getValue() != pExpected->getValue()) ||
+				(batched.getWidth(pElt) != oneByOne.getWidth(pExpected)) ||
+				(batched.getStartOffset(pElt) != oneByOne.getStartOffset(pExpected))) {
+				string msg = "Unexpected element after batch edits at " +
+						     std::to_string(i) + ": " + editOps.image();
+				throw logic_error(msg);
+			}
+		}
+	}
+
+	// An invalid batch leaves the sequence unchanged.
+	Sequence seq;
+	for (size_t i = 0; i < count; i++) {
+		seq.append(new TestElement(i), 1);
+	}
+
+	vector<Sequence::Edit> edits(2);
+	edits[0].m_index = 0;
+	edits[0].m_isInsert = false;
+	edits[1].m_index = count;
+	edits[1].m_isInsert = false;
+
+	bool isThrown = false;
+	try {
+		seq.applyEdits(edits);
+	} catch (std::length_error&) {
+		isThrown = true;
+	}
+
+	if (!isThrown || (seq.getLength() != count)) {
+		throw logic_error("Invalid batch of edits was applied");
+	}
+
+	std::cout << "Completed testBatchEdits" << std::endl << std::endl;
+}
+
+
+void checkPersistentSequence(const PersistentSequence<size_t>& seq,
+		                     const vector<size_t>& values,
+		                     const vector<size_t>& widths)
+{
+	seq.verify();
+	if (seq.getLength() != values.size()) {
+		throw logic_error("Unexpected length of PersistentSequence");
+	}
+
+	size_t offset = 0;
+	for (size_t i = 0; i < values.size(); i++) {
+		if ((seq[i] != values[i]) || (seq.getWidth(i) != widths[i]) ||
+			(seq.getStartOffset(i) != offset) ||
+			(*seq.iteratorAt(i) != values[i])) {
+			string msg = "Unexpected element of PersistentSequence at " +
+					     std::to_string(i);
+			throw logic_error(msg);
+		}
+
+		for (size_t w = 0; w < widths[i]; w++) {
+			if (seq.getElementAtOffset(offset + w) != values[i]) {
+				string msg = "Unexpected element at offset " +
+						     std::to_string(offset + w);
+				throw logic_error(msg);
+			}
+		}
+
+		offset += widths[i];
+	}
+
+	if (!std::equal(seq.begin(), seq.end(), values.begin(), values.end()) ||
+		!std::equal(seq.iteratorAt(values.size() / 2), seq.end(),
+				    values.begin() + values.size() / 2, values.end())) {
+		throw logic_error("Unexpected iteration of PersistentSequence");
+	}
+}
+
+
+void testPersistentSequence(size_t count)
+{
+	PersistentSequence<size_t> seq;
+	vector<size_t> values;
+	vector<size_t> widths;
+
+	// Snapshots taken along the way, with what they should hold.
+	vector<PersistentSequence<size_t>> snapshots;
+	vector<vector<size_t>> snapshotValues;
+	vector<vector<size_t>> snapshotWidths;
+
+	std::cout << "Started testPersistentSequence: " << count << std::endl;
+
+	for (size_t i = 0; i < 2*count; i++) {
+		size_t index = rand() % (values.size() + 1);
+		size_t op = rand() % 4;
+		if ((op == 0) && !values.empty()) {
+			index = rand() % values.size();
+			values.erase(values.begin() + index);
+			widths.erase(widths.begin() + index);
+			seq.remove(index);
+		} else if ((op == 1) && !values.empty()) {
+			index = rand() % values.size();
+			widths[index] = rand() % 3;
+			seq.setWidth(index, widths[index]);
+		} else if ((op == 2) && !values.empty()) {
+			index = rand() % values.size();
+			values[index] = count + i;
+			seq.set(index, values[index]);
+		} else {
+			values.insert(values.begin() + index, i);
+			widths.insert(widths.begin() + index, 1 + rand() % 3);
+			seq.insertAtIndex(i, index, widths[index]);
+		}
+
+		if (i % 3 == 0) {
+			snapshots.push_back(seq.snapshot());
+			snapshotValues.push_back(values);
+			snapshotWidths.push_back(widths);
+			if (!snapshots.back().isSharedWith(seq)) {
+				throw logic_error("Snapshot is not shared");
+			}
+		}
+	}
+
+	checkPersistentSequence(seq, values, widths);
+	for (size_t i = 0; i < snapshots.size(); i++) {
+		checkPersistentSequence(snapshots[i], snapshotValues[i], snapshotWidths[i]);
+	}
+
+	// An edit of a snapshot does not affect the sequence.
+	PersistentSequence<size_t> snapshot = seq.snapshot();
+	snapshot.build(values.begin(), values.end(), [](size_t)->IndexType { return 2; });
+	snapshot.append(count, 1);
+	snapshot.verify();
+	checkPersistentSequence(seq, values, widths);
+
+	// A reader scans a snapshot while the sequence is edited.
+	PersistentSequence<size_t> reader = seq.snapshot();
+	std::thread readerThread([&reader, &values, &widths]() {
+		checkPersistentSequence(reader, values, widths);
+	});
+
+	for (size_t i = 0; i < count; i++) {
+		seq.insertAtIndex(i, rand() % (seq.getLength() + 1), 1);
+		seq.remove(rand() % seq.getLength());
+	}
+	readerThread.join();
+
+	std::cout << "Completed testPersistentSequence" << std::endl << std::endl;
+}
+
+
+void testConcurrentSequence(size_t count)
+{
+	ConcurrentSequence<size_t> seq;
+	vector<size_t> values;
+	vector<size_t> widths;
+
+	std::cout << "Started testConcurrentSequence: " << count << std::endl;
+
+	for (size_t i = 0; i < 2*count; i++) {
+		size_t index = rand() % (values.size() + 1);
+		size_t op = rand() % 4;
+		if ((op == 0) && !values.empty()) {
+			index = rand() % values.size();
+			values.erase(values.begin() + index);
+			widths.erase(widths.begin() + index);
+			seq.remove(index);
+		} else if ((op == 1) && !values.empty()) {
+			index = rand() % values.size();
+			widths[index] = rand() % 3;
+			seq.setWidth(index, widths[index]);
+		} else if ((op == 2) && !values.empty()) {
+			index = rand() % values.size();
+			values[index] = count + i;
+			seq.set(index, values[index]);
+		} else {
+			values.insert(values.begin() + index, i);
+			widths.insert(widths.begin() + index, 1 + rand() % 3);
+			seq.insertAtIndex(i, index, widths[index]);
+		}
+		seq.verify();
+	}
+
+	size_t offset = 0;
+	for (size_t i = 0; i < values.size(); i++) {
+		if ((seq.get(i) != values[i]) || (seq.getWidth(i) != widths[i]) ||
+			(seq.getStartOffset(i) != offset)) {
+			string msg = "Unexpected element of ConcurrentSequence at " +
+					     std::to_string(i);
+			throw logic_error(msg);
+		}
+
+		for (size_t w = 0; w < widths[i]; w++) {
+			if (seq.getElementAtOffset(offset + w) != values[i]) {
+				string msg = "Unexpected element at offset " +
+						     std::to_string(offset + w);
+				throw logic_error(msg);
+			}
+		}
+
+		offset += widths[i];
+	}
+
+	vector<size_t> visited;
+	seq.visitRange(0, values.size(), [&visited](const size_t& value) {
+		visited.push_back(value);
+	});
+	if (visited != values) {
+		throw logic_error("Unexpected visitRange of ConcurrentSequence");
+	}
+
+	// With no readers, everything retired can be reclaimed.
+	seq.reclaim();
+	if (seq.getRetiredCount() != 0) {
+		throw logic_error("Retired nodes were not reclaimed");
+	}
+
+	// Readers look up the sequence while it is edited.  The writer keeps
+	// the values in ascending order, so each reader checks that every
+	// range it visits is in order, i.e. is from a consistent tree.
+	seq.clear();
+	for (size_t i = 0; i < count; i++) {
+		seq.append(2*i, 1);
+	}
+
+	std::atomic<bool> isDone(false);
+	std::atomic<size_t> errors(0);
+	vector<std::thread> readers;
+	for (size_t r = 0; r < 3; r++) {
+		readers.emplace_back([&seq, &isDone, &errors, r]() {
+			size_t probe = r;
+			do {
+				size_t length = seq.getLength();
+				try {
+					size_t previous = 0;
+					seq.visitRange(0, length, [&previous, &errors](const size_t& value) {
+						if (value < previous) {
+							errors++;
+						}
+						previous = value;
+					});
+					probe = probe * 31 + 7;
+					seq.getElementAtOffset(probe % (length + 1));
+				} catch (std::exception&) {
+					// The sequence shrank since its length was taken.
+				}
+			} while (!isDone);
+		});
+	}
+
+	for (size_t i = 0; i < 20*count; i++) {
+		size_t index = rand() % seq.getLength();
+		size_t value = seq.get(index);
+		if ((index + 1 < seq.getLength()) && (seq.get(index + 1) > value + 1)) {
+			seq.insertAtIndex(value + 1, index + 1, 1);
+		} else if (seq.getLength() > 1) {
+			seq.remove(index);
+		}
+	}
+
+	isDone = true;
+	for (std::thread& reader : readers) {
+		reader.join();
+	}
+
+	seq.verify();
+	if (errors != 0) {
+		throw logic_error("A reader saw an inconsistent ConcurrentSequence");
+	}
+
+	// An edit whose copy of an element throws is dropped, and the nodes
+	// that it would have replaced stay in the tree, so that the later
+	// edits do not reclaim them.
+	ConcurrentSequence<ThrowingValue> throwing;
+	vector<size_t> expected;
+	for (size_t i = 0; i < count; i++) {
+		throwing.append(i, 1);
+		expected.push_back(i);
+	}
+
+	for (size_t copies = 1; copies < 40; copies++) {
+		size_t index = rand() % (expected.size() + 1);
+		ThrowingValue::s_copiesLeft = copies;
+		try {
+			throwing.insertAtIndex(count + copies, index, 1);
+			expected.insert(expected.begin() + index, count + copies);
+		} catch (std::runtime_error&) {
+		}
+
+		ThrowingValue::s_copiesLeft = copies;
+		try {
+			throwing.setWidth(rand() % expected.size(), 1);
+		} catch (std::runtime_error&) {
+		}
+		ThrowingValue::s_copiesLeft = 0;
+	}
+
+	for (size_t i = 0; i < 3*count; i++) {
+		throwing.setWidth(rand() % expected.size(), 1);
+	}
+
+	throwing.verify();
+	for (size_t i = 0; i < expected.size(); i++) {
+		if (throwing.get(i).m_value != expected[i]) {
+			string msg = "Unexpected element after a failed edit at " +
+					     std::to_string(i);
+			throw logic_error(msg);
+		}
+	}
+
+	std::cout << "Completed testConcurrentSequence" << std::endl << std::endl;
+}
+
+
+void testCombiningSequence(size_t count)
+{
+	Sequence seq;
+	CombiningSequence combining(seq);
+	const size_t threadCount = 4;
+
+	std::cout << "Started testCombiningSequence: " << count << std::endl;
+
+	// Each thread inserts count elements, and then removes half as many.
+	vector<std::thread> threads;
+	for (size_t t = 0; t < threadCount; t++) {
+		threads.emplace_back([&combining, count, t]() {
+			size_t probe = t;
+			// The index is taken in the operation, as the length may be
+			// changed by other threads in between operations.
+			for (size_t i = 0; i < count; i++) {
+				TestElement* pElt = new TestElement(t * count + i);
+				auto op = [&probe, pElt](Sequence& seq) {
+					probe = probe * 31 + 7;
+					seq.insertAtIndex(pElt, probe % (seq.getLength() + 1), 1);
+				};
+				combining.execute(op);
+			}
+
+			for (size_t i = 0; i < count/2; i++) {
+				auto op = [&probe](Sequence& seq) {
+					probe = probe * 31 + 7;
+					seq.remove(probe % seq.getLength());
+				};
+				combining.execute(op);
+			}
+		});
+	}
+
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+
+	seq.verify();
+	if ((seq.getLength() != threadCount * (count - count/2)) ||
+		(combining.getCombinedCount() != threadCount * (count + count/2))) {
+		throw logic_error("Unexpected length after CombiningSequence");
+	}
+
+	// An exception reaches the thread whose operation threw it.
+	bool isThrown = false;
+	TestElement* pElt = new TestElement(0);
+	try {
+		combining.insertAtIndex(pElt, seq.getLength() + 1);
+	} catch (std::length_error&) {
+		isThrown = true;
+	}
+	delete pElt;
+
+	if (!isThrown || (combining.getElement(0) != seq.getElement(0))) {
+		throw logic_error("Unexpected result from CombiningSequence");
+	}
+
+	std::cout << "Completed testCombiningSequence" << std::endl << std::endl;
+}
+
+
+// A trivially copyable element, for sequence files.
+struct FileTestValue
+{
+	size_t m_value;
+
+	string image() const
+	{
+		return std::to_string(m_value);
+	}
+};
+
+
+struct FileTestValueKey
+{
+	size_t operator()(const FileTestValue& value) const
+	{
+		return value.m_value;
+	}
+};
+
+
+template <class SequenceType>
+void checkSequenceFile(SequenceType& seq, const vector<size_t>& values,
+		               const vector<size_t>& widths)
+{
+	if (seq.getLength() != values.size()) {
+		throw logic_error("Unexpected length of sequence from file");
+	}
+
+	size_t offset = 0;
+	for (size_t i = 0; i < values.size(); i++) {
+		if ((seq[i].m_value != values[i]) || (seq.getWidth(i) != widths[i]) ||
+			(seq.getStartOffset(i) != offset) ||
+			(seq.iteratorAt(i)->m_value != values[i])) {
+			string msg = "Unexpected element of sequence from file at " +
+					     std::to_string(i);
+			throw logic_error(msg);
+		}
+
+		for (size_t w = 0; w < widths[i]; w++) {
+			if (seq.getElementAtOffset(offset + w).m_value != values[i]) {
+				string msg = "Unexpected element at offset " +
+						     std::to_string(offset + w);
+				throw logic_error(msg);
+			}
+		}
+
+		offset += widths[i];
+	}
+}
+
+
+void testSequenceFile(size_t count)
+{
+	typedef SumAggregate<FileTestValue, FileTestValueKey> Sum;
+	GenericSequence<FileTestValue, Sum> seq;
+	vector<size_t> values;
+	vector<size_t> widths;
+
+	std::cout << "Started testSequenceFile: " << count << std::endl;
+
+	for (size_t i = 0; i < count; i++) {
+		size_t index = rand() % (values.size() + 1);
+		values.insert(values.begin() + index, i);
+		widths.insert(widths.begin() + index, rand() % 3);
+		seq.insertAtIndex({i}, index, widths[index]);
+	}
+
+	// Into a sequence, which may or may not fit the flat array, and back.
+	std::stringstream stream;
+	seq.save(stream);
+	GenericSequence<FileTestValue, Sum, 8> loaded;
+	loaded.load(stream);
+	loaded.verify();
+	checkSequenceFile(loaded, values, widths);
+	if (loaded.aggregate(0, count) != std::accumulate(values.begin(), values.end(), (size_t) 0)) {
+		throw logic_error("Unexpected aggregate of sequence from file");
+	}
+
+	std::stringstream again;
+	loaded.save(again);
+	if (again.str() != stream.str()) {
+		throw logic_error("Unexpected sequence file from a loaded sequence");
+	}
+
+	// Mapped in place.
+	const string path = "testSequenceFile.seq";
+	seq.save(path);
+	{
+		MappedSequence<FileTestValue> mapped(path);
+		checkSequenceFile(mapped, values, widths);
+		if (!std::equal(mapped.begin(), mapped.end(), values.begin(), values.end(),
+				[](const FileTestValue& value, size_t expected) {
+					return value.m_value == expected;
+				})) {
+			throw logic_error("Unexpected iteration of MappedSequence");
+		}
+
+		// An invalid index throws as for GenericSequence.
+		bool isThrown = false;
+		try {
+			mapped[count];
+		} catch (std::range_error&) {
+			isThrown = true;
+		}
+
+		if (!isThrown) {
+			throw logic_error("Invalid index of MappedSequence was accepted");
+		}
+	}
+	std::remove(path.c_str());
+
+	// A truncated file, a file whose header has a corrupt count, loaded
+	// or mapped, or a file of another element type, is rejected.
+	size_t rejected = 0;
+	try {
+		GenericSequence<FileTestValue> truncated;
+		std::stringstream shorter(stream.str().substr(0, stream.str().size() - 1));
+		truncated.load(shorter);
+	} catch (std::runtime_error&) {
+		rejected++;
+	}
+
+	string corrupt = stream.str();
+	SequenceFileHeader header;
+	std::memcpy(&header, corrupt.data(), sizeof(header));
+	header.m_count = (uint64_t) 1 << 60;
+	std::memcpy(&corrupt[0], &header, sizeof(header));
+	try {
+		GenericSequence<FileTestValue> huge;
+		std::stringstream corruptStream(corrupt);
+		huge.load(corruptStream);
+	} catch (std::runtime_error&) {
+		rejected++;
+	}
+
+	// The records of 2^60 elements would take exactly 2^64 bytes, so
+	// the header alone must not pass for a file of that many.
+	{
+		std::ofstream out(path, std::ios::binary);
+		out.write(corrupt.data(), sizeof(header));
+	}
+	try {
+		MappedSequence<FileTestValue> huge(path);
+	} catch (std::runtime_error&) {
+		rejected++;
+	}
+	std::remove(path.c_str());
+
+	seq.save(path);
+	try {
+		MappedSequence<std::pair<size_t, size_t>> other(path);
+	} catch (std::runtime_error&) {
+		rejected++;
+	}
+	std::remove(path.c_str());
+
+	if (rejected != 4) {
+		throw logic_error("Invalid sequence file was not rejected");
+	}
+
+	std::cout << "Completed testSequenceFile" << std::endl << std::endl;
+}
+
+
+template <IndexType SmallCapacity>
+void checkParallel(const GenericSequence<TestElement, NoAggregate<TestElement>, SmallCapacity>& seq,
+		           const vector<size_t>& values, ThreadPool& pool, IndexType grain)
+{
+	std::atomic<size_t> sum(0);
+	seq.parallelForEach([&sum](const TestElement& elt) {
+		sum += elt.getValue();
+	}, pool, grain);
+
+	if (sum != std::accumulate(values.begin(), values.end(), (size_t) 0)) {
+		throw logic_error("Unexpected sum from parallelForEach");
+	}
+
+	// Concatenation is order sensitive, so this checks that the chunks
+	// are combined in index order.
+	vector<size_t> inOrder = seq.parallelReduce(vector<size_t>(),
+		[](vector<size_t>& result, const TestElement& elt) {
+			result.push_back(elt.getValue());
+		},
+		[](vector<size_t> left, const vector<size_t>& right) {
+			left.insert(left.end(), right.begin(), right.end());
+			return left;
+		}, pool, grain);
+
+	if (inOrder != values) {
+		throw logic_error("Unexpected order from parallelReduce");
+	}
+}
+
+
+void testParallel(size_t count, IndexType grain)
+{
+	ThreadPool pool(4);
+	GenericSequence<TestElement> seq;
+	GenericSequence<TestElement, NoAggregate<TestElement>, 8> smallSeq;
+	vector<size_t> values;
+
+	std::cout << "Started testParallel: " << count << std::endl;
+
+	checkParallel(seq, values, pool, grain);
+	for (size_t i = 0; i < count; i++) {
+		size_t index = rand() % (values.size() + 1);
+		values.insert(values.begin() + index, i);
+		seq.insertAtIndex(TestElement(i), index);
+		smallSeq.insertAtIndex(TestElement(i), index);
+	}
+
+	checkParallel(seq, values, pool, grain);
+	checkParallel(smallSeq, values, pool, grain);
+
+	// An exception from a task reaches the caller, after which the
+	// pool can still be used.
+	bool isThrown = false;
+	try {
+		seq.parallelForEach([](const TestElement& elt) {
+			if (elt.getValue() == 0) {
+				throw std::range_error("Invalid index!");
+			}
+		}, pool, grain);
+	} catch (std::range_error&) {
+		isThrown = true;
+	}
+
+	if (!isThrown) {
+		throw logic_error("Exception from parallelForEach was lost");
+	}
+	checkParallel(seq, values, pool, grain);
+
+	// The lookups write the finger, so the sequence is not visited in
+	// parallel while it is enabled.
+	seq.setFingerEnabled(true);
+	isThrown = false;
+	try {
+		seq.parallelForEach([](const TestElement&) {}, pool, grain);
+	} catch (logic_error&) {
+		isThrown = true;
+	}
+
+	if (!isThrown) {
+		throw logic_error("parallelForEach allowed with the finger enabled");
+	}
+	seq.setFingerEnabled(false);
+	checkParallel(seq, values, pool, grain);
+
+	std::cout << "Completed testParallel" << std::endl << std::endl;
+}
+
+
+// Checks some elements by lookups, which push the pending range width
+// updates on their paths only, and then all of them by iterating.
+template <class SequenceType>
+void checkRangeWidths(SequenceType& seq, const vector<size_t>& values,
+		              const vector<size_t>& widths)
+{
+	if (seq.getLength() != values.size()) {
+		throw logic_error("Unexpected length after range width update");
+	}
+
+	vector<size_t> starts(values.size() + 1, 0);
+	std::partial_sum(widths.begin(), widths.end(), starts.begin() + 1);
+
+	for (size_t k = 0; (k < 3) && !values.empty(); k++) {
+		size_t i = rand() % values.size();
+		if ((seq.getWidth(i) != widths[i]) || (seq.getStartOffset(i) != starts[i])) {
+			string msg = "Unexpected width after range width update at " +
+					     std::to_string(i);
+			throw logic_error(msg);
+		}
+
+		if ((widths[i] > 0) &&
+			(seq.getElementAtOffset(starts[i] + widths[i] - 1).getValue() != values[i])) {
+			throw logic_error("Unexpected element at offset after range width update");
+		}
+	}
+
+	size_t i = 0;
+	for (const TestElement& elt : seq) {
+		if ((elt.getValue() != values[i]) || (seq.getWidth(i) != widths[i]) ||
+			(seq.getStartOffset(i) != starts[i])) {
+			string msg = "Unexpected element after range width update at " +
+					     std::to_string(i);
+			throw logic_error(msg);
+		}
+		i++;
+	}
+}
+
+
+template <IndexType SmallCapacity>
+void testRangeWidth(size_t count)
+{
+	GenericSequence<TestElement, NoAggregate<TestElement>, SmallCapacity> seq;
+	vector<size_t> values;
+	vector<size_t> widths;
+
+	std::cout << "Started testRangeWidth: " << count << std::endl;
+
+	for (size_t i = 0; i < count; i++) {
+		seq.append(TestElement(i), i % 3);
+		values.push_back(i);
+		widths.push_back(i % 3);
+	}
+
+	for (size_t step = 0; step < 4*count; step++) {
+		size_t from = rand() % (values.size() + 1);
+		size_t to = from + rand() % (values.size() - from + 1);
+
+		switch (rand() % 6) {
+		case 0:
+			seq.rangeSetWidth(from, to, step % 5);
+			std::fill(widths.begin() + from, widths.begin() + to, step % 5);
+			break;
+
+		case 1:
+			seq.rangeAddWidth(from, to, 2);
+			for (size_t i = from; i < to; i++) {
+				widths[i] += 2;
+			}
+			break;
+
+		case 2:
+			// Only subtract from widths that stay non-negative.
+			if (std::all_of(widths.begin() + from, widths.begin() + to,
+					        [](size_t width) { return width > 0; })) {
+				seq.rangeAddWidth(from, to, -1);
+				for (size_t i = from; i < to; i++) {
+					widths[i]--;
+				}
+			}
+			break;
+
+		case 3:
+			seq.insertAtIndex(TestElement(count + step), from, step % 4);
+			values.insert(values.begin() + from, count + step);
+			widths.insert(widths.begin() + from, step % 4);
+			break;
+
+		case 4:
+			if (from < values.size()) {
+				seq.remove(from);
+				values.erase(values.begin() + from);
+				widths.erase(widths.begin() + from);
+			}
+			break;
+
+		default:
+			if (from < values.size()) {
+				seq.setWidth(from, step % 7);
+				widths[from] = step % 7;
+			}
+			break;
+		}
+
+		if (step % 5 == 0) {
+			checkRangeWidths(seq, values, widths);
+		}
+	}
+
+	checkRangeWidths(seq, values, widths);
+
+	// Splitting and concatenating carries the pending updates along.
+	Sequence tree;
+	for (size_t i = 0; i < count; i++) {
+		tree.append(new TestElement(i), 1);
+	}
+
+	tree.rangeAddWidth(0, count, 2);
+	tree.rangeSetWidth(count / 3, count, 5);
+	Sequence tail = tree.split(count / 2);
+	tail.rangeAddWidth(0, tail.getLength(), 1);
+	tree.concat(std::move(tail));
+
+	// The traversal pushes the updates down the paths it walks, so the
+	// widths of the elements it hands out are current.
+	IndexType offset = 0;
+	IndexType index = 0;
+	for (Sequence::Element* pElt : tree) {
+		IndexType expected = (index < count / 3) ? 3 : ((index < count / 2) ? 5 : 6);
+		if ((pElt->getWidth() != expected) || (tree.getStartOffset(pElt) != offset)) {
+			throw logic_error("Unexpected width after split and concat");
+		}
+		offset += expected;
+		index++;
+	}
+	tree.verify();
+
+	// So does a walk from the middle, and one backwards from the end.
+	tree.rangeAddWidth(0, count, 1);
+	index = count / 4;
+	tree.visitRange(count / 4, count / 2, [&index, count](const Sequence::Element* pElt) {
+		IndexType expected = (index < count / 3) ? 4 : 6;
+		if (pElt->getWidth() != expected) {
+			throw logic_error("Unexpected width in a range visit after range update");
+		}
+		index++;
+	});
+
+	tree.rangeAddWidth(0, count, 1);
+	index = count;
+	for (Sequence::Iterator it = tree.end(); it != tree.begin(); ) {
+		--it;
+		index--;
+		IndexType expected = (index < count / 3) ? 5 : ((index < count / 2) ? 7 : 8);
+		if ((*it)->getWidth() != expected) {
+			throw logic_error("Unexpected width in a backward walk after range update");
+		}
+	}
+	tree.verify();
+
+	bool isThrown = false;
+	try {
+		seq.rangeSetWidth(0, values.size() + 1, 1);
+	} catch (std::length_error&) {
+		isThrown = true;
+	}
+
+	if (!isThrown) {
+		throw logic_error("Invalid range width update was applied");
+	}
+
+	std::cout << "Completed testRangeWidth" << std::endl << std::endl;
+}
+
+
+template <IndexType SmallCapacity>
+void testReverseMove(size_t count)
+{
+	GenericSequence<TestElement, NoAggregate<TestElement>, SmallCapacity> seq;
+	vector<size_t> values;
+	vector<size_t> widths;
+
+	std::cout << "Started testReverseMove: " << count << std::endl;
+
+	for (size_t i = 0; i < count; i++) {
+		seq.append(TestElement(i), 1 + i % 4);
+		values.push_back(i);
+		widths.push_back(1 + i % 4);
+	}
+
+	for (size_t step = 0; step < 4*count; step++) {
+		size_t from = rand() % (values.size() + 1);
+		size_t to = from + rand() % (values.size() - from + 1);
+		size_t dest = rand() % (values.size() - (to - from) + 1);
+
+		switch (rand() % 5) {
+		case 0:
+		case 1:
+			seq.reverseRange(from, to);
+			std::reverse(values.begin() + from, values.begin() + to);
+			std::reverse(widths.begin() + from, widths.begin() + to);
+			break;
+
+		case 2:
+			seq.moveRange(from, to, dest);
+			for (vector<size_t>* pVec : {&values, &widths}) {
+				vector<size_t> range(pVec->begin() + from, pVec->begin() + to);
+				pVec->erase(pVec->begin() + from, pVec->begin() + to);
+				pVec->insert(pVec->begin() + dest, range.begin(), range.end());
+			}
+			break;
+
+		case 3:
+			seq.rangeAddWidth(from, to, 1);
+			for (size_t i = from; i < to; i++) {
+				widths[i]++;
+			}
+			break;
+
+		default:
+			if (from < values.size()) {
+				seq.remove(from);
+				values.erase(values.begin() + from);
+				widths.erase(widths.begin() + from);
+			} else {
+				seq.insertAtIndex(TestElement(count + step), from, 2);
+				values.insert(values.begin() + from, count + step);
+				widths.insert(widths.begin() + from, 2);
+			}
+			break;
+		}
+
+		if (step % 5 == 0) {
+			checkRangeWidths(seq, values, widths);
+		}
+	}
+
+	checkRangeWidths(seq, values, widths);
+
+	// The elements are relinked, not copied, and their indices are
+	// found while reversals are pending.
+	Sequence tree;
+	vector<TestElement*> elts;
+	for (size_t i = 0; i < count; i++) {
+		elts.push_back(new TestElement(i));
+		tree.append(elts.back(), 1);
+	}
+
+	tree.reverseRange(0, count);
+	tree.reverseRange(count / 4, count / 2);
+	tree.moveRange(0, count / 3, count - count / 3);
+	std::reverse(elts.begin(), elts.end());
+	std::reverse(elts.begin() + count / 4, elts.begin() + count / 2);
+	std::rotate(elts.begin(), elts.begin() + count / 3, elts.end());
+
+	// The traversal pushes the reversals down the paths it walks.
+	if (!std::equal(tree.begin(), tree.end(), elts.begin(), elts.end())) {
+		throw logic_error("Unexpected order after reversal");
+	}
+
+	tree.reverseRange(count / 3, count);
+	std::reverse(elts.begin() + count / 3, elts.end());
+	for (size_t i = 0; i < count; i++) {
+		size_t k = (i * 7) % count;
+		if ((tree.getIndex(elts[k]) != k) || (tree.getStartOffset(elts[k]) != k)) {
+			string msg = "Unexpected index after reversal at " + std::to_string(k);
+			throw logic_error(msg);
+		}
+	}
+
+	tree.verify();
+	if (!std::equal(tree.begin(), tree.end(), elts.begin(), elts.end())) {
+		throw logic_error("Unexpected order after reversal");
+	}
+
+	bool isThrown = false;
+	try {
+		seq.moveRange(0, 1, values.size());
+	} catch (std::length_error&) {
+		isThrown = true;
+	}
+
+	if (!isThrown) {
+		throw logic_error("Invalid range move was applied");
+	}
+
+	std::cout << "Completed testReverseMove" << std::endl << std::endl;
+}
+
+
+void testComparePositions(size_t count)
+{
+	Sequence seq;
+	vector<Sequence::Element*> elts;
+
+	std::cout << "Started testComparePositions: " << count << std::endl;
+
+	for (size_t i = 0; i < count; i++) {
+		elts.push_back(new TestElement(i));
+		seq.insertAtIndex(elts.back(), rand() % (seq.getLength() + 1), 1);
+	}
+
+	for (size_t step = 0; step < 4; step++) {
+		if (step == 2) {
+			// Positions are compared while reversals are pending.
+			seq.reverseRange(count / 4, count);
+			seq.reverseRange(0, count / 2);
+		}
+
+		for (Sequence::Element* pA : elts) {
+			Sequence::Element* pB = elts[rand() % count];
+			IndexType indexA = seq.getIndex(pA);
+			IndexType indexB = seq.getIndex(pB);
+			int expected = (indexA < indexB) ? -1 : ((indexA > indexB) ? 1 : 0);
+			if ((seq.comparePositions(pA, pB) != expected) ||
+				(seq.comparePositions(pB, pA) != -expected)) {
+				string msg = "Unexpected comparison of positions " +
+						     std::to_string(indexA) + " and " + std::to_string(indexB);
+				throw logic_error(msg);
+			}
+		}
+
+		// Sorting a shuffled copy gives the order of the sequence.
+		vector<Sequence::Element*> sorted = elts;
+		for (size_t i = count - 1; i > 0; i--) {
+			std::swap(sorted[i], sorted[rand() % (i + 1)]);
+		}
+		seq.sortByPosition(sorted);
+
+		vector<Sequence::Element*> compared = elts;
+		std::sort(compared.begin(), compared.end(),
+			[&seq](const Sequence::Element* pA, const Sequence::Element* pB) {
+				return seq.comparePositions(pA, pB) < 0;
+			});
+
+		if (!std::equal(seq.begin(), seq.end(), sorted.begin(), sorted.end()) ||
+			(compared != sorted)) {
+			throw logic_error("Unexpected order of sorted elements");
+		}
+	}
+
+	std::cout << "Completed testComparePositions" << std::endl << std::endl;
+}
+
+
+template <IndexType SmallCapacity>
+void testBatchLookups(size_t count)
+{
+	GenericSequence<TestElement, NoAggregate<TestElement>, SmallCapacity> seq;
+	Sequence tree;
+	vector<size_t> starts;
+	size_t offset = 0;
+
+	std::cout << "Started testBatchLookups: " << count << std::endl;
+
+	// Some elements have no width, so offsets are at elements of
+	// non-zero width only.
+	for (size_t i = 0; i < count; i++) {
+		seq.append(TestElement(i), i % 3);
+		tree.append(new TestElement(i), i % 3);
+		starts.push_back(offset);
+		offset += i % 3;
+	}
+
+	// Pending reversals and width updates are pushed by the lookups.
+	tree.reverseRange(0, count / 2);
+	tree.rangeAddWidth(count / 3, count, 1);
+
+	for (size_t step = 0; step < 4; step++) {
+		vector<IndexType> indices;
+		vector<IndexType> offsets;
+		for (size_t k = 0; k < count / 2 + step; k++) {
+			indices.push_back(rand() % count);
+			offsets.push_back(rand() % offset);
+		}
+
+		vector<IndexType> sortedIndices = indices;
+		vector<IndexType> sortedOffsets = offsets;
+		std::sort(sortedIndices.begin(), sortedIndices.end());
+		std::sort(sortedOffsets.begin(), sortedOffsets.end());
+
+		vector<TestElement> values;
+		seq.getElements(sortedIndices, values);
+		for (size_t k = 0; k < sortedIndices.size(); k++) {
+			if (values[k].getValue() != sortedIndices[k]) {
+				throw logic_error("Unexpected element from getElements");
+			}
+		}
+
+		seq.getElementsAtOffsets(sortedOffsets, values);
+		for (size_t k = 0; k < sortedOffsets.size(); k++) {
+			if (values[k].getValue() != seq.getElementAtOffset(sortedOffsets[k]).getValue()) {
+				throw logic_error("Unexpected element from getElementsAtOffsets");
+			}
+		}
+
+		// Lookups past the end give nullptr, in both ways.
+		sortedIndices.push_back(count);
+		vector<Sequence::Element*> sorted;
+		vector<Sequence::Element*> interleaved;
+		tree.getElements(sortedIndices, sorted);
+		tree.getElementsInterleaved(sortedIndices, interleaved);
+		if ((sorted != interleaved) || (sorted.back() != nullptr)) {
+			throw logic_error("Unexpected elements from getElementsInterleaved");
+		}
+
+		tree.getElementsInterleaved(indices, interleaved);
+		for (size_t k = 0; k < indices.size(); k++) {
+			if (interleaved[k] != tree.getElement(indices[k])) {
+				throw logic_error("Unexpected element from getElementsInterleaved");
+			}
+		}
+
+		tree.getElementsAtOffsets(sortedOffsets, sorted);
+		tree.getElementsAtOffsetsInterleaved(offsets, interleaved);
+		for (size_t k = 0; k < sortedOffsets.size(); k++) {
+			if (sorted[k] != tree.getElementAtOffset(sortedOffsets[k])) {
+				throw logic_error("Unexpected element from getElementsAtOffsets");
+			}
+		}
+
+		for (size_t k = 0; k < offsets.size(); k++) {
+			if (interleaved[k] != tree.getElementAtOffset(offsets[k])) {
+				throw logic_error("Unexpected element from getElementsAtOffsetsInterleaved");
+			}
+		}
+	}
+
+	bool isThrown = false;
+	try {
+		vector<Sequence::Element*> elts;
+		tree.getElements({1, 0}, elts);
+	} catch (std::logic_error&) {
+		isThrown = true;
+	}
+
+	if (!isThrown) {
+		throw logic_error("Unsorted batched lookups were accepted");
+	}
+
+	std::cout << "Completed testBatchLookups" << std::endl << std::endl;
+}
+
+
+template <IndexType SmallCapacity>
+void testFrozenSequence(size_t count)
+{
+	GenericSequence<TestElement, NoAggregate<TestElement>, SmallCapacity> seq;
+	vector<size_t> values;
+	vector<size_t> widths;
+
+	std::cout << "Started testFrozenSequence: " << count << std::endl;
+
+	if (seq.freeze().getLength() != 0) {
+		throw logic_error("Unexpected length of empty FrozenSequence");
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		size_t index = rand() % (values.size() + 1);
+		seq.insertAtIndex(TestElement(i), index, i % 3);
+		values.insert(values.begin() + index, i);
+		widths.insert(widths.begin() + index, i % 3);
+	}
+
+	// The frozen copy is not changed by later edits of the sequence.
+	FrozenSequence<TestElement> frozen = seq.freeze();
+	seq.remove(0);
+
+	size_t offset = 0;
+	for (size_t i = 0; i < count; i++) {
+		if ((frozen[i].getValue() != values[i]) || (frozen.getWidth(i) != widths[i]) ||
+			(frozen.getStartOffset(i) != offset) ||
+			(frozen.iteratorAt(i)->getValue() != values[i])) {
+			string msg = "Unexpected element of FrozenSequence at " + std::to_string(i);
+			throw logic_error(msg);
+		}
+
+		for (size_t w = 0; w < widths[i]; w++) {
+			if ((frozen.getElementAtOffset(offset + w).getValue() != values[i]) ||
+				(frozen.getIndexAtOffset(offset + w) != i)) {
+				string msg = "Unexpected element of FrozenSequence at offset " +
+						     std::to_string(offset + w);
+				throw logic_error(msg);
+			}
+		}
+
+		offset += widths[i];
+	}
+
+	bool isThrown = false;
+	try {
+		frozen.getElementAtOffset(offset);
+	} catch (std::range_error&) {
+		isThrown = true;
+	}
+
+	if (!isThrown || (std::distance(frozen.begin(), frozen.end()) != (long) count)) {
+		throw logic_error("Unexpected end of FrozenSequence");
+	}
+
+	// A frozen Sequence holds its elements, with the pending updates
+	// applied.
+	Sequence tree;
+	for (size_t i = 0; i < count; i++) {
+		tree.append(new TestElement(i), 1);
+	}
+
+	tree.reverseRange(0, count);
+	tree.rangeAddWidth(0, count / 2, 1);
+	FrozenSequence<Sequence::Element*> frozenTree = tree.freeze();
+	for (size_t i = 0; i < count; i++) {
+		size_t width = (i < count / 2) ? 2 : 1;
+		if ((frozenTree[i] != tree.getElement(i)) || (frozenTree.getWidth(i) != width) ||
+			(frozenTree.getElementAtOffset(frozenTree.getStartOffset(i)) != frozenTree[i])) {
+			string msg = "Unexpected element of frozen Sequence at " + std::to_string(i);
+			throw logic_error(msg);
+		}
+	}
+
+	std::cout << "Completed testFrozenSequence" << std::endl << std::endl;
+}
+
+
+int main(int argc, char* argv[])
+{
+	if ((argc > 1) && (string(argv[1]) == "bench")) {
+		runBenchmarks();
+		return 0;
+	}
+
+	// The minimum sequence length for an unbalanced tree
+	// is 3 (e.g. $0($1($2,0),0)).  Doing the above tests
+	// from 3 to 40 covers all Rotations except for LR-b
+	// and LR-c.
+	for (size_t count = 3; count <= 40; count++) {
+		testBasic(count);
+		testBasicGeneric(count);
+		testRandom(count);
+		testElementPool(count);
+		testBuild(count);
+		testSplitConcat(count);
+		testStableRemove(count);
+		testIterators(count);
+		testVisitRange(count);
+		testAggregate(count);
+		testCompactSequence(count);
+		testBTreeSequence<BTreeSequence<size_t, 4, 4>>(count);
+		testSmallSequence(count);
+		testFinger(count);
+		testCursor(count);
+		testBatchEdits(count);
+		testParallel(count, 1);
+		testPersistentSequence(count);
+		testConcurrentSequence(count);
+		testCombiningSequence(count);
+		testSequenceFile(count);
+		testRangeWidth<0>(count);
+		testRangeWidth<8>(count);
+		testReverseMove<0>(count);
+		testReverseMove<8>(count);
+		testComparePositions(count);
+		testBatchLookups<0>(count);
+		testBatchLookups<8>(count);
+		testFrozenSequence<0>(count);
+		testFrozenSequence<8>(count);
+	}
+
+	// Several levels of the default capacities.
+	testBTreeSequence<BTreeSequence<size_t>>(100000);
+	testParallel(100000, GenericSequence<TestElement>::ParallelGrain);
+	testBatchEdits(20000);
+	testRangeWidth<0>(2000);
+	testReverseMove<0>(2000);
+	testComparePositions(100000);
+	testBatchLookups<0>(100000);
+	testFrozenSequence<0>(10000);
+	testConcurrentSequence(1000);
 
 	testEdits("(2,D,2,3)(1,D,1,2)(1,D,3,8)(0,D,0,1)(0,D,4,5)");
 
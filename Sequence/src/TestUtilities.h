@@ -19,6 +19,17 @@ public:
 	: Sequence::Element(), m_value(value)
 	{}
 
+	// A copy has the value only, and is in no sequence.
+	TestElement(const TestElement& that)
+	: Sequence::Element(), m_value(that.m_value)
+	{}
+
+	TestElement& operator=(const TestElement& that)
+	{
+		m_value = that.m_value;
+		return *this;
+	}
+
 	// Virtual destructor
 	virtual ~TestElement() {}
 
@@ -27,7 +38,7 @@ public:
 		return std::to_string(m_value);
 	}
 
-	size_t getValue()
+	size_t getValue() const
 	{
 		return m_value;
 	}
@@ -200,6 +211,25 @@ public:
 		}
 	}
 
+	// Applies all the edits as one batch.  Unlike execDo, the values
+	// and widths of the deleted elements are not recorded.
+	void execBatch(Sequence& seq)
+	{
+		vector<Sequence::Edit> edits;
+		for (EditOp& editOp : *this) {
+			Sequence::Edit edit;
+			edit.m_index = editOp.m_index;
+			edit.m_isInsert = editOp.m_isInsert;
+			if (editOp.m_isInsert) {
+				edit.m_pElt = new TestElement(editOp.m_value);
+				edit.m_width = editOp.m_width;
+			}
+			edits.push_back(edit);
+		}
+
+		seq.applyEdits(edits);
+	}
+
 	void execUndo(Sequence& seq)
 	{
 		size_t count = size();
@@ -0,0 +1,196 @@
+/*
+ * ThreadPool.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: R. Krishnaswamy
+ */
+#include "inc/ThreadPool.h"
+
+// Set on the threads of a pool, so that a task that calls run() falls
+// back to running serially instead of waiting on itself.
+static thread_local bool isPoolThread = false;
+
+// Constructor
+ThreadPool::ThreadPool(IndexType threadCount)
+{
+	if (threadCount == 0) {
+		threadCount = 1;
+	}
+
+	for (IndexType i = 0; i < threadCount; i++) {
+		m_queues.push_back(make_unique<Queue>());
+	}
+
+	// Thread 0 is the caller of run().
+	for (IndexType i = 1; i < threadCount; i++) {
+		m_threads.emplace_back(&ThreadPool::workerLoop, this, i);
+	}
+}
+
+
+// Destructor
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_isStopping = true;
+	}
+	m_wake.notify_all();
+
+	for (std::thread& thread : m_threads) {
+		thread.join();
+	}
+}
+
+
+void ThreadPool::run(IndexType taskCount,
+		             const std::function<void(IndexType task)>& task)
+{
+	if (taskCount == 0) {
+		return;
+	}
+
+	if (m_threads.empty() || (taskCount == 1) || isPoolThread) {
+		for (IndexType i = 0; i < taskCount; i++) {
+			task(i);
+		}
+		return;
+	}
+
+	std::lock_guard<std::mutex> runLock(m_runMutex);
+
+	// The task is published before any of its numbers are queued; a
+	// worker reads it only after taking a number under a queue lock.
+	m_pTask = &task;
+	m_pending = taskCount;
+	m_error = nullptr;
+
+	IndexType threadCount = m_queues.size();
+	for (IndexType i = 0; i < threadCount; i++) {
+		std::lock_guard<std::mutex> lock(m_queues[i]->m_mutex);
+		IndexType from = taskCount * i / threadCount;
+		IndexType to = taskCount * (i + 1) / threadCount;
+		for (IndexType t = from; t < to; t++) {
+			m_queues[i]->m_tasks.push_back(t);
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_generation++;
+	}
+	m_wake.notify_all();
+
+	isPoolThread = true;
+	drain(0);
+	isPoolThread = false;
+
+	std::exception_ptr error;
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_done.wait(lock, [this] { return m_pending == 0; });
+		error = m_error;
+		m_error = nullptr;
+	}
+
+	if (error) {
+		std::rethrow_exception(error);
+	}
+}
+
+
+ThreadPool& ThreadPool::getDefault()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+
+IndexType ThreadPool::defaultThreadCount()
+{
+	IndexType count = std::thread::hardware_concurrency();
+	return (count == 0) ? 1 : count;
+}
+
+
+void ThreadPool::workerLoop(IndexType worker)
+{
+	isPoolThread = true;
+	uint64_t seen = 0;
+
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wake.wait(lock, [this, seen] {
+				return m_isStopping || (m_generation != seen);
+			});
+
+			if (m_isStopping) {
+				return;
+			}
+			seen = m_generation;
+		}
+
+		drain(worker);
+	}
+}
+
+
+void ThreadPool::drain(IndexType worker)
+{
+	IndexType task;
+	while (popOwn(worker, task) || steal(worker, task)) {
+		execute(task);
+	}
+}
+
+
+bool ThreadPool::popOwn(IndexType worker, IndexType& task)
+{
+	Queue& queue = *m_queues[worker];
+	std::lock_guard<std::mutex> lock(queue.m_mutex);
+	if (queue.m_tasks.empty()) {
+		return false;
+	}
+
+	task = queue.m_tasks.front();
+	queue.m_tasks.pop_front();
+	return true;
+}
+
+
+bool ThreadPool::steal(IndexType worker, IndexType& task)
+{
+	IndexType threadCount = m_queues.size();
+	for (IndexType i = 1; i < threadCount; i++) {
+		Queue& victim = *m_queues[(worker + i) % threadCount];
+		std::lock_guard<std::mutex> lock(victim.m_mutex);
+		if (!victim.m_tasks.empty()) {
+			task = victim.m_tasks.back();
+			victim.m_tasks.pop_back();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+void ThreadPool::execute(IndexType task)
+{
+	try {
+		(*m_pTask)(task);
+	} catch (...) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_error) {
+			m_error = std::current_exception();
+		}
+	}
+
+	if (--m_pending == 0) {
+		// Lock, so that the notification cannot slip in between the
+		// caller's check and its wait.
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_done.notify_all();
+	}
+}